@@ -0,0 +1,238 @@
+#ifndef AGGREGATETREE_H
+#define AGGREGATETREE_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <limits>
+#include "avlbst.h"
+
+/**
+* Monoids for AggregateTree. A monoid is any class with
+*     Value identity() const;
+*     Value operator()(const Value& a, const Value& b) const;
+* where operator() is associative and identity() is its neutral element. It
+* does not have to be commutative: values are always combined in key order.
+*/
+template <typename Value>
+struct SumMonoid
+{
+    Value identity() const { return Value(); }
+    Value operator()(const Value& a, const Value& b) const { return a + b; }
+};
+
+template <typename Value>
+struct MinMonoid
+{
+    Value identity() const { return std::numeric_limits<Value>::max(); }
+    Value operator()(const Value& a, const Value& b) const { return (b < a) ? b : a; }
+};
+
+template <typename Value>
+struct MaxMonoid
+{
+    Value identity() const { return std::numeric_limits<Value>::lowest(); }
+    Value operator()(const Value& a, const Value& b) const { return (a < b) ? b : a; }
+};
+
+/**
+* An AVLNode that also stores the combined value of its whole subtree.
+*/
+template <typename Key, typename Value>
+class AggregateNode : public AVLNode<Key, Value>
+{
+public:
+    AggregateNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual ~AggregateNode();
+
+    const Value& getAggregate() const;
+    void setAggregate(const Value& aggregate);
+
+protected:
+    Value aggregate_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the AggregateNode class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value>
+AggregateNode<Key, Value>::AggregateNode(const Key& key, const Value& value, AVLNode<Key, Value> *parent) :
+    AVLNode<Key, Value>(key, value, parent), aggregate_(value)
+{
+
+}
+
+template<class Key, class Value>
+AggregateNode<Key, Value>::~AggregateNode()
+{
+
+}
+
+template<class Key, class Value>
+const Value& AggregateNode<Key, Value>::getAggregate() const
+{
+    return aggregate_;
+}
+
+template<class Key, class Value>
+void AggregateNode<Key, Value>::setAggregate(const Value& aggregate)
+{
+    aggregate_ = aggregate;
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the AggregateNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An AVLTree where every node caches the monoid-combined value of its subtree,
+* kept current by AVLTree's updateNode() hook through inserts, removes,
+* rotations, nodeSwap, range erase and merge. aggregate(lo, hi) then combines
+* O(log n) cached subtrees instead of visiting every item in the range.
+*
+* The cache only sees changes made through the tree, so values cannot be
+* modified in place: operator[] and at() are read-only here, and values
+* reached through an iterator must not be assigned. Use insert() or update()
+* to change a value; update() refreshes the cache along the key's path.
+*/
+template <class Key, class Value, class Monoid = SumMonoid<Value> >
+class AggregateTree : public AVLTree<Key, Value>
+{
+public:
+    explicit AggregateTree(const Monoid& monoid = Monoid());
+
+    // combined value of every item with a key in [lo, hi), in key order
+    Value aggregate(const Key& lo, const Key& hi) const;
+    // combined value of the whole tree, O(1)
+    Value aggregateAll() const;
+
+    Value const & operator[](const Key& key) const;
+    Value const & at(const Key& key) const;
+
+protected:
+    virtual AVLNode<Key,Value>* createNode(const Key& key, const Value& value, AVLNode<Key,Value>* parent);
+    virtual void updateNode(AVLNode<Key,Value>* node);
+
+    // cached aggregate of the subtree at node, identity for NULL
+    Value subtreeAggregate(AVLNode<Key,Value>* node) const;
+
+    Monoid monoid_;
+};
+
+/*
+----------------------------------------------
+Begin implementations for the AggregateTree class.
+----------------------------------------------
+*/
+
+template<class Key, class Value, class Monoid>
+AggregateTree<Key, Value, Monoid>::AggregateTree(const Monoid& monoid)
+    : monoid_(monoid)
+{
+
+}
+
+/**
+* Walks down to the first node inside [lo, hi), then down each side of it:
+* on the left side every node >= lo contributes itself and its whole right
+* subtree, on the right side every node < hi contributes itself and its whole
+* left subtree. Two root-to-leaf paths, so O(log n).
+*/
+template<class Key, class Value, class Monoid>
+Value AggregateTree<Key, Value, Monoid>::aggregate(const Key& lo, const Key& hi) const
+{
+    // find the highest node inside the range
+    AVLNode<Key,Value>* split = static_cast<AVLNode<Key,Value>*>(this->root_);
+    while(split != NULL && (split->getKey() < lo || !(split->getKey() < hi))) {
+        split = (split->getKey() < lo) ? split->getRight() : split->getLeft();
+    }
+    if(split == NULL) {
+        return monoid_.identity();
+    }
+
+    // keys >= lo in the left subtree, collected right to left
+    Value leftPart = monoid_.identity();
+    for(AVLNode<Key,Value>* curr = split->getLeft(); curr != NULL; ) {
+        if(curr->getKey() < lo) {
+            curr = curr->getRight();
+        }
+        else {
+            leftPart = monoid_(monoid_(curr->getValue(), subtreeAggregate(curr->getRight())), leftPart);
+            curr = curr->getLeft();
+        }
+    }
+
+    // keys < hi in the right subtree, collected left to right
+    Value rightPart = monoid_.identity();
+    for(AVLNode<Key,Value>* curr = split->getRight(); curr != NULL; ) {
+        if(curr->getKey() < hi) {
+            rightPart = monoid_(rightPart, monoid_(subtreeAggregate(curr->getLeft()), curr->getValue()));
+            curr = curr->getRight();
+        }
+        else {
+            curr = curr->getLeft();
+        }
+    }
+
+    return monoid_(monoid_(leftPart, split->getValue()), rightPart);
+}
+
+template<class Key, class Value, class Monoid>
+Value AggregateTree<Key, Value, Monoid>::aggregateAll() const
+{
+    return subtreeAggregate(static_cast<AVLNode<Key,Value>*>(this->root_));
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, class Monoid>
+Value const & AggregateTree<Key, Value, Monoid>::operator[](const Key& key) const
+{
+    return AVLTree<Key, Value>::operator[](key);
+}
+template<class Key, class Value, class Monoid>
+Value const & AggregateTree<Key, Value, Monoid>::at(const Key& key) const
+{
+    return AVLTree<Key, Value>::at(key);
+}
+
+template<class Key, class Value, class Monoid>
+AVLNode<Key,Value>* AggregateTree<Key, Value, Monoid>::createNode(const Key& key, const Value& value,
+                                                                  AVLNode<Key,Value>* parent)
+{
+    return new AggregateNode<Key,Value>(key, value, parent);
+}
+
+// helper - aggregate = left subtree, then the node's own value, then right subtree
+template<class Key, class Value, class Monoid>
+void AggregateTree<Key, Value, Monoid>::updateNode(AVLNode<Key,Value>* node)
+{
+    Value aggregate = monoid_(monoid_(subtreeAggregate(node->getLeft()), node->getValue()),
+                              subtreeAggregate(node->getRight()));
+    static_cast<AggregateNode<Key,Value>*>(node)->setAggregate(aggregate);
+}
+
+template<class Key, class Value, class Monoid>
+Value AggregateTree<Key, Value, Monoid>::subtreeAggregate(AVLNode<Key,Value>* node) const
+{
+    if(node == NULL) {
+        return monoid_.identity();
+    }
+    return static_cast<AggregateNode<Key,Value>*>(node)->getAggregate();
+}
+
+/*
+--------------------------------------------
+End implementations for the AggregateTree class.
+--------------------------------------------
+*/
+
+#endif
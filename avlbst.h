@@ -6,6 +6,7 @@
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <vector>
 #include "bst.h"
 
 struct KeyError { };
@@ -28,6 +29,11 @@ public:
     void setBalance (int8_t balance);
     void updateBalance(int8_t diff);
 
+    // Getter/setter for the tombstone flag used by LazyAVLTree. It stays with the
+    // node (not the position) when nodes are swapped.
+    bool isTombstone() const;
+    void setTombstone(bool tombstone);
+
     // Getters for parent, left, and right. These need to be redefined since they
     // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
     // for more information.
@@ -37,6 +43,7 @@ public:
 
 protected:
     int8_t balance_;    // effectively a signed char
+    bool tombstone_;    // fits in the padding after balance_
 };
 
 /*
@@ -50,7 +57,7 @@ protected:
 */
 template<class Key, class Value>
 AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Value> *parent) :
-    Node<Key, Value>(key, value, parent), balance_(0)
+    Node<Key, Value>(key, value, parent), balance_(0), tombstone_(false)
 {
 
 }
@@ -91,6 +98,24 @@ void AVLNode<Key, Value>::updateBalance(int8_t diff)
     balance_ += diff;
 }
 
+/**
+* A getter for the tombstone flag of a AVLNode.
+*/
+template<class Key, class Value>
+bool AVLNode<Key, Value>::isTombstone() const
+{
+    return tombstone_;
+}
+
+/**
+* A setter for the tombstone flag of a AVLNode.
+*/
+template<class Key, class Value>
+void AVLNode<Key, Value>::setTombstone(bool tombstone)
+{
+    tombstone_ = tombstone;
+}
+
 /**
 * An overridden function for getting the parent since a static_cast is necessary to make sure
 * that our node is a AVLNode.
@@ -131,21 +156,87 @@ template <class Key, class Value>
 class AVLTree : public BinarySearchTree<Key, Value>
 {
 public:
-    virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
+    virtual std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+        insert (const std::pair<const Key, Value> &new_item); // TODO
     virtual void remove(const Key& key);  // TODO
+
 protected:
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
 
-    // Add helper functions here
-        // compute height of an AVL subtree
-        int getHeight(AVLNode<Key,Value>* node) const;
+    // Augmentation hooks for derived trees that cache data about each subtree
+        // allocate the node for a new item; override to use a derived node type
+        virtual AVLNode<Key,Value>* createNode(const Key& key, const Value& value, AVLNode<Key,Value>* parent);
+        // recompute node's cached data from its own item and its children.
+        // Called bottom-up on every node whose subtree changed; a no-op here.
+        virtual void updateNode(AVLNode<Key,Value>* node);
+        // updateNode on node and every ancestor, e.g. after a value changed
+        void updatePath(AVLNode<Key,Value>* node);
+
+        // single-descent insert: link a new leaf and retrace, O(log n)
+        virtual Node<Key,Value>* findOrCreate(const Key& key, const Value& value, bool& created);
+        // a value changed in place: updatePath
+        virtual void valueChanged(Node<Key,Value>* node);
 
+    // Add helper functions here
         // rotations
         void rotateL(AVLNode<Key,Value>* node);
         void rotateR(AVLNode<Key,Value>* node);
 
-        // rebalance going up from a given node to root
-        void balance(AVLNode<Key,Value>* node);
+        // link the sorted nodes[lo, hi) into a perfectly balanced subtree under parent,
+        // setting balances along the way. Returns the subtree root and its height.
+        AVLNode<Key,Value>* buildBalanced(std::vector<AVLNode<Key,Value>*>& nodes, size_t lo, size_t hi,
+                                          AVLNode<Key,Value>* parent, int& height);
+
+        // split/join surgery for range erase. These work on detached subtrees
+        // (root parent NULL) and pass heights along so nothing is recomputed.
+        virtual void eraseKeys(const Key* lo, const Key* hi);
+        // erase_if: removes every match and relinks the survivors into a
+        // balanced tree, O(n)
+        virtual void eraseMatching(const typename BinarySearchTree<Key, Value>::ItemPredicate& pred);
+
+        // height read off the balance factors along one root-to-leaf path, O(log n)
+        static int spineHeight(AVLNode<Key,Value>* node);
+
+        // rotate node back into balance if its balance is +-2; returns the subtree root
+        AVLNode<Key,Value>* fixNode(AVLNode<Key,Value>* node);
+
+        // child's subtree just got one taller (or shorter); walk up fixing balances.
+        // Returns the root of the whole tree and whether its height changed.
+        AVLNode<Key,Value>* retraceGrow(AVLNode<Key,Value>* child, bool& grew);
+        AVLNode<Key,Value>* retraceShrink(AVLNode<Key,Value>* parent, bool leftShrank, bool& shrank);
+
+        // left < mid < right, all keys; returns the joined tree and its height
+        AVLNode<Key,Value>* join(AVLNode<Key,Value>* left, int leftH, AVLNode<Key,Value>* mid,
+                                 AVLNode<Key,Value>* right, int rightH, int& height);
+        // join without a middle node: the smallest node of right takes that role
+        AVLNode<Key,Value>* join2(AVLNode<Key,Value>* left, int leftH,
+                                  AVLNode<Key,Value>* right, int rightH, int& height);
+        // merge() support: reuse the nodes of another AVLTree
+        virtual void absorbNodes(Node<Key,Value>* root, const BinarySearchTree<Key, Value>& source);
+
+        // bulk building: nodes come from createNode and get their balance and updateNode
+        virtual Node<Key,Value>* createBuildNode(const Key& key, const Value& value);
+        virtual void finishBuildNode(Node<Key,Value>* node, int leftH, int rightH, int depth, int treeHeight);
+
+        // exporters show each node's balance
+        virtual void annotateNode(Node<Key,Value>* node, std::vector<std::pair<const char*, int> >& fields) const;
+
+        // link a detached node in as a new leaf and retrace, O(log n). If the key
+        // is already present the node only hands over its value and is freed.
+        void insertNode(AVLNode<Key,Value>* node);
+        // a merged-in key is already present: the node already in the tree
+        // stays and takes value. Override to update other per-node state.
+        virtual void takeValue(AVLNode<Key,Value>* node, const Value& value);
+
+        // split the subtree at node (of height h) into keys < key and keys >= key,
+        // or into keys <= key and keys > key when inclusive is set
+        void split(AVLNode<Key,Value>* node, int h, const Key& key,
+                   AVLNode<Key,Value>*& left, int& leftH, AVLNode<Key,Value>*& right, int& rightH,
+                   bool inclusive = false);
+
+        // unlink and free one node (swapping with its predecessor first if it
+        // has two children), then rebalance
+        void removeNode(AVLNode<Key,Value>* node);
 
 
 };
@@ -155,29 +246,38 @@ protected:
  * overwrite the current value with the updated value.
  */
 template<class Key, class Value>
-void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
 {
+    BST_LATENCY_SCOPE(LAT_AVL_INSERT);
     // TODO -> DONE
+    return this->insertItem(new_item);
+}
+
+template<class Key, class Value>
+Node<Key,Value>* AVLTree<Key, Value>::findOrCreate(const Key& key, const Value& value, bool& created)
+{
+    created = false;
     // base case: empty tree - new root
     if(this->root_ == NULL) {
-        AVLNode<Key,Value>* newRoot = new AVLNode<Key,Value>(new_item.first, new_item.second, NULL);
+        AVLNode<Key,Value>* newRoot = createNode(key, value, NULL);
         this->root_ = newRoot;
-        return;
+        created = true;
+        return newRoot;
     }
 
-    // standard BST insert with AVLNode
+    // standard BST descent with AVLNode
     Node<Key,Value>* curr = this->root_;
     Node<Key,Value>* parent = NULL;
 
     while(curr != NULL) {
         parent = curr;
-        // key already exists - overwrite value (no structural change)
-        if(new_item.first == curr->getKey()) {
-            curr->setValue(new_item.second);
-            return;
+        // key already exists - no structural change
+        if(key == curr->getKey()) {
+            return curr;
         }
         // new key is smaller - go left
-        else if(new_item.first < curr->getKey()) {
+        else if(key < curr->getKey()) {
             curr = curr->getLeft();
         }
         // new key is larger - go right
@@ -189,18 +289,27 @@ void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
     // convert parent to AVLNode
     AVLNode<Key,Value>* avlP = static_cast<AVLNode<Key,Value>*>(parent);
     // create new AVLNode
-    AVLNode<Key,Value>* newN = new AVLNode<Key,Value>(new_item.first, new_item.second, avlP);
+    AVLNode<Key,Value>* newN = createNode(key, value, avlP);
 
     // insert new node as left or right child
-    if(new_item.first < parent->getKey()) {
+    if(key < parent->getKey()) {
         parent->setLeft(newN);
     }
     else {
         parent->setRight(newN);
     }
 
-    // rebalance from parent to root
-    balance(avlP);
+    // retrace from the new leaf, stopping once a subtree's height is unchanged
+    bool grew = false;
+    this->root_ = retraceGrow(newN, grew);
+    created = true;
+    return newN;
+}
+
+template<class Key, class Value>
+void AVLTree<Key, Value>::valueChanged(Node<Key,Value>* node)
+{
+    updatePath(static_cast<AVLNode<Key,Value>*>(node));
 }
 
 /*
@@ -210,22 +319,26 @@ void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
 template<class Key, class Value>
 void AVLTree<Key, Value>:: remove(const Key& key)
 {
+    BST_LATENCY_SCOPE(LAT_AVL_REMOVE);
     // TODO -> DONE
     // standard BST remove
     Node<Key, Value>* rNode = this->internalFind(key);
 
-    // convert to AVLNode
-    AVLNode<Key,Value>* avlR = static_cast<AVLNode<Key,Value>*>(rNode);
-
     //base case: key not found, no removal
     if (rNode == NULL) {return;}
 
+    removeNode(static_cast<AVLNode<Key,Value>*>(rNode));
+}
+
+template<class Key, class Value>
+void AVLTree<Key, Value>::removeNode(AVLNode<Key,Value>* rNode)
+{
     // case 1: node has 2 children
     if(rNode->getLeft() != NULL && rNode->getRight() != NULL) {
         // find predecessor
         AVLNode<Key,Value>* pred = static_cast<AVLNode<Key,Value>*>(BinarySearchTree<Key,Value>::predecessor(rNode));
         // swap nodes
-        nodeSwap(avlR, pred);
+        nodeSwap(rNode, pred);
     }
 
     // case 2: 0 or 1 child 
@@ -247,12 +360,14 @@ void AVLTree<Key, Value>:: remove(const Key& key)
     }
 
     // reconnect parent to child
+    bool leftShrank = false;
     if(parent == NULL) {
         this->root_ = child;
     }
     else {
         // determine if left or right child is removed
-        if(parent->getLeft() == rNode) {
+        leftShrank = (parent->getLeft() == rNode);
+        if(leftShrank) {
             parent->setLeft(child);
         }
         else {
@@ -263,9 +378,10 @@ void AVLTree<Key, Value>:: remove(const Key& key)
     delete rNode;
 
     // AVL remove
-    // rebalance from parent of removed node and up
+    // retrace from the parent of the removed node, O(log n)
     if(parent != NULL) {
-        balance(parent);
+        bool shrank = false;
+        this->root_ = retraceShrink(parent, leftShrank, shrank);
     }
 
 }
@@ -277,20 +393,41 @@ void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>*
     int8_t tempB = n1->getBalance();
     n1->setBalance(n2->getBalance());
     n2->setBalance(tempB);
+
+    // every subtree from the lower node up to the upper one now holds a
+    // different item at some position, so refresh that stretch bottom-up
+    AVLNode<Key,Value>* lower = n1;
+    AVLNode<Key,Value>* upper = n2;
+    AVLNode<Key,Value>* curr = n1;
+    while(curr != NULL && curr != n2) { curr = curr->getParent(); }
+    if(curr == NULL) {
+        lower = n2;
+        upper = n1;
+    }
+    for(curr = lower; curr != upper->getParent(); curr = curr->getParent()) {
+        updateNode(curr);
+    }
 }
 
-// helper functions:
-// helper - height of an AVL subtree 
 template<class Key, class Value>
-int AVLTree<Key, Value>::getHeight(AVLNode<Key,Value>* curr) const
+AVLNode<Key,Value>* AVLTree<Key, Value>::createNode(const Key& key, const Value& value, AVLNode<Key,Value>* parent)
 {
-    // base case
-    if(curr == NULL) return 0;
+    return new AVLNode<Key,Value>(key, value, parent);
+}
 
-    // recursively get height
-    int leftH = getHeight(curr->getLeft());
-    int rightH = getHeight(curr->getRight());
-    return std::max(leftH, rightH) + 1;
+template<class Key, class Value>
+void AVLTree<Key, Value>::updateNode(AVLNode<Key,Value>* node)
+{
+    (void)node;
+}
+
+template<class Key, class Value>
+void AVLTree<Key, Value>::updatePath(AVLNode<Key,Value>* node)
+{
+    while(node != NULL) {
+        updateNode(node);
+        node = node->getParent();
+    }
 }
 
 // helper - single left rotation
@@ -335,6 +472,17 @@ void AVLTree<Key, Value>::rotateL(AVLNode<Key,Value>* x) {
 
     // finish rotation by making x left child of y
     y->setLeft(x);
+
+    // update balances from the old ones, O(1)
+        // only x and y changed children, and the subtrees they got are known
+    int xB = x->getBalance() + 1 - std::min<int>(y->getBalance(), 0);
+    int yB = y->getBalance() + 1 + std::max(xB, 0);
+    x->setBalance(xB);
+    y->setBalance(yB);
+
+    // x is now below y
+    updateNode(x);
+    updateNode(y);
 }
 
 // helper - single right rotation
@@ -380,49 +528,519 @@ void AVLTree<Key, Value>::rotateR(AVLNode<Key,Value>* z) {
     // make z the right child of y
     y->setRight(z);
 
-    // update balances using subtree heights
+    // update balances from the old ones, O(1)
         // balance = height(left subtree) - height(right subtree)
-    z->setBalance( getHeight(z->getLeft()) - getHeight(z->getRight()) );
-    y->setBalance( getHeight(y->getLeft()) - getHeight(y->getRight()) );
+    int zB = z->getBalance() - 1 - std::max<int>(y->getBalance(), 0);
+    int yB = y->getBalance() - 1 + std::min(zB, 0);
+    z->setBalance(zB);
+    y->setBalance(yB);
+
+    // z is now below y
+    updateNode(z);
+    updateNode(y);
 
 }
 
-// helper - balance starting from a given node and moving up toward the root.
-    // recompute each node's balance from subtree heights 
-    // perform single or double rotations.
+// helper - build a balanced subtree from sorted nodes in O(hi - lo).
+    // The middle node becomes the root, so the two halves differ by at most one node
+    // and their heights by at most one.
 template<class Key, class Value>
-void AVLTree<Key, Value>::balance(AVLNode<Key,Value>* curr)
+AVLNode<Key,Value>* AVLTree<Key, Value>::buildBalanced(std::vector<AVLNode<Key,Value>*>& nodes, size_t lo, size_t hi,
+                                                       AVLNode<Key,Value>* parent, int& height)
 {
-    while(curr != NULL) {
-        int bFact = getHeight(curr->getLeft()) - getHeight(curr->getRight());
-        curr->setBalance(bFact);
+    // base case: empty range
+    if(lo >= hi) {
+        height = 0;
+        return NULL;
+    }
 
-        // left-heavy
-        if(bFact == 2) {
-            AVLNode<Key,Value>* L = curr->getLeft();
-            int factL = getHeight(L->getLeft()) - getHeight(L->getRight());
+    size_t mid = lo + (hi - lo) / 2;
+    AVLNode<Key,Value>* root = nodes[mid];
+    int leftH = 0;
+    int rightH = 0;
 
-            // case 1: left-right
-            if(factL < 0) {
-                rotateL(L);
+    root->setParent(parent);
+    root->setLeft(buildBalanced(nodes, lo, mid, root, leftH));
+    root->setRight(buildBalanced(nodes, mid + 1, hi, root, rightH));
+    root->setBalance(leftH - rightH);
+    updateNode(root);
+
+    height = std::max(leftH, rightH) + 1;
+    return root;
+}
+
+template<class Key, class Value>
+Node<Key,Value>* AVLTree<Key, Value>::createBuildNode(const Key& key, const Value& value)
+{
+    return createNode(key, value, NULL);
+}
+
+template<class Key, class Value>
+void AVLTree<Key, Value>::finishBuildNode(Node<Key,Value>* node, int leftH, int rightH, int /*depth*/, int /*treeHeight*/)
+{
+    AVLNode<Key,Value>* avlNode = static_cast<AVLNode<Key,Value>*>(node);
+    avlNode->setBalance(leftH - rightH);
+    updateNode(avlNode);
+}
+
+template<class Key, class Value>
+void AVLTree<Key, Value>::annotateNode(Node<Key,Value>* node, std::vector<std::pair<const char*, int> >& fields) const
+{
+    fields.push_back(std::make_pair("balance", (int)static_cast<AVLNode<Key,Value>*>(node)->getBalance()));
+}
+
+/**
+* Removes every item for which pred(item) is true. Every item has to be tested
+* anyway, so instead of k rebalancing removes the survivors are relinked into a
+* perfectly balanced tree in one O(n) pass. No surviving node is reallocated.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::eraseMatching(const typename BinarySearchTree<Key, Value>::ItemPredicate& pred)
+{
+    std::vector<AVLNode<Key,Value>*> keep;
+    std::vector<AVLNode<Key,Value>*> doomed;
+    for(Node<Key,Value>* curr = this->getSmallestNode(); curr != NULL;
+        curr = BinarySearchTree<Key, Value>::successor(curr)) {
+        AVLNode<Key,Value>* avlCurr = static_cast<AVLNode<Key,Value>*>(curr);
+        if(pred(avlCurr->getItem())) {
+            doomed.push_back(avlCurr);
+        }
+        else {
+            keep.push_back(avlCurr);
+        }
+    }
+    if(doomed.empty()) { return; }
+
+    for(size_t i = 0; i < doomed.size(); ++i) {
+        delete doomed[i];
+    }
+    int height = 0;
+    this->root_ = buildBalanced(keep, 0, keep.size(), NULL, height);
+}
+
+/**
+* Removes [*lo, *hi) by splitting the tree at lo and at hi, freeing the middle
+* piece, and joining the outer two: O(log n) plus freeing the k removed nodes.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::eraseKeys(const Key* lo, const Key* hi)
+{
+    AVLNode<Key,Value>* root = static_cast<AVLNode<Key,Value>*>(this->root_);
+    AVLNode<Key,Value>* left = NULL;
+    AVLNode<Key,Value>* mid = root;
+    AVLNode<Key,Value>* right = NULL;
+    int leftH = 0;
+    int midH = spineHeight(root);
+    int rightH = 0;
+
+    if(lo != NULL) {
+        split(root, midH, *lo, left, leftH, mid, midH);
+    }
+    if(hi != NULL) {
+        AVLNode<Key,Value>* rest = mid;
+        split(rest, midH, *hi, mid, midH, right, rightH);
+    }
+
+    this->clearSubtree(mid);
+
+    int height = 0;
+    this->root_ = join2(left, leftH, right, rightH, height);
+}
+
+// helper - height from balances: always step into the taller side
+template<class Key, class Value>
+int AVLTree<Key, Value>::spineHeight(AVLNode<Key,Value>* node)
+{
+    int h = 0;
+    while(node != NULL) {
+        ++h;
+        node = (node->getBalance() >= 0) ? node->getLeft() : node->getRight();
+    }
+    return h;
+}
+
+// helper - single or double rotation at a node whose balance is +-2
+template<class Key, class Value>
+AVLNode<Key,Value>* AVLTree<Key, Value>::fixNode(AVLNode<Key,Value>* node)
+{
+    if(node->getBalance() == 2) {
+        if(node->getLeft()->getBalance() < 0) {
+            rotateL(node->getLeft());
+        }
+        rotateR(node);
+        return node->getParent();
+    }
+    if(node->getBalance() == -2) {
+        if(node->getRight()->getBalance() > 0) {
+            rotateR(node->getRight());
+        }
+        rotateL(node);
+        return node->getParent();
+    }
+    return node;
+}
+
+// helper - walk up from a subtree that grew by one
+    // stops as soon as some ancestor's height is unchanged
+template<class Key, class Value>
+AVLNode<Key,Value>* AVLTree<Key, Value>::retraceGrow(AVLNode<Key,Value>* child, bool& grew)
+{
+    grew = true;
+    updateNode(child);
+    AVLNode<Key,Value>* parent = child->getParent();
+    while(parent != NULL) {
+        parent->updateBalance(parent->getLeft() == child ? 1 : -1);
+        updateNode(parent);
+
+        if(parent->getBalance() == 0) {
+            grew = false;
+            child = parent;
+            break;
+        }
+        if(parent->getBalance() == 2 || parent->getBalance() == -2) {
+            child = fixNode(parent);
+            // a rotation only leaves the subtree taller when the child it
+            // lifted was itself balanced, which join can produce
+            if(child->getBalance() == 0) {
+                grew = false;
+                break;
             }
-            // case 2: left-left = right
-            rotateR(curr);
         }
-        // right-heavy
-        else if(bFact == -2) {
-            AVLNode<Key,Value>* R = curr->getRight();
-            int factR = getHeight(R->getLeft()) - getHeight(R->getRight());
-
-            // case 3: right-left 
-            if(factR > 0) {
-                rotateR(R);
+        else {
+            child = parent;
+        }
+        parent = child->getParent();
+    }
+
+    // heights are settled; the ancestors may still need updateNode
+    while(child->getParent() != NULL) {
+        child = child->getParent();
+        updateNode(child);
+    }
+    return child;
+}
+
+// helper - walk up from a parent whose left (or right) subtree shrank by one
+template<class Key, class Value>
+AVLNode<Key,Value>* AVLTree<Key, Value>::retraceShrink(AVLNode<Key,Value>* parent, bool leftShrank, bool& shrank)
+{
+    shrank = true;
+    AVLNode<Key,Value>* top = parent;
+    while(parent != NULL) {
+        parent->updateBalance(leftShrank ? -1 : 1);
+        updateNode(parent);
+
+        if(parent->getBalance() == 1 || parent->getBalance() == -1) {
+            shrank = false;
+            top = parent;
+            break;
+        }
+        top = parent;
+        if(parent->getBalance() != 0) {
+            top = fixNode(parent);
+            // the lifted child was balanced: the subtree kept its height
+            if(top->getBalance() != 0) {
+                shrank = false;
+                break;
             }
-            // case 4: right-right = left
-            rotateL(curr);
         }
+        parent = top->getParent();
+        if(parent != NULL) {
+            leftShrank = (parent->getLeft() == top);
+        }
+    }
+
+    while(top != NULL && top->getParent() != NULL) {
+        top = top->getParent();
+        updateNode(top);
+    }
+    return top;
+}
+
+/**
+* Joins two AVL trees around a middle node. The shorter tree is hung next to
+* mid on the spine of the taller one at the first node of matching height, so
+* the cost is the height difference, O(log n).
+*/
+template<class Key, class Value>
+AVLNode<Key,Value>* AVLTree<Key, Value>::join(AVLNode<Key,Value>* left, int leftH, AVLNode<Key,Value>* mid,
+                                              AVLNode<Key,Value>* right, int rightH, int& height)
+{
+    // heights are close enough: mid becomes the root
+    if(leftH <= rightH + 1 && rightH <= leftH + 1) {
+        mid->setParent(NULL);
+        mid->setLeft(left);
+        mid->setRight(right);
+        mid->setBalance(leftH - rightH);
+        if(left != NULL) { left->setParent(mid); }
+        if(right != NULL) { right->setParent(mid); }
+        updateNode(mid);
+        height = std::max(leftH, rightH) + 1;
+        return mid;
+    }
+
+    bool grew = false;
+    AVLNode<Key,Value>* root = NULL;
+    if(leftH > rightH) {
+        // go down the right spine of left until the height fits next to right
+        AVLNode<Key,Value>* curr = left;
+        AVLNode<Key,Value>* parent = NULL;
+        int currH = leftH;
+        while(currH > rightH + 1) {
+            parent = curr;
+            currH -= (curr->getBalance() > 0) ? 2 : 1;
+            curr = curr->getRight();
+        }
+
+        mid->setParent(parent);
+        mid->setLeft(curr);
+        mid->setRight(right);
+        mid->setBalance(currH - rightH);
+        if(curr != NULL) { curr->setParent(mid); }
+        if(right != NULL) { right->setParent(mid); }
+        parent->setRight(mid);
+
+        // mid's subtree is one taller than curr's was
+        root = retraceGrow(mid, grew);
+        height = leftH + (grew ? 1 : 0);
+    }
+    else {
+        // mirror image: go down the left spine of right
+        AVLNode<Key,Value>* curr = right;
+        AVLNode<Key,Value>* parent = NULL;
+        int currH = rightH;
+        while(currH > leftH + 1) {
+            parent = curr;
+            currH -= (curr->getBalance() < 0) ? 2 : 1;
+            curr = curr->getLeft();
+        }
+
+        mid->setParent(parent);
+        mid->setLeft(left);
+        mid->setRight(curr);
+        mid->setBalance(leftH - currH);
+        if(curr != NULL) { curr->setParent(mid); }
+        if(left != NULL) { left->setParent(mid); }
+        parent->setLeft(mid);
+
+        root = retraceGrow(mid, grew);
+        height = rightH + (grew ? 1 : 0);
+    }
+    return root;
+}
 
-        curr = curr->getParent();
+// helper - unlink the smallest node of right and use it as the middle of a join
+template<class Key, class Value>
+AVLNode<Key,Value>* AVLTree<Key, Value>::join2(AVLNode<Key,Value>* left, int leftH,
+                                               AVLNode<Key,Value>* right, int rightH, int& height)
+{
+    if(right == NULL) {
+        height = leftH;
+        return left;
+    }
+    if(left == NULL) {
+        height = rightH;
+        return right;
+    }
+
+    AVLNode<Key,Value>* smallest = right;
+    while(smallest->getLeft() != NULL) {
+        smallest = smallest->getLeft();
+    }
+
+    // the smallest node has at most a right child, which takes its place
+    AVLNode<Key,Value>* parent = smallest->getParent();
+    AVLNode<Key,Value>* child = smallest->getRight();
+    if(child != NULL) { child->setParent(parent); }
+
+    bool shrank = true;
+    if(parent == NULL) {
+        right = child;
+    }
+    else {
+        parent->setLeft(child);
+        right = retraceShrink(parent, true, shrank);
+    }
+    if(shrank) { --rightH; }
+    if(right != NULL) { right->setParent(NULL); }
+
+    return join(left, leftH, smallest, right, rightH, height);
+}
+
+/**
+* Merges the nodes released by a tree of the same type, picking the cheapest way:
+*   - key ranges do not overlap: join the two trees, O(log n + log m)
+*   - the other tree is small: relink its nodes one at a time, O(m log(n + m))
+*   - otherwise: flatten both, merge the sorted runs, rebuild, O(n + m)
+* Nodes are never reallocated. Items of any other tree type are copied with insert().
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::absorbNodes(Node<Key,Value>* root, const BinarySearchTree<Key, Value>& source)
+{
+    // derived trees may use their own node type, so only reuse nodes from a
+    // tree of exactly the same type
+    if(typeid(source) != typeid(*this)) {
+        this->absorbByInsert(root);
+        return;
+    }
+
+    AVLNode<Key,Value>* other = static_cast<AVLNode<Key,Value>*>(root);
+    AVLNode<Key,Value>* mine = static_cast<AVLNode<Key,Value>*>(this->root_);
+    if(mine == NULL) {
+        this->root_ = other;
+        return;
+    }
+
+    AVLNode<Key,Value>* mineMin = mine;
+    AVLNode<Key,Value>* mineMax = mine;
+    AVLNode<Key,Value>* otherMin = other;
+    AVLNode<Key,Value>* otherMax = other;
+    while(mineMin->getLeft() != NULL) { mineMin = mineMin->getLeft(); }
+    while(mineMax->getRight() != NULL) { mineMax = mineMax->getRight(); }
+    while(otherMin->getLeft() != NULL) { otherMin = otherMin->getLeft(); }
+    while(otherMax->getRight() != NULL) { otherMax = otherMax->getRight(); }
+
+    int mineH = spineHeight(mine);
+    int otherH = spineHeight(other);
+    int height = 0;
+
+    // case 1: disjoint key ranges
+    if(mineMax->getKey() < otherMin->getKey()) {
+        this->root_ = join2(mine, mineH, other, otherH, height);
+        return;
+    }
+    if(otherMax->getKey() < mineMin->getKey()) {
+        this->root_ = join2(other, otherH, mine, mineH, height);
+        return;
+    }
+
+    std::vector<AVLNode<Key,Value>*> otherNodes;
+    for(Node<Key,Value>* curr = otherMin; curr != NULL; curr = BinarySearchTree<Key, Value>::successor(curr)) {
+        otherNodes.push_back(static_cast<AVLNode<Key,Value>*>(curr));
+    }
+
+    // an AVL tree of height h holds between ~1.6^h and 2^h nodes; 2^(h-1) is
+    // close enough to pick a strategy without counting
+    size_t mineSize = (mineH >= 40) ? ((size_t)1 << 40) : ((size_t)1 << (mineH - 1));
+    size_t logSize = (size_t)mineH + 1;
+
+    // case 2: few nodes to add - m rebalancing inserts beat touching all n
+    if(otherNodes.size() * logSize < mineSize) {
+        for(size_t i = 0; i < otherNodes.size(); ++i) {
+            insertNode(otherNodes[i]);
+        }
+        return;
+    }
+
+    // case 3: interleaved and of similar size - merge the in-order runs
+    std::vector<AVLNode<Key,Value>*> mineNodes;
+    for(Node<Key,Value>* curr = mineMin; curr != NULL; curr = BinarySearchTree<Key, Value>::successor(curr)) {
+        mineNodes.push_back(static_cast<AVLNode<Key,Value>*>(curr));
+    }
+
+    std::vector<AVLNode<Key,Value>*> merged;
+    merged.reserve(mineNodes.size() + otherNodes.size());
+    size_t i = 0;
+    size_t j = 0;
+    while(i < mineNodes.size() || j < otherNodes.size()) {
+        if(j == otherNodes.size() || (i < mineNodes.size() && mineNodes[i]->getKey() < otherNodes[j]->getKey())) {
+            merged.push_back(mineNodes[i++]);
+        }
+        else if(i == mineNodes.size() || otherNodes[j]->getKey() < mineNodes[i]->getKey()) {
+            merged.push_back(otherNodes[j++]);
+        }
+        // equal keys: keep our node, take the other value
+        else {
+            takeValue(mineNodes[i], otherNodes[j]->getValue());
+            delete otherNodes[j++];
+            merged.push_back(mineNodes[i++]);
+        }
+    }
+
+    this->root_ = buildBalanced(merged, 0, merged.size(), NULL, height);
+}
+
+template<class Key, class Value>
+void AVLTree<Key, Value>::takeValue(AVLNode<Key,Value>* node, const Value& value)
+{
+    node->setValue(value);
+}
+
+template<class Key, class Value>
+void AVLTree<Key, Value>::insertNode(AVLNode<Key,Value>* node)
+{
+    node->setLeft(NULL);
+    node->setRight(NULL);
+    node->setBalance(0);
+
+    Node<Key,Value>* curr = this->root_;
+    Node<Key,Value>* parent = NULL;
+    while(curr != NULL) {
+        // key already exists - take the value, drop the node
+        if(node->getKey() == curr->getKey()) {
+            AVLNode<Key,Value>* avlCurr = static_cast<AVLNode<Key,Value>*>(curr);
+            takeValue(avlCurr, node->getValue());
+            updatePath(avlCurr);
+            delete node;
+            return;
+        }
+        parent = curr;
+        curr = (node->getKey() < curr->getKey()) ? curr->getLeft() : curr->getRight();
+    }
+
+    node->setParent(static_cast<AVLNode<Key,Value>*>(parent));
+    if(parent == NULL) {
+        this->root_ = node;
+        return;
+    }
+    if(node->getKey() < parent->getKey()) {
+        parent->setLeft(node);
+    }
+    else {
+        parent->setRight(node);
+    }
+
+    bool grew = false;
+    this->root_ = retraceGrow(node, grew);
+}
+
+/**
+* Splits the subtree rooted at node into keys < key and keys >= key. Each node
+* on the search path is rejoined with the pieces on its side, and the heights
+* of those pieces telescope, so the whole split is O(log n).
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::split(AVLNode<Key,Value>* node, int h, const Key& key,
+                                AVLNode<Key,Value>*& left, int& leftH, AVLNode<Key,Value>*& right, int& rightH,
+                                bool inclusive)
+{
+    if(node == NULL) {
+        left = right = NULL;
+        leftH = rightH = 0;
+        return;
+    }
+
+    // detach node from its children, keeping their heights
+    AVLNode<Key,Value>* l = node->getLeft();
+    AVLNode<Key,Value>* r = node->getRight();
+    int lH = (node->getBalance() >= 0) ? h - 1 : h - 2;
+    int rH = (node->getBalance() <= 0) ? h - 1 : h - 2;
+    if(l != NULL) { l->setParent(NULL); }
+    if(r != NULL) { r->setParent(NULL); }
+
+    bool goesLeft = inclusive ? !(key < node->getKey()) : (node->getKey() < key);
+    if(goesLeft) {
+        // node and its left subtree go left, the right subtree is split further
+        AVLNode<Key,Value>* rLeft = NULL;
+        int rLeftH = 0;
+        split(r, rH, key, rLeft, rLeftH, right, rightH, inclusive);
+        left = join(l, lH, node, rLeft, rLeftH, leftH);
+    }
+    else {
+        AVLNode<Key,Value>* lRight = NULL;
+        int lRightH = 0;
+        split(l, lH, key, left, leftH, lRight, lRightH, inclusive);
+        right = join(lRight, lRightH, node, r, rH, rightH);
     }
 }
 
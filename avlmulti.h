@@ -0,0 +1,385 @@
+#ifndef AVLMULTI_H
+#define AVLMULTI_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* An AVLNode that also counts how many times its key was inserted. Only used
+* by AVLMultiTree in counting mode; otherwise the count stays at 1.
+*/
+template <typename Key, typename Value>
+class AVLMultiNode : public AVLNode<Key, Value>
+{
+public:
+    AVLMultiNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual ~AVLMultiNode();
+
+    size_t getCount() const;
+    void setCount(size_t count);
+
+protected:
+    size_t count_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the AVLMultiNode class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value>
+AVLMultiNode<Key, Value>::AVLMultiNode(const Key& key, const Value& value, AVLNode<Key, Value> *parent) :
+    AVLNode<Key, Value>(key, value, parent), count_(1)
+{
+
+}
+
+template<class Key, class Value>
+AVLMultiNode<Key, Value>::~AVLMultiNode()
+{
+
+}
+
+template<class Key, class Value>
+size_t AVLMultiNode<Key, Value>::getCount() const
+{
+    return count_;
+}
+
+template<class Key, class Value>
+void AVLMultiNode<Key, Value>::setCount(size_t count)
+{
+    count_ = count;
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the AVLMultiNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An AVLTree that keeps duplicate keys. Each insert() adds a new node after
+* every node with an equal key, so iterating yields duplicates in insertion
+* order, and count()/equal_range() cost O(log n + k) for k matches.
+*
+* In counting mode the tree is set-like: a repeated insert only bumps the
+* count of the existing node (and overwrites its value, like AVLTree::insert),
+* so each key is stored and iterated once and count() is O(log n).
+*
+* operator[] and at() never insert here: with duplicates a key does not name
+* one item. update() changes the oldest item with the key, or inserts one.
+*/
+template <class Key, class Value>
+class AVLMultiTree : public AVLTree<Key, Value>
+{
+public:
+    typedef typename BinarySearchTree<Key, Value>::iterator iterator;
+
+    explicit AVLMultiTree(bool countDuplicates = false);
+
+    // always adds an item, so the bool is always true
+    virtual std::pair<iterator, bool> insert (const std::pair<const Key, Value> &new_item);
+    // removes every item with this key, O(log n + k)
+    virtual void remove(const Key& key);
+    // removes the oldest item with this key (or one from its count)
+    void removeOne(const Key& key);
+
+    size_t count(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    bool countsDuplicates() const;
+
+    // the oldest item with this key
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+    Value& at(const Key& key);
+    Value const & at(const Key& key) const;
+
+protected:
+    // first node in key order with this key, or NULL
+    AVLMultiNode<Key,Value>* firstOf(const Key& key) const;
+
+    // every node is an AVLMultiNode, including those parallel_build makes
+    virtual AVLNode<Key,Value>* createNode(const Key& key, const Value& value, AVLNode<Key,Value>* parent);
+
+    // merge() and parallel_build support: keeps duplicates instead of overwriting
+    virtual void absorbNodes(Node<Key,Value>* root, const BinarySearchTree<Key, Value>& source);
+    virtual bool keepsDuplicates() const;
+
+    // update() support: the oldest item with key, or a new one
+    virtual Node<Key,Value>* findOrCreate(const Key& key, const Value& value, bool& created);
+
+    // link node in after every node with an equal key (or add its count to
+    // that node in counting mode) and retrace, O(log n). Returns the node
+    // now holding the item.
+    AVLMultiNode<Key,Value>* linkNode(AVLMultiNode<Key,Value>* node);
+
+    bool countDuplicates_;
+};
+
+/*
+----------------------------------------------
+Begin implementations for the AVLMultiTree class.
+----------------------------------------------
+*/
+
+template<class Key, class Value>
+AVLMultiTree<Key, Value>::AVLMultiTree(bool countDuplicates)
+    : countDuplicates_(countDuplicates)
+{
+
+}
+
+template<class Key, class Value>
+std::pair<typename AVLMultiTree<Key, Value>::iterator, bool>
+AVLMultiTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
+{
+    AVLMultiNode<Key,Value>* node = linkNode(new AVLMultiNode<Key,Value>(new_item.first, new_item.second, NULL));
+    return std::make_pair(this->iteratorAt(node), true);
+}
+
+/*
+ * Splits the run of equal keys out of the tree and frees it.
+ */
+template<class Key, class Value>
+void AVLMultiTree<Key, Value>::remove(const Key& key)
+{
+    AVLNode<Key,Value>* root = static_cast<AVLNode<Key,Value>*>(this->root_);
+    AVLNode<Key,Value>* left = NULL;
+    AVLNode<Key,Value>* rest = NULL;
+    AVLNode<Key,Value>* equal = NULL;
+    AVLNode<Key,Value>* right = NULL;
+    int leftH = 0;
+    int restH = 0;
+    int equalH = 0;
+    int rightH = 0;
+
+    this->split(root, this->spineHeight(root), key, left, leftH, rest, restH);
+    this->split(rest, restH, key, equal, equalH, right, rightH, true);
+    this->clearSubtree(equal);
+
+    int height = 0;
+    this->root_ = this->join2(left, leftH, right, rightH, height);
+}
+
+template<class Key, class Value>
+void AVLMultiTree<Key, Value>::removeOne(const Key& key)
+{
+    AVLMultiNode<Key,Value>* node = firstOf(key);
+    if(node == NULL) { return; }
+
+    if(node->getCount() > 1) {
+        node->setCount(node->getCount() - 1);
+        return;
+    }
+    this->removeNode(node);
+}
+
+template<class Key, class Value>
+size_t AVLMultiTree<Key, Value>::count(const Key& key) const
+{
+    AVLMultiNode<Key,Value>* node = firstOf(key);
+    if(node == NULL) { return 0; }
+    if(countDuplicates_) { return node->getCount(); }
+
+    size_t total = 0;
+    for(Node<Key,Value>* curr = node; curr != NULL && curr->getKey() == key;
+        curr = BinarySearchTree<Key, Value>::successor(curr)) {
+        ++total;
+    }
+    return total;
+}
+
+/**
+* Returns [first, last) over the items with this key. Finding last walks the
+* k matches, so the whole call is O(log n + k).
+*/
+template<class Key, class Value>
+std::pair<typename AVLMultiTree<Key, Value>::iterator, typename AVLMultiTree<Key, Value>::iterator>
+AVLMultiTree<Key, Value>::equal_range(const Key& key) const
+{
+    iterator first = this->lower_bound(key);
+    iterator last = first;
+    while(last != this->end() && last->first == key) {
+        ++last;
+    }
+    return std::make_pair(first, last);
+}
+
+template<class Key, class Value>
+bool AVLMultiTree<Key, Value>::countsDuplicates() const
+{
+    return countDuplicates_;
+}
+
+template<class Key, class Value>
+typename AVLMultiTree<Key, Value>::iterator
+AVLMultiTree<Key, Value>::find(const Key& key) const
+{
+    iterator it = this->lower_bound(key);
+    if(it != this->end() && it->first == key) {
+        return it;
+    }
+    return this->end();
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value of the oldest item with the key
+ */
+template<class Key, class Value>
+Value& AVLMultiTree<Key, Value>::operator[](const Key& key)
+{
+    AVLMultiNode<Key,Value>* curr = firstOf(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+template<class Key, class Value>
+Value const & AVLMultiTree<Key, Value>::operator[](const Key& key) const
+{
+    AVLMultiNode<Key,Value>* curr = firstOf(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+template<class Key, class Value>
+Value& AVLMultiTree<Key, Value>::at(const Key& key)
+{
+    return (*this)[key];
+}
+template<class Key, class Value>
+Value const & AVLMultiTree<Key, Value>::at(const Key& key) const
+{
+    return (*this)[key];
+}
+
+/*
+ * Two descents for a missing key (the search, then linkNode); equal keys
+ * make the shared single descent of the other trees ambiguous.
+ */
+template<class Key, class Value>
+Node<Key,Value>* AVLMultiTree<Key, Value>::findOrCreate(const Key& key, const Value& value, bool& created)
+{
+    AVLMultiNode<Key,Value>* node = firstOf(key);
+    created = (node == NULL);
+    if(created) {
+        node = linkNode(new AVLMultiNode<Key,Value>(key, value, NULL));
+    }
+    return node;
+}
+
+template<class Key, class Value>
+AVLMultiNode<Key,Value>* AVLMultiTree<Key, Value>::firstOf(const Key& key) const
+{
+    Node<Key,Value>* node = this->internalLowerBound(key);
+    if(node == NULL || node->getKey() != key) { return NULL; }
+    return static_cast<AVLMultiNode<Key,Value>*>(node);
+}
+
+template<class Key, class Value>
+AVLNode<Key,Value>* AVLMultiTree<Key, Value>::createNode(const Key& key, const Value& value, AVLNode<Key,Value>* parent)
+{
+    return new AVLMultiNode<Key,Value>(key, value, parent);
+}
+
+/**
+* Nodes from another AVLMultiTree are relinked one at a time, so duplicates
+* from both trees survive (ours first). Anything else is copied with insert().
+* A counted node from a counting source becomes that many nodes here unless
+* this tree counts too. An empty tree takes the nodes as they are when both
+* trees keep duplicates as nodes.
+*/
+template<class Key, class Value>
+void AVLMultiTree<Key, Value>::absorbNodes(Node<Key,Value>* root, const BinarySearchTree<Key, Value>& source)
+{
+    const AVLMultiTree<Key, Value>* multi = dynamic_cast<const AVLMultiTree<Key, Value>*>(&source);
+    if(multi == NULL) {
+        this->absorbByInsert(root);
+        return;
+    }
+    bool expand = multi->countDuplicates_ && !countDuplicates_;
+    if(this->root_ == NULL && !countDuplicates_ && !expand) {
+        this->root_ = root;
+        return;
+    }
+
+    // collect first: relinking would break the successor walk
+    std::vector<AVLMultiNode<Key,Value>*> nodes;
+    Node<Key,Value>* curr = root;
+    while(curr->getLeft() != NULL) { curr = curr->getLeft(); }
+    for( ; curr != NULL; curr = BinarySearchTree<Key, Value>::successor(curr)) {
+        nodes.push_back(static_cast<AVLMultiNode<Key,Value>*>(curr));
+    }
+    for(size_t i = 0; i < nodes.size(); ++i) {
+        size_t copies = expand ? nodes[i]->getCount() : 1;
+        if(expand) {
+            nodes[i]->setCount(1);
+        }
+        linkNode(nodes[i]);
+        for(size_t c = 1; c < copies; ++c) {
+            linkNode(new AVLMultiNode<Key,Value>(nodes[i]->getKey(), nodes[i]->getValue(), NULL));
+        }
+    }
+}
+
+template<class Key, class Value>
+bool AVLMultiTree<Key, Value>::keepsDuplicates() const
+{
+    return true;
+}
+
+template<class Key, class Value>
+AVLMultiNode<Key,Value>* AVLMultiTree<Key, Value>::linkNode(AVLMultiNode<Key,Value>* node)
+{
+    node->setLeft(NULL);
+    node->setRight(NULL);
+    node->setBalance(0);
+
+    Node<Key,Value>* curr = this->root_;
+    Node<Key,Value>* parent = NULL;
+    while(curr != NULL) {
+        // counting mode: fold the node into the existing one
+        if(countDuplicates_ && node->getKey() == curr->getKey()) {
+            AVLMultiNode<Key,Value>* existing = static_cast<AVLMultiNode<Key,Value>*>(curr);
+            existing->setCount(existing->getCount() + node->getCount());
+            existing->setValue(node->getValue());
+            this->updatePath(existing);
+            delete node;
+            return existing;
+        }
+        parent = curr;
+        // equal keys go right, after the older duplicates
+        curr = (node->getKey() < curr->getKey()) ? curr->getLeft() : curr->getRight();
+    }
+
+    node->setParent(static_cast<AVLNode<Key,Value>*>(parent));
+    if(parent == NULL) {
+        this->root_ = node;
+        return node;
+    }
+    if(node->getKey() < parent->getKey()) {
+        parent->setLeft(node);
+    }
+    else {
+        parent->setRight(node);
+    }
+
+    bool grew = false;
+    this->root_ = this->retraceGrow(node, grew);
+    return node;
+}
+
+/*
+--------------------------------------------
+End implementations for the AVLMultiTree class.
+--------------------------------------------
+*/
+
+#endif
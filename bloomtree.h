@@ -0,0 +1,421 @@
+#ifndef BLOOMTREE_H
+#define BLOOMTREE_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "avlmulti.h"
+
+/**
+* A blocked Bloom filter over hashed keys. Every key sets k bits inside one
+* 512-bit block (a cache line), so a query costs a single cache miss whatever
+* k is. A blocked filter needs about a tenth more bits than a classic one for
+* the same false-positive rate, which sizeFor() adds in.
+*/
+class BlockedBloomFilter
+{
+public:
+    BlockedBloomFilter();
+
+    // empty filter for capacity keys at a false-positive rate of fpRate
+    void sizeFor(size_t capacity, double fpRate);
+    void add(uint64_t hash);
+    bool mayContain(uint64_t hash) const;
+    // clear every bit, keeping the size
+    void reset();
+    size_t bits() const;
+
+protected:
+    static const size_t BLOCK_WORDS = 8;    // 8 x 64 bits = one cache line
+
+    // helper - splitmix64 finalizer, so that identity hashes (std::hash of
+    // integers) still spread over blocks and bits
+    static uint64_t mix(uint64_t hash);
+
+    std::vector<uint64_t> words_;
+    size_t blocks_;
+    unsigned probes_;   // bits set per key, k
+};
+
+/**
+* A tree whose find() and at() first ask a Bloom filter of its keys, for
+* workloads where many lookups are for absent keys: a negative answer
+* returns end() (or throws, for at()) without touching the tree.
+*
+* The filter is sized for a capacity and a false-positive target. Every key
+* that insert(), operator[] or update() creates is added to it, but a Bloom
+* filter cannot forget a key, so removed keys linger as stale bits that raise
+* the false-positive rate. The filter is rebuilt
+* from the tree's keys, O(n), once removals reach half of the keys or inserts
+* exceed the capacity (which is then doubled); both keep the rebuild cost
+* amortized O(1) per update. rebuildFilter() rebuilds on demand.
+*
+* Counters of rejected lookups and false positives show whether the target
+* fits the workload. Like the hot-key cache, lookups update them, so even
+* readers must not share one tree between threads.
+*
+* Tree cannot be an AVLMultiTree: its insert() links duplicate keys without
+* going through findOrCreate(), so they would never reach the filter.
+*/
+template <class Key, class Value, class Tree = AVLTree<Key, Value> >
+class BloomGuardedTree : public Tree
+{
+    static_assert(!std::is_base_of<AVLMultiTree<Key, Value>, Tree>::value,
+                  "BloomGuardedTree needs a tree with unique keys");
+
+public:
+    // fpRate in (0, 1) is the false-positive target at capacity keys
+    explicit BloomGuardedTree(double fpRate = 0.01, size_t capacity = 1024);
+
+    virtual void remove(const Key& key);
+    typename Tree::iterator find(const Key& key) const;
+    // inserts like the base version; the const one is filtered like at()
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+    Value& at(const Key& key);
+    Value const & at(const Key& key) const;
+    void clear();
+
+    // resize the filter for the current keys and drop every stale bit
+    void rebuildFilter();
+
+    // lookups the filter answered alone, and lookups it let through for a
+    // key that was not there
+    size_t filterRejects() const;
+    size_t filterFalsePositives() const;
+    size_t filterRebuilds() const;
+    size_t filterBits() const;
+    void resetFilterStats();
+
+protected:
+    virtual void eraseKeys(const Key* lo, const Key* hi);
+    virtual void eraseMatching(const typename BinarySearchTree<Key, Value>::ItemPredicate& pred);
+    virtual Node<Key,Value>* releaseNodes();
+    virtual void absorbNodes(Node<Key,Value>* root, const BinarySearchTree<Key, Value>& source);
+    // adds every created key to the filter
+    virtual Node<Key,Value>* findOrCreate(const Key& key, const Value& value, bool& created);
+
+    // the node holding key or NULL; consults the filter first
+    Node<Key,Value>* guardedFind(const Key& key) const;
+    // rebuild if the filter is too full or too stale
+    void maybeRebuild();
+
+    BlockedBloomFilter filter_;
+    double fpRate_;
+    size_t minCapacity_;
+    size_t capacity_;   // keys the filter is sized for
+    size_t keys_;       // keys added to the filter; overwrites and removed keys count
+    size_t added_;      // inserts since the last rebuild
+    size_t removed_;    // removals since the last rebuild
+    mutable size_t rejects_;
+    mutable size_t falsePositives_;
+    size_t rebuilds_;
+};
+
+/*
+-----------------------------------------------
+Begin implementations for the BlockedBloomFilter class.
+-----------------------------------------------
+*/
+
+inline BlockedBloomFilter::BlockedBloomFilter()
+    : blocks_(0), probes_(1)
+{
+}
+
+/**
+* A classic filter needs -ln(p) / ln(2)^2 bits per key and k = -log2(p)
+* probes; the bits get another 10% for blocking.
+*/
+inline void BlockedBloomFilter::sizeFor(size_t capacity, double fpRate)
+{
+    if(!(fpRate > 0 && fpRate < 1)) {
+        throw std::invalid_argument("false-positive rate must be in (0, 1)");
+    }
+    double ln2 = std::log(2.0);
+    double bitsPerKey = 1.1 * -std::log(fpRate) / (ln2 * ln2);
+    double probes = std::ceil(-std::log(fpRate) / ln2);
+    probes_ = (probes < 1) ? 1 : (probes > 16) ? 16 : (unsigned)probes;
+
+    size_t bits = (size_t)(bitsPerKey * (capacity == 0 ? 1 : capacity)) + 1;
+    blocks_ = (bits + BLOCK_WORDS * 64 - 1) / (BLOCK_WORDS * 64);
+    words_.assign(blocks_ * BLOCK_WORDS, 0);
+}
+
+inline void BlockedBloomFilter::add(uint64_t hash)
+{
+    uint64_t h = mix(hash);
+    uint64_t* block = &words_[(size_t)((h >> 32) * blocks_ >> 32) * BLOCK_WORDS];
+    uint32_t bit = (uint32_t)h;
+    uint32_t step = (uint32_t)(h >> 41) | 1;
+    for(unsigned i = 0; i < probes_; ++i) {
+        block[(bit >> 6) & (BLOCK_WORDS - 1)] |= (uint64_t)1 << (bit & 63);
+        bit += step;
+    }
+}
+
+inline bool BlockedBloomFilter::mayContain(uint64_t hash) const
+{
+    if(blocks_ == 0) {
+        return true;
+    }
+    uint64_t h = mix(hash);
+    const uint64_t* block = &words_[(size_t)((h >> 32) * blocks_ >> 32) * BLOCK_WORDS];
+    uint32_t bit = (uint32_t)h;
+    uint32_t step = (uint32_t)(h >> 41) | 1;
+    for(unsigned i = 0; i < probes_; ++i) {
+        if((block[(bit >> 6) & (BLOCK_WORDS - 1)] & ((uint64_t)1 << (bit & 63))) == 0) {
+            return false;
+        }
+        bit += step;
+    }
+    return true;
+}
+
+inline void BlockedBloomFilter::reset()
+{
+    for(size_t i = 0; i < words_.size(); ++i) {
+        words_[i] = 0;
+    }
+}
+
+inline size_t BlockedBloomFilter::bits() const
+{
+    return words_.size() * 64;
+}
+
+inline uint64_t BlockedBloomFilter::mix(uint64_t hash)
+{
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+/*
+-----------------------------------------------
+End implementations for the BlockedBloomFilter class.
+-----------------------------------------------
+*/
+
+/*
+-----------------------------------------------
+Begin implementations for the BloomGuardedTree class.
+-----------------------------------------------
+*/
+
+template<class Key, class Value, class Tree>
+BloomGuardedTree<Key, Value, Tree>::BloomGuardedTree(double fpRate, size_t capacity)
+    : fpRate_(fpRate), minCapacity_(capacity == 0 ? 1 : capacity), capacity_(minCapacity_),
+      keys_(0), added_(0), removed_(0), rejects_(0), falsePositives_(0), rebuilds_(0)
+{
+    filter_.sizeFor(capacity_, fpRate_);
+}
+
+template<class Key, class Value, class Tree>
+void BloomGuardedTree<Key, Value, Tree>::remove(const Key& key)
+{
+    // an absent key needs no descent and leaves no stale bits
+    if(!filter_.mayContain(std::hash<Key>()(key))) {
+        return;
+    }
+    // a false positive: nothing to remove, and no stale bits either
+    if(this->visibleFind(key) == NULL) {
+        return;
+    }
+    Tree::remove(key);
+    ++removed_;
+    maybeRebuild();
+}
+
+template<class Key, class Value, class Tree>
+typename Tree::iterator BloomGuardedTree<Key, Value, Tree>::find(const Key& key) const
+{
+    BST_LATENCY_SCOPE(LAT_BST_FIND);
+    return Tree::iteratorAt(guardedFind(key));
+}
+
+template<class Key, class Value, class Tree>
+Value& BloomGuardedTree<Key, Value, Tree>::operator[](const Key& key)
+{
+    return Tree::operator[](key);
+}
+
+template<class Key, class Value, class Tree>
+Value const & BloomGuardedTree<Key, Value, Tree>::operator[](const Key& key) const
+{
+    return at(key);
+}
+
+template<class Key, class Value, class Tree>
+Value& BloomGuardedTree<Key, Value, Tree>::at(const Key& key)
+{
+    Node<Key,Value>* node = guardedFind(key);
+    if(node == NULL) throw std::out_of_range("Invalid key");
+    return node->getValue();
+}
+
+template<class Key, class Value, class Tree>
+Value const & BloomGuardedTree<Key, Value, Tree>::at(const Key& key) const
+{
+    Node<Key,Value>* node = guardedFind(key);
+    if(node == NULL) throw std::out_of_range("Invalid key");
+    return node->getValue();
+}
+
+template<class Key, class Value, class Tree>
+void BloomGuardedTree<Key, Value, Tree>::clear()
+{
+    Tree::clear();
+    rebuildFilter();
+}
+
+template<class Key, class Value, class Tree>
+void BloomGuardedTree<Key, Value, Tree>::eraseMatching(const typename BinarySearchTree<Key, Value>::ItemPredicate& pred)
+{
+    // a whole-tree pass already, so one more does not change the order
+    Tree::eraseMatching(pred);
+    rebuildFilter();
+}
+
+/**
+* Counts the keys and sizes the filter for twice as many (or the initial
+* capacity), so the tree can grow by half again before the next rebuild.
+*/
+template<class Key, class Value, class Tree>
+void BloomGuardedTree<Key, Value, Tree>::rebuildFilter()
+{
+    std::vector<uint64_t> hashes;
+    for(typename Tree::iterator it = this->begin(); it != this->end(); ++it) {
+        hashes.push_back(std::hash<Key>()(it->first));
+    }
+
+    capacity_ = 2 * hashes.size();
+    if(capacity_ < minCapacity_) {
+        capacity_ = minCapacity_;
+    }
+    filter_.sizeFor(capacity_, fpRate_);
+    for(size_t i = 0; i < hashes.size(); ++i) {
+        filter_.add(hashes[i]);
+    }
+    keys_ = hashes.size();
+    added_ = 0;
+    removed_ = 0;
+    ++rebuilds_;
+}
+
+template<class Key, class Value, class Tree>
+size_t BloomGuardedTree<Key, Value, Tree>::filterRejects() const
+{
+    return rejects_;
+}
+
+template<class Key, class Value, class Tree>
+size_t BloomGuardedTree<Key, Value, Tree>::filterFalsePositives() const
+{
+    return falsePositives_;
+}
+
+template<class Key, class Value, class Tree>
+size_t BloomGuardedTree<Key, Value, Tree>::filterRebuilds() const
+{
+    return rebuilds_;
+}
+
+template<class Key, class Value, class Tree>
+size_t BloomGuardedTree<Key, Value, Tree>::filterBits() const
+{
+    return filter_.bits();
+}
+
+template<class Key, class Value, class Tree>
+void BloomGuardedTree<Key, Value, Tree>::resetFilterStats()
+{
+    rejects_ = 0;
+    falsePositives_ = 0;
+    rebuilds_ = 0;
+}
+
+// helper - count the keys in [*lo, *hi) as removals before they go, O(k)
+template<class Key, class Value, class Tree>
+void BloomGuardedTree<Key, Value, Tree>::eraseKeys(const Key* lo, const Key* hi)
+{
+    typename Tree::iterator it = (lo != NULL) ? this->lower_bound(*lo) : this->begin();
+    for(; it != this->end() && (hi == NULL || it->first < *hi); ++it) {
+        ++removed_;
+    }
+    Tree::eraseKeys(lo, hi);
+    maybeRebuild();
+}
+
+template<class Key, class Value, class Tree>
+Node<Key,Value>* BloomGuardedTree<Key, Value, Tree>::releaseNodes()
+{
+    Node<Key,Value>* root = Tree::releaseNodes();
+    rebuildFilter();
+    return root;
+}
+
+template<class Key, class Value, class Tree>
+void BloomGuardedTree<Key, Value, Tree>::absorbNodes(Node<Key,Value>* root, const BinarySearchTree<Key, Value>& source)
+{
+    Tree::absorbNodes(root, source);
+    rebuildFilter();
+}
+
+template<class Key, class Value, class Tree>
+Node<Key,Value>* BloomGuardedTree<Key, Value, Tree>::findOrCreate(const Key& key, const Value& value, bool& created)
+{
+    Node<Key,Value>* node = Tree::findOrCreate(key, value, created);
+    if(created) {
+        filter_.add(std::hash<Key>()(key));
+        ++keys_;
+        ++added_;
+        // a rebuild relinks nothing, so node stays valid
+        maybeRebuild();
+    }
+    return node;
+}
+
+template<class Key, class Value, class Tree>
+Node<Key,Value>* BloomGuardedTree<Key, Value, Tree>::guardedFind(const Key& key) const
+{
+    if(!filter_.mayContain(std::hash<Key>()(key))) {
+        ++rejects_;
+        return NULL;
+    }
+    Node<Key,Value>* node = this->internalFind(key);
+    // a LazyAVLTree tombstone is absent
+    if(node != NULL && this->isHiddenNode(node)) {
+        node = NULL;
+    }
+    if(node == NULL) {
+        ++falsePositives_;
+    }
+    return node;
+}
+
+template<class Key, class Value, class Tree>
+void BloomGuardedTree<Key, Value, Tree>::maybeRebuild()
+{
+    if(keys_ > capacity_ || (removed_ > 32 && 2 * removed_ > keys_)) {
+        rebuildFilter();
+    }
+}
+
+/*
+-----------------------------------------------
+End implementations for the BloomGuardedTree class.
+-----------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,391 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include "bst.h"
+#include "avlbst.h"
+#include "rbbst.h"
+#include "btree.h"
+#include "pathavl.h"
+#include "parallel.h"
+#include "hotcache.h"
+#include "bloomtree.h"
+
+using namespace std;
+
+// Usage: ./bst-bench [numKeys] [numOps]
+//
+// Each workload first loads numKeys random keys, then times numOps
+// operations of the given mix. Times are reported in nanoseconds per op.
+
+typedef chrono::steady_clock Clock;
+
+struct Workload
+{
+    const char* name;
+    int insertPct;  // percent of ops that insert
+    int removePct;  // percent of ops that remove; the rest are finds
+};
+
+// runs one workload against one tree type and returns ns/op
+template<typename Tree>
+double runWorkload(const Workload& w, size_t numKeys, size_t numOps, unsigned seed)
+{
+    mt19937_64 gen(seed);
+    uniform_int_distribution<uint64_t> keyDist(0, numKeys * 2);
+    uniform_int_distribution<int> opDist(0, 99);
+
+    Tree tree;
+    for(size_t i = 0; i < numKeys; ++i) {
+        tree.insert(make_pair(keyDist(gen), (uint64_t)i));
+    }
+
+    // pre-generate the op stream so the RNG is not timed
+    vector<pair<int, uint64_t> > ops(numOps);
+    for(size_t i = 0; i < numOps; ++i) {
+        ops[i] = make_pair(opDist(gen), keyDist(gen));
+    }
+
+    size_t found = 0;
+    Clock::time_point start = Clock::now();
+    for(size_t i = 0; i < numOps; ++i) {
+        if(ops[i].first < w.insertPct) {
+            tree.insert(make_pair(ops[i].second, (uint64_t)i));
+        }
+        else if(ops[i].first < w.insertPct + w.removePct) {
+            tree.remove(ops[i].second);
+        }
+        else if(tree.find(ops[i].second) != tree.end()) {
+            ++found;
+        }
+    }
+    Clock::time_point stop = Clock::now();
+
+    // keep the finds from being optimized away
+    if(found == (size_t)-1) {
+        cout << "";
+    }
+    return chrono::duration<double, nano>(stop - start).count() / numOps;
+}
+
+// times looking up batches of batchSize random keys, either one find() at a
+// time or with find_many(), and prints ns/lookup for both
+template<typename Tree>
+void runBatchedLookups(const char* name, size_t numKeys, size_t numLookups, size_t batchSize)
+{
+    mt19937_64 gen(270);
+    uniform_int_distribution<uint64_t> keyDist(0, numKeys * 2);
+
+    Tree tree;
+    for(size_t i = 0; i < numKeys; ++i) {
+        tree.insert(make_pair(keyDist(gen), (uint64_t)i));
+    }
+
+    vector<vector<uint64_t> > batches(numLookups / batchSize, vector<uint64_t>(batchSize));
+    for(size_t b = 0; b < batches.size(); ++b) {
+        for(size_t i = 0; i < batchSize; ++i) {
+            batches[b][i] = keyDist(gen);
+        }
+    }
+
+    size_t found = 0;
+    Clock::time_point start = Clock::now();
+    for(size_t b = 0; b < batches.size(); ++b) {
+        for(size_t i = 0; i < batchSize; ++i) {
+            if(tree.find(batches[b][i]) != tree.end()) {
+                ++found;
+            }
+        }
+    }
+    Clock::time_point mid = Clock::now();
+    vector<typename Tree::iterator> results;
+    for(size_t b = 0; b < batches.size(); ++b) {
+        tree.find_many(batches[b], results);
+        for(size_t i = 0; i < batchSize; ++i) {
+            if(results[i] != tree.end()) {
+                --found;
+            }
+        }
+    }
+    Clock::time_point stop = Clock::now();
+
+    size_t total = batches.size() * batchSize;
+    cout << left << setw(46) << name << right << fixed << setprecision(1)
+         << setw(12) << chrono::duration<double, nano>(mid - start).count() / total
+         << setw(14) << chrono::duration<double, nano>(stop - mid).count() / total;
+    // both passes must agree on how many keys were found
+    cout << (found == 0 ? "" : "  MISMATCH") << endl;
+}
+
+// times combining a second tree of numKeys keys into a first one, either by
+// insert()ing every item or with merge(), and prints ns/item for both.
+// Interleaved trees hold the even and the odd keys; otherwise the second
+// tree's keys all come after the first's.
+template<typename Tree>
+void runMerge(const char* name, size_t numKeys, bool interleaved)
+{
+    Tree base1, base2, extra1, extra2;
+    for(size_t i = 0; i < numKeys; ++i) {
+        uint64_t mine = interleaved ? 2 * i : i;
+        uint64_t other = interleaved ? 2 * i + 1 : numKeys + i;
+        base1.insert(make_pair(mine, (uint64_t)i));
+        base2.insert(make_pair(mine, (uint64_t)i));
+        extra1.insert(make_pair(other, (uint64_t)i));
+        extra2.insert(make_pair(other, (uint64_t)i));
+    }
+
+    Clock::time_point start = Clock::now();
+    for(typename Tree::iterator it = extra1.begin(); it != extra1.end(); ++it) {
+        base1.insert(*it);
+    }
+    extra1.clear();
+    Clock::time_point mid = Clock::now();
+    base2.merge(std::move(extra2));
+    Clock::time_point stop = Clock::now();
+
+    cout << left << setw(46) << name << right << fixed << setprecision(1)
+         << setw(12) << chrono::duration<double, nano>(mid - start).count() / numKeys
+         << setw(14) << chrono::duration<double, nano>(stop - mid).count() / numKeys << endl;
+}
+
+// times loading numItems random pairs (about 1 in 8 keys repeated) with an
+// insert() loop and with parallel_build on one thread and on every core, and
+// prints ns/item for each
+template<typename Tree>
+void runBuild(const char* name, size_t numItems, unsigned threads)
+{
+    mt19937_64 gen(390);
+    uniform_int_distribution<uint64_t> keyDist(0, numItems - numItems / 8);
+    vector<pair<uint64_t, uint64_t> > items;
+    for(size_t i = 0; i < numItems; ++i) {
+        items.push_back(make_pair(keyDist(gen), (uint64_t)i));
+    }
+
+    double times[3];
+    for(int run = 0; run < 3; ++run) {
+        Tree tree;
+        vector<pair<uint64_t, uint64_t> > input(items);
+        Clock::time_point start = Clock::now();
+        if(run == 0) {
+            for(size_t i = 0; i < input.size(); ++i) {
+                tree.insert(input[i]);
+            }
+        }
+        else {
+            parallel_build(tree, input, run == 1 ? 1 : threads);
+        }
+        times[run] = chrono::duration<double, nano>(Clock::now() - start).count() / numItems;
+    }
+
+    cout << left << setw(46) << name << right << fixed << setprecision(1)
+         << setw(12) << times[0] << setw(14) << times[1] << setw(14) << times[2] << endl;
+}
+
+// helpers for runScan: sum the values
+uint64_t valueOf(const pair<const uint64_t, uint64_t>& item)
+{
+    return item.second;
+}
+
+uint64_t addValues(uint64_t a, uint64_t b)
+{
+    return a + b;
+}
+
+// times summing every value of a tree of numItems items with an iterator loop
+// and with parallel_reduce, ordered and relaxed, and prints ns/item for each
+template<typename Tree>
+void runScan(const char* name, size_t numItems, unsigned threads)
+{
+    vector<pair<uint64_t, uint64_t> > items;
+    for(size_t i = 0; i < numItems; ++i) {
+        items.push_back(make_pair((uint64_t)i, (uint64_t)i));
+    }
+    Tree tree;
+    parallel_build(tree, items);
+
+    Clock::time_point start = Clock::now();
+    uint64_t loopSum = 0;
+    for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+        loopSum += it->second;
+    }
+    Clock::time_point mid = Clock::now();
+    uint64_t orderedSum = parallel_reduce(tree, (uint64_t)0, valueOf, addValues, true, threads);
+    Clock::time_point mid2 = Clock::now();
+    uint64_t relaxedSum = parallel_reduce(tree, (uint64_t)0, valueOf, addValues, false, threads);
+    Clock::time_point stop = Clock::now();
+
+    cout << left << setw(46) << name << right << fixed << setprecision(1)
+         << setw(12) << chrono::duration<double, nano>(mid - start).count() / numItems
+         << setw(14) << chrono::duration<double, nano>(mid2 - mid).count() / numItems
+         << setw(14) << chrono::duration<double, nano>(stop - mid2).count() / numItems
+         << (loopSum == orderedSum && loopSum == relaxedSum ? "" : "  MISMATCH") << endl;
+}
+
+// times numLookups Zipf-distributed (s = 1) lookups of numKeys keys in a plain
+// AVLTree and in a HotKeyCachedTree with cacheSize entries, and prints
+// ns/lookup for both and the cache's hit rate
+void runSkewedLookups(size_t numKeys, size_t numLookups, size_t cacheSize)
+{
+    mt19937_64 gen(480);
+    vector<uint64_t> keys(numKeys);
+    uniform_int_distribution<uint64_t> keyDist(0, numKeys * 2);
+    for(size_t i = 0; i < numKeys; ++i) {
+        keys[i] = keyDist(gen);
+    }
+
+    // rank r is drawn with probability proportional to 1 / (r + 1)
+    vector<double> cdf(numKeys);
+    double total = 0;
+    for(size_t r = 0; r < numKeys; ++r) {
+        total += 1.0 / (r + 1);
+        cdf[r] = total;
+    }
+    uniform_real_distribution<double> u(0, total);
+    vector<uint64_t> lookups(numLookups);
+    for(size_t i = 0; i < numLookups; ++i) {
+        size_t r = lower_bound(cdf.begin(), cdf.end(), u(gen)) - cdf.begin();
+        lookups[i] = keys[r < numKeys ? r : numKeys - 1];
+    }
+
+    AVLTree<uint64_t, uint64_t> plain;
+    HotKeyCachedTree<uint64_t, uint64_t> cached(cacheSize);
+    for(size_t i = 0; i < numKeys; ++i) {
+        plain.insert(make_pair(keys[i], (uint64_t)i));
+        cached.insert(make_pair(keys[i], (uint64_t)i));
+    }
+
+    uint64_t sum = 0;
+    Clock::time_point start = Clock::now();
+    for(size_t i = 0; i < numLookups; ++i) {
+        sum += plain.find(lookups[i])->second;
+    }
+    Clock::time_point mid = Clock::now();
+    for(size_t i = 0; i < numLookups; ++i) {
+        sum -= cached.find(lookups[i])->second;
+    }
+    Clock::time_point stop = Clock::now();
+
+    cout << left << setw(46) << "AVLTree, Zipf keys" << right << fixed << setprecision(1)
+         << setw(12) << chrono::duration<double, nano>(mid - start).count() / numLookups
+         << setw(14) << chrono::duration<double, nano>(stop - mid).count() / numLookups
+         << setw(11) << 100.0 * cached.cacheHits() / numLookups << "%";
+    // both passes must read the same values
+    cout << (sum == 0 ? "" : "  MISMATCH") << endl;
+}
+
+// times numLookups lookups of which half are for absent keys in a plain
+// AVLTree and in a BloomGuardedTree with a 1% false-positive target, and
+// prints ns/lookup for both and the share of lookups the filter answered
+void runNegativeLookups(size_t numKeys, size_t numLookups)
+{
+    mt19937_64 gen(490);
+    uniform_int_distribution<uint64_t> keyDist(0, numKeys - 1);
+
+    // even keys are present, odd keys absent
+    AVLTree<uint64_t, uint64_t> plain;
+    BloomGuardedTree<uint64_t, uint64_t> guarded(0.01);
+    for(size_t i = 0; i < numKeys; ++i) {
+        uint64_t key = 2 * keyDist(gen);
+        plain.insert(make_pair(key, (uint64_t)i));
+        guarded.insert(make_pair(key, (uint64_t)i));
+    }
+
+    vector<uint64_t> lookups(numLookups);
+    for(size_t i = 0; i < numLookups; ++i) {
+        lookups[i] = 2 * keyDist(gen) + (i % 2);
+    }
+
+    size_t found = 0;
+    Clock::time_point start = Clock::now();
+    for(size_t i = 0; i < numLookups; ++i) {
+        if(plain.find(lookups[i]) != plain.end()) {
+            ++found;
+        }
+    }
+    Clock::time_point mid = Clock::now();
+    for(size_t i = 0; i < numLookups; ++i) {
+        if(guarded.find(lookups[i]) != guarded.end()) {
+            --found;
+        }
+    }
+    Clock::time_point stop = Clock::now();
+
+    cout << left << setw(46) << "AVLTree, 50% absent keys" << right << fixed << setprecision(1)
+         << setw(12) << chrono::duration<double, nano>(mid - start).count() / numLookups
+         << setw(14) << chrono::duration<double, nano>(stop - mid).count() / numLookups
+         << setw(11) << 100.0 * guarded.filterRejects() / numLookups << "%";
+    // both passes must find the same keys
+    cout << (found == 0 ? "" : "  MISMATCH") << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t numKeys = 5000;
+    size_t numOps = 50000;
+    if(argc > 1) { numKeys = strtoul(argv[1], NULL, 10); }
+    if(argc > 2) { numOps = strtoul(argv[2], NULL, 10); }
+
+    const Workload workloads[] = {
+        { "write-heavy (45% ins / 45% rem / 10% find)", 45, 45 },
+        { "balanced    (25% ins / 25% rem / 50% find)", 25, 25 },
+        { "read-heavy  ( 5% ins /  5% rem / 90% find)",  5,  5 },
+    };
+
+    cout << "keys: " << numKeys << ", ops: " << numOps << " (ns/op)" << endl;
+    cout << left << setw(46) << "workload"
+         << right << setw(12) << "AVLTree" << setw(14) << "RedBlackTree" << setw(12) << "BTreeMap" << setw(13) << "PathAVLTree" << endl;
+
+    for(size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); ++i) {
+        double avl = runWorkload<AVLTree<uint64_t, uint64_t> >(workloads[i], numKeys, numOps, 104 + i);
+        double rb = runWorkload<RedBlackTree<uint64_t, uint64_t> >(workloads[i], numKeys, numOps, 104 + i);
+        double bt = runWorkload<BTreeMap<uint64_t, uint64_t> >(workloads[i], numKeys, numOps, 104 + i);
+        double path = runWorkload<PathAVLTree<uint64_t, uint64_t> >(workloads[i], numKeys, numOps, 104 + i);
+        cout << left << setw(46) << workloads[i].name
+             << right << fixed << setprecision(1) << setw(12) << avl << setw(14) << rb << setw(12) << bt << setw(13) << path << endl;
+    }
+
+    cout << endl << "merging two trees of " << numKeys << " keys each (ns/item)" << endl;
+    cout << left << setw(46) << "tree / key ranges"
+         << right << setw(12) << "insert()" << setw(14) << "merge()" << endl;
+    runMerge<AVLTree<uint64_t, uint64_t> >("AVLTree, disjoint", numKeys, false);
+    runMerge<AVLTree<uint64_t, uint64_t> >("AVLTree, interleaved", numKeys, true);
+    runMerge<RedBlackTree<uint64_t, uint64_t> >("RedBlackTree, interleaved", numKeys, true);
+
+    size_t buildItems = numKeys < (1 << 18) ? (1 << 18) : numKeys;
+    unsigned cores = ParallelTreeOps<uint64_t, uint64_t>::threadCount(0);
+    cout << endl << "loading " << buildItems << " unsorted items (ns/item), " << cores << " cores" << endl;
+    cout << left << setw(46) << "tree"
+         << right << setw(12) << "insert()" << setw(14) << "build x1" << setw(14) << "build xN" << endl;
+    runBuild<RedBlackTree<uint64_t, uint64_t> >("RedBlackTree", buildItems, cores);
+    runBuild<BinarySearchTree<uint64_t, uint64_t> >("BinarySearchTree (random order)", buildItems, cores);
+
+    cout << endl << "summing " << buildItems << " values (ns/item), " << cores << " cores" << endl;
+    cout << left << setw(46) << "tree"
+         << right << setw(12) << "iterator" << setw(14) << "ordered" << setw(14) << "relaxed" << endl;
+    runScan<AVLTree<uint64_t, uint64_t> >("AVLTree", buildItems, cores);
+
+    cout << endl << "skewed lookups, keys: " << buildItems << ", 1024 cached nodes (ns/lookup)" << endl;
+    cout << left << setw(46) << "tree / key distribution"
+         << right << setw(12) << "find()" << setw(14) << "cached find()" << setw(12) << "hit rate" << endl;
+    runSkewedLookups(buildItems, 1 << 21, 1024);
+
+    cout << endl << "negative lookups, keys: " << buildItems << " (ns/lookup)" << endl;
+    cout << left << setw(46) << "tree / key mix"
+         << right << setw(12) << "find()" << setw(14) << "filtered" << setw(12) << "rejected" << endl;
+    runNegativeLookups(buildItems, 1 << 21);
+
+    // batched lookups need a large tree to be memory bound. Keep this section last: freeing a
+    // million nodes makes the next allocation pay for consolidating the heap.
+    size_t lookupKeys = numKeys < (1 << 20) ? (1 << 20) : numKeys;
+    cout << endl << "batched lookups, keys: " << lookupKeys << " (ns/lookup)" << endl;
+    cout << left << setw(46) << "tree / batch size"
+         << right << setw(12) << "find()" << setw(14) << "find_many()" << endl;
+    runBatchedLookups<RedBlackTree<uint64_t, uint64_t> >("RedBlackTree, 32 keys per batch", lookupKeys, 1 << 20, 32);
+
+    return 0;
+}
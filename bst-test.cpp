@@ -1,10 +1,56 @@
 #include <iostream>
 #include <map>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <csignal>
+#include <sys/resource.h>
 #include "bst.h"
 #include "avlbst.h"
+#include "rbbst.h"
+#include "btree.h"
+#include "compactavl.h"
+#include "pathavl.h"
+#include "lazyavl.h"
+#include "avlmulti.h"
+#include "intervaltree.h"
+#include "aggregatetree.h"
+#include "parallel.h"
+#include "shardedavl.h"
+#include "tracetree.h"
+#include "treeexport.h"
+#include "staticmap.h"
+#include "hotcache.h"
+#include "bloomtree.h"
+#include "durableavl.h"
+#include "checkpointtree.h"
 
 using namespace std;
 
+// Static Map Tests: a table sorted while compiling
+static constexpr std::pair<int, char> opcodeTable[] = { {0xe8, 'c'}, {0x90, 'n'}, {0xc3, 'r'}, {0xe9, 'j'} };
+static constexpr StaticMap<int, char, 4> opcodes = makeStaticMap(opcodeTable);
+static_assert(opcodes[0xc3] == 'r' && opcodes.find(0x91) == opcodes.end(), "opcode table");
+
+bool isEvenValue(const std::pair<const char, int>& item)
+{
+    return item.second % 2 == 0;
+}
+
+std::string keyString(const std::pair<const char, int>& item)
+{
+    return std::string(1, item.first);
+}
+
+std::string concat(const std::string& a, const std::string& b)
+{
+    return a + b;
+}
+
+void doubleValue(std::pair<const char, int>& item)
+{
+    item.second *= 2;
+}
 
 int main(int argc, char *argv[])
 {
@@ -23,6 +69,14 @@ int main(int argc, char *argv[])
     else {
         cout << "Did not find b" << endl;
     }
+    std::vector<char> keys;
+    keys.push_back('a');
+    keys.push_back('c');
+    std::vector<BinarySearchTree<char,int>::iterator> found;
+    bt.find_many(keys, found);
+    for(size_t i = 0; i < keys.size(); ++i) {
+        cout << "find_many " << keys[i] << ": " << (found[i] != bt.end() ? "found" : "not found") << endl;
+    }
     cout << "Erasing b" << endl;
     bt.remove('b');
 
@@ -43,6 +97,633 @@ int main(int argc, char *argv[])
     }
     cout << "Erasing b" << endl;
     at.remove('b');
+    for(char c = 'a'; c <= 'j'; ++c) {
+        at.insert(std::make_pair(c, c - 'a'));
+    }
+    cout << "Erasing [c, h) and every even value" << endl;
+    at.erase_range('c', 'h');
+    at.erase_if(isEvenValue);
+    for(AVLTree<char,int>::iterator it = at.begin(); it != at.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    AVLTree<char,int> other;
+    other.insert(std::make_pair('c',20));
+    other.insert(std::make_pair('h',70));
+    cout << "Merging in c and h" << endl;
+    at.merge(std::move(other));
+    for(AVLTree<char,int>::iterator it = at.begin(); it != at.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+
+    // Red-Black Tree Tests
+    RedBlackTree<char,int> rt;
+    rt.insert(std::make_pair('a',1));
+    rt.insert(std::make_pair('b',2));
+
+    cout << "\nRedBlackTree contents:" << endl;
+    for(RedBlackTree<char,int>::iterator it = rt.begin(); it != rt.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    if(rt.find('b') != rt.end()) {
+        cout << "Found b" << endl;
+    }
+    else {
+        cout << "Did not find b" << endl;
+    }
+    cout << "Erasing b" << endl;
+    rt.remove('b');
+
+    // random inserts and removes, checked against std::map and the color rules
+    RedBlackTree<int,int> rbt;
+    std::map<int,int> rbExpected;
+    bool rbValid = true;
+    unsigned int rbSeed = 12345;
+    for(int i = 0; i < 4000; ++i) {
+        rbSeed = rbSeed * 1103515245 + 12345;
+        int k = (rbSeed >> 16) % 500;
+        if(i % 3 == 2) {
+            rbt.remove(k);
+            rbExpected.erase(k);
+        }
+        else {
+            rbt.insert(std::make_pair(k, i));
+            rbExpected[k] = i;
+        }
+        if(i % 50 == 0) {
+            rbValid = rbValid && rbt.isRedBlack();
+        }
+    }
+    size_t rbSize = 0;
+    bool rbSame = true;
+    std::map<int,int>::iterator rbWant = rbExpected.begin();
+    for(RedBlackTree<int,int>::iterator it = rbt.begin(); rbSame && it != rbt.end(); ++it, ++rbWant, ++rbSize) {
+        rbSame = rbWant != rbExpected.end() && it->first == rbWant->first && it->second == rbWant->second;
+    }
+    rbSame = rbSame && rbSize == rbExpected.size();
+    // then remove everything, checking after each step
+    for(std::map<int,int>::iterator it = rbExpected.begin(); it != rbExpected.end(); ++it) {
+        rbt.remove(it->first);
+        rbValid = rbValid && rbt.isRedBlack();
+    }
+    cout << "RedBlackTree random run: " << rbSize << " items, matches std::map: " << rbSame
+         << ", valid red-black tree throughout: " << (rbValid && rbt.isRedBlack()) << ", empty at the end: " << rbt.empty() << endl;
+
+    // B-Tree Map Tests
+    BTreeMap<char,int> bm;
+    bm.insert(std::make_pair('a',1));
+    bm.insert(std::make_pair('b',2));
+
+    cout << "\nBTreeMap contents:" << endl;
+    for(BTreeMap<char,int>::iterator it = bm.begin(); it != bm.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    if(bm.find('b') != bm.end()) {
+        cout << "Found b" << endl;
+    }
+    else {
+        cout << "Did not find b" << endl;
+    }
+    cout << "Erasing b" << endl;
+    bm.remove('b');
+
+    // random inserts and removes against std::map, with a small fanout so the
+    // tree grows several levels and every split, borrow and merge case runs
+    BTreeMap<int,int,4> btm;
+    std::map<int,int> btExpected;
+    unsigned int btSeed = 777;
+    int btHeight = 0;
+    for(int i = 0; i < 20000; ++i) {
+        btSeed = btSeed * 1103515245 + 12345;
+        int k = (btSeed >> 16) % 3000;
+        if(i % 4 == 3) {
+            btm.remove(k);
+            btExpected.erase(k);
+        }
+        else {
+            btm.insert(std::make_pair(k, i));
+            btExpected[k] = i;
+        }
+        btHeight = std::max(btHeight, btm.height());
+    }
+    size_t btSize = 0;
+    bool btSame = btm.size() == btExpected.size();
+    std::map<int,int>::iterator btWant = btExpected.begin();
+    for(BTreeMap<int,int,4>::iterator it = btm.begin(); btSame && it != btm.end(); ++it, ++btWant, ++btSize) {
+        btSame = btWant != btExpected.end() && it->first == btWant->first && it->second == btWant->second;
+    }
+    btSame = btSame && btSize == btExpected.size();
+    for(int k = 0; btSame && k < 3000; ++k) {
+        btSame = (btm.find(k) == btm.end()) == (btExpected.find(k) == btExpected.end());
+    }
+    // remove down to empty in a scattered order, checking the size on the way
+    std::vector<int> btKeys;
+    for(std::map<int,int>::iterator it = btExpected.begin(); it != btExpected.end(); ++it) {
+        btKeys.push_back(it->first);
+    }
+    for(size_t i = 0; i < btKeys.size(); ++i) {
+        int k = btKeys[(i * 7919) % btKeys.size()];
+        btm.remove(k);
+        btExpected.erase(k);
+        btSame = btSame && btm.size() == btExpected.size();
+    }
+    cout << "BTreeMap random run: " << btSize << " items, height up to " << btHeight
+         << ", matches std::map: " << btSame << ", empty at the end: " << btm.empty()
+         << ", height: " << btm.height() << ", begin == end: " << (btm.begin() == btm.end()) << endl;
+
+    // Compact AVL Tree Tests
+    CompactAVLTree<int,int> ct;
+    std::map<int,int> ctExpected;
+    for(int i = 0; i < 200; ++i) {
+        int k = (i * 37) % 211;
+        ct.insert(std::make_pair(k, i));
+        ctExpected[k] = i;
+    }
+    // each remove moves the pool's last node into the freed slot
+    for(int k = 0; k < 211; k += 3) {
+        ct.remove(k);
+        ctExpected.erase(k);
+    }
+    bool ctSame = ct.size() == ctExpected.size();
+    std::map<int,int>::iterator ctWant = ctExpected.begin();
+    for(CompactAVLTree<int,int>::iterator it = ct.begin(); ctSame && it != ct.end(); ++it, ++ctWant) {
+        ctSame = ctWant != ctExpected.end() && it->first == ctWant->first && it->second == ctWant->second;
+    }
+    cout << "\nCompactAVLTree: " << ct.size() << " items, matches std::map: " << ctSame
+         << ", balanced: " << ct.isBalanced() << ", find(3): "
+         << (ct.find(3) == ct.end() ? "end" : "found") << ", find(4): " << ct.find(4)->second << endl;
+
+    // Path AVL Tree Tests
+    PathAVLTree<int,int> pt;
+    std::map<int,int> ptExpected;
+    for(int i = 0; i < 200; ++i) {
+        int k = (i * 37) % 211;
+        pt.insert(std::make_pair(k, i));
+        ptExpected[k] = i;
+    }
+    // removes retrace along the recorded path, with no parent pointers
+    for(int k = 0; k < 211; k += 3) {
+        pt.remove(k);
+        ptExpected.erase(k);
+    }
+    size_t ptSize = 0;
+    bool ptSame = true;
+    std::map<int,int>::iterator ptWant = ptExpected.begin();
+    for(PathAVLTree<int,int>::iterator it = pt.begin(); ptSame && it != pt.end(); ++it, ++ptWant, ++ptSize) {
+        ptSame = ptWant != ptExpected.end() && it->first == ptWant->first && it->second == ptWant->second;
+    }
+    ptSame = ptSame && ptSize == ptExpected.size();
+    cout << "\nPathAVLTree: " << ptSize << " items, matches std::map: " << ptSame
+         << ", balanced: " << pt.isBalanced() << ", find(3): "
+         << (pt.find(3) == pt.end() ? "end" : "found") << ", find(4): " << pt.find(4)->second << endl;
+    pt.clear();
+    cout << "after clear, empty: " << pt.empty() << endl;
+
+    // Lazy-delete AVL Tree Tests
+    LazyAVLTree<char,int> lt;
+    lt.setAutoCompact(false);
+    lt.insert(std::make_pair('a',1));
+    lt.insert(std::make_pair('b',2));
+    cout << "\nLazyAVLTree erasing b" << endl;
+    lt.remove('b');
+    cout << "live: " << lt.size() << ", tombstones: " << lt.tombstones() << endl;
+    for(LazyAVLTree<char,int>::iterator it = lt.begin(); it != lt.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    lt.compact();
+    cout << "after compact, tombstones: " << lt.tombstones() << endl;
+    // through the base class, lookups must still miss tombstones
+    lt.insert(std::make_pair('c',3));
+    lt.remove('a');
+    BinarySearchTree<char,int>& ltBase = lt;
+    std::vector<char> ltKeys;
+    ltKeys.push_back('a');
+    ltKeys.push_back('c');
+    std::vector<BinarySearchTree<char,int>::iterator> ltHits;
+    ltBase.find_many(ltKeys, ltHits);
+    cout << "via base: find(a) " << (ltBase.find('a') == ltBase.end() ? "missing" : "FOUND")
+         << ", find_many(a,c) " << (ltHits[0] == ltBase.end() ? "missing" : "FOUND")
+         << " " << (ltHits[1] != ltBase.end() ? "found" : "MISSING")
+         << ", begin " << ltBase.begin()->first << endl;
+    std::vector<LazyAVLTree<char,int>::iterator> ltLazyHits;
+    lt.find_many(ltKeys, ltLazyHits);
+    cout << "find_many(a,c) " << (ltLazyHits[0] == lt.end() ? "missing" : "FOUND")
+         << " " << (ltLazyHits[1] != lt.end() ? "found" : "MISSING") << endl;
+    for(char c = 'd'; c <= 'k'; ++c) {
+        lt.insert(std::make_pair(c, c - 'a'));
+    }
+    AVLTree<char,int>& ltAvl = lt;
+    ltAvl.erase_if([](const std::pair<const char, int>& item) { return item.second % 2 == 0; });
+    cout << "erase_if of even values via AVLTree&, live: " << lt.size() << ", tombstones: " << lt.tombstones() << endl;
+    ltBase.clear();
+    cout << "after clear via base, live: " << lt.size() << ", tombstones: " << lt.tombstones() << endl;
+
+    // AVL Multi Tree Tests
+    AVLMultiTree<char,int> mt;
+    mt.insert(std::make_pair('a',1));
+    mt.insert(std::make_pair('b',2));
+    mt.insert(std::make_pair('a',3));
+    cout << "\nAVLMultiTree contents:" << endl;
+    for(AVLMultiTree<char,int>::iterator it = mt.begin(); it != mt.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "count(a): " << mt.count('a') << endl;
+    cout << "Erasing one a" << endl;
+    mt.removeOne('a');
+    std::pair<AVLMultiTree<char,int>::iterator, AVLMultiTree<char,int>::iterator> as = mt.equal_range('a');
+    for(AVLMultiTree<char,int>::iterator it = as.first; it != as.second; ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+
+    // counted duplicates become separate items in a tree that keeps nodes
+    AVLMultiTree<int,int> countedFives(true);
+    AVLMultiTree<int,int> countedSevens(true);
+    for(int i = 0; i < 3; ++i) {
+        countedFives.insert(std::make_pair(5, 50));
+        countedSevens.insert(std::make_pair(7, 70));
+    }
+    AVLMultiTree<int,int> nodeMerged;
+    AVLMultiTree<int,int> emptyMerged;
+    nodeMerged.insert(std::make_pair(1, 10));
+    nodeMerged.merge(std::move(countedFives));
+    emptyMerged.merge(std::move(countedSevens));
+    size_t mergedItems = 0;
+    for(AVLMultiTree<int,int>::iterator it = emptyMerged.begin(); it != emptyMerged.end(); ++it) {
+        ++mergedItems;
+    }
+    cout << "counted merge, count(5): " << nodeMerged.count(5) << ", count(7): " << emptyMerged.count(7)
+         << ", items: " << mergedItems << ", balanced: " << (nodeMerged.isBalanced() && emptyMerged.isBalanced() ? "yes" : "no") << endl;
+
+    // Interval Tree Tests
+    IntervalTree<int,char> it;
+    it.insert(1, 5, 'a');
+    it.insert(4, 9, 'b');
+    it.insert(12, 15, 'c');
+    std::vector<IntervalTree<int,char>::iterator> hits;
+    it.overlapping(5, 12, hits);
+    cout << "\nIntervalTree overlapping [5,12]:" << endl;
+    for(size_t i = 0; i < hits.size(); ++i) {
+        cout << hits[i]->first << " " << hits[i]->second << endl;
+    }
+    cout << "stab(10): " << (it.stab(10) != it.end() ? "found" : "none") << endl;
+
+    // Aggregate Tree Tests
+    AggregateTree<int,int> sums;
+    AggregateTree<int,int,MaxMonoid<int> > maxes;
+    for(int k = 1; k <= 10; ++k) {
+        sums.insert(std::make_pair(k, k * k));
+        maxes.insert(std::make_pair(k, (k * 7) % 11));
+    }
+    cout << "\nAggregateTree sum of squares over [3,7): " << sums.aggregate(3, 7) << endl;
+    cout << "max over [1,5): " << maxes.aggregate(1, 5) << endl;
+    sums.remove(4);
+    cout << "after erasing 4, sum over [3,7): " << sums.aggregate(3, 7) << endl;
+
+    // Parallel Build Tests
+    AVLTree<char,int> pb;
+    std::vector<std::pair<char,int> > items;
+    const char* letters = "parallelbuild";
+    for(int i = 0; letters[i] != '\0'; ++i) {
+        items.push_back(std::make_pair(letters[i], i));
+    }
+    parallel_build(pb, items, 2);
+    cout << "\nparallel_build of \"" << letters << "\", last value per key:" << endl;
+    for(AVLTree<char,int>::iterator it = pb.begin(); it != pb.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "balanced: " << (pb.isBalanced() ? "yes" : "no") << endl;
+
+    // a multi tree keeps every item, in input order
+    AVLMultiTree<char,int> pm;
+    AVLMultiTree<char,int> pmCounted(true);
+    std::vector<std::pair<char,int> > multiItems;
+    for(int i = 0; letters[i] != '\0'; ++i) {
+        multiItems.push_back(std::make_pair(letters[i], i));
+    }
+    std::vector<std::pair<char,int> > countedItems(multiItems);
+    pm.insert(std::make_pair('l', -1));
+    parallel_build(pm, multiItems, 2);
+    parallel_build(pmCounted, countedItems, 2);
+    cout << "parallel_build into AVLMultiTree, items with key l:";
+    std::pair<AVLMultiTree<char,int>::iterator, AVLMultiTree<char,int>::iterator> ls = pm.equal_range('l');
+    for(AVLMultiTree<char,int>::iterator it = ls.first; it != ls.second; ++it) {
+        cout << " " << it->second;
+    }
+    cout << endl << "count(l): " << pm.count('l') << ", counting mode count(l): " << pmCounted.count('l')
+         << ", balanced: " << (pm.isBalanced() ? "yes" : "no") << endl;
+    // big enough for the threaded sort and build
+    AVLMultiTree<int,int> pmBig;
+    std::vector<std::pair<int,int> > bigItems;
+    for(int i = 0; i < 40000; ++i) {
+        bigItems.push_back(std::make_pair((i * 7919) % 1000, i));
+    }
+    parallel_build(pmBig, bigItems, 4);
+    cout << "40000 items over 1000 keys: count(0) = " << pmBig.count(0) << ", count(999) = " << pmBig.count(999)
+         << ", balanced: " << (pmBig.isBalanced() ? "yes" : "no") << endl;
+
+    // Parallel Walk Tests
+    parallel_for_each(pb, doubleValue, 2);
+    cout << "\nparallel_reduce keys in order: " << parallel_reduce(pb, std::string(), keyString, concat, true, 2) << endl;
+    cout << "value of p after doubling: " << pb['p'] << ", of u: " << pb['u'] << endl;
+
+    // Sharded Map Tests
+    std::vector<int> bounds;
+    bounds.push_back(10);
+    bounds.push_back(20);
+    ShardedAVLMap<int,int> sm(3, bounds);
+    for(int k = 0; k < 30; k += 4) {
+        sm.insert(std::make_pair(k, k * 10));
+    }
+    sm.remove(8);
+    std::vector<std::pair<int,int> > spans;
+    sm.range(5, 25, spans);
+    cout << "\nShardedAVLMap [5,25):" << endl;
+    for(size_t i = 0; i < spans.size(); ++i) {
+        cout << spans[i].first << " " << spans[i].second << endl;
+    }
+    std::vector<size_t> sizes;
+    sm.shardSizes(sizes);
+    cout << "shard sizes: " << sizes[0] << " " << sizes[1] << " " << sizes[2] << endl;
+
+    // Trace Tests
+    std::vector<TraceRecord<int> > trace;
+    {
+        TracedTree<int, std::string> tt("bst-test.trace");
+        tt.insert(std::make_pair(1, std::string("one")));
+        tt.insert(std::make_pair(2, std::string("two")));
+        tt.insert(std::make_pair(3, std::string("three")));
+        tt.find(2);
+        tt.remove(1);
+        tt.erase_range(3, 10);
+        AVLTree<int, std::string> more;
+        more.insert(std::make_pair(7, std::string("seven")));
+        tt.merge(std::move(more));
+        // base-class writes reach the trace through the hooks
+        BinarySearchTree<int, std::string>& ttBase = tt;
+        ttBase.update(2, [](std::string& v) { v = "deux"; });
+        ttBase[9];
+    }
+    readTrace("bst-test.trace", trace);
+    std::remove("bst-test.trace");
+    std::map<int, std::string> replayed;
+    replayTrace<int, std::string>(trace, replayed);
+    cout << "\nreplayed " << trace.size() << " traced operations, keys:";
+    for(std::map<int, std::string>::iterator it = replayed.begin(); it != replayed.end(); ++it) {
+        cout << " " << it->first << "(" << it->second.size() << ")";
+    }
+    cout << endl;
+
+    // Export Tests
+    AVLTree<int, char> ex;
+    for(int i = 1; i <= 7; ++i) {
+        ex.insert(std::make_pair(i, (char)('a' + i - 1)));
+    }
+    ex.remove(7);
+    cout << "\nexportTree, two levels:" << endl;
+    exportTree(ex, cout, EXPORT_TEXT, 2);
+    cout << "exportSubtree(6) as JSON: ";
+    exportSubtree(ex, 6, cout, EXPORT_JSON);
+    cout << "exportSubtree(9) found: " << (exportSubtree(ex, 9, cout) ? "yes" : "no") << endl;
+
+    cout << "\nStaticMap in key order:";
+    for(StaticMap<int, char, 4>::iterator it = opcodes.begin(); it != opcodes.end(); ++it) {
+        cout << " " << hex << it->first << dec << "=" << it->second;
+    }
+    cout << endl;
+    try {
+        opcodes[0x91];
+    }
+    catch(const std::out_of_range& e) {
+        cout << "opcodes[0x91]: " << e.what() << endl;
+    }
+
+    // Hot Key Cache Tests
+    HotKeyCachedTree<char, int> hot(8);
+    for(char c = 'a'; c <= 'z'; ++c) {
+        hot.insert(std::make_pair(c, c - 'a'));
+    }
+    for(int i = 0; i < 3; ++i) {
+        hot.find('q');
+        hot['e'];
+    }
+    hot.remove('q');
+    cout << "\nHotKeyCachedTree after removing q: find(q) "
+         << (hot.find('q') == hot.end() ? "end" : "found") << ", e=" << hot['e']
+         << ", hits " << hot.cacheHits() << ", misses " << hot.cacheMisses() << endl;
+
+    // Bloom Filter Tests
+    BloomGuardedTree<int, int> guarded(0.01, 16);
+    for(int i = 0; i < 100; i += 2) {
+        guarded.insert(std::make_pair(i, i * i));
+    }
+    for(int i = 0; i < 100; i += 4) {
+        guarded.remove(i);
+    }
+    size_t present = 0;
+    for(int i = 0; i < 100; ++i) {
+        if(guarded.find(i) != guarded.end()) {
+            ++present;
+        }
+    }
+    cout << "\nBloomGuardedTree: " << present << " of 100 keys present, 6 -> " << guarded[6]
+         << ", filter rebuilt " << guarded.filterRebuilds() << " times" << endl;
+    // absent keys (odd ones never went in) are not removals, even when a
+    // loose filter lets half of them through
+    BloomGuardedTree<int, int> leaky(0.5, 64);
+    for(int i = 0; i < 100; i += 2) {
+        leaky.insert(std::make_pair(i, i));
+    }
+    size_t rebuildsBefore = leaky.filterRebuilds();
+    for(int i = 1; i < 1000; i += 2) {
+        leaky.remove(i);
+    }
+    cout << "removing 500 absent keys rebuilt the filter " << leaky.filterRebuilds() - rebuildsBefore << " times" << endl;
+
+    // Upsert Tests
+    AVLTree<char, int> counts;
+    const char* text = "mississippi";
+    for(const char* c = text; *c != '\0'; ++c) {
+        counts[*c]++;
+    }
+    RedBlackTree<char, int> counted;
+    for(const char* c = text; *c != '\0'; ++c) {
+        counted.update(*c, [](int& n) { ++n; });
+    }
+    cout << "\nLetter counts of " << text << ":";
+    for(AVLTree<char, int>::iterator it = counts.begin(); it != counts.end(); ++it) {
+        cout << " " << it->first << "=" << it->second;
+    }
+    cout << endl;
+    std::pair<BinarySearchTree<char, int>::iterator, bool> added = counts.insert(std::make_pair('z', 1));
+    // an existing key keeps its node and takes the new value
+    std::pair<BinarySearchTree<char, int>::iterator, bool> again = counts.insert(std::make_pair('s', 9));
+    cout << "insert z: " << added.second << ", insert s: " << again.second << " (s -> " << again.first->second
+         << "), update matches operator[]: " << (counted.at('i') == counts['i'] && counted.at('p') == counts['p']) << endl;
+    try {
+        counts.at('q');
+    }
+    catch(std::out_of_range& e) {
+        cout << "at('q') threw out_of_range" << endl;
+    }
+
+#ifdef BST_LATENCY_STATS
+    // Latency Histogram Tests: percentiles are rounded up by at most 1/16
+    LatencyHistogram hist;
+    for(uint64_t ns = 1; ns <= 1000; ++ns) {
+        hist.record(ns);
+    }
+    uint64_t p50 = hist.percentile(0.5);
+    uint64_t p99 = hist.percentile(0.99);
+    cout << "\nLatencyHistogram of 1..1000 ns: count " << hist.count() << ", p50 " << p50 << ", p99 " << p99
+         << ", max " << hist.max() << ", within 1/16: "
+         << (p50 >= 500 && p50 <= 500 + 500 / 16 && p99 >= 990 && p99 <= 990 + 990 / 16) << endl;
+    // every find() through the base class records one sample
+    latencyReset();
+    for(int i = 0; i < 100; ++i) {
+        counts.find('s');
+    }
+    LatencyHistogram finds;
+    latencySnapshot(LAT_BST_FIND, finds);
+    cout << "finds recorded: " << finds.count() << endl;
+#endif
+
+    // Durable Tree Tests: write, reopen, compare
+    char walDir[] = "/tmp/bst-test-XXXXXX";
+    if(mkdtemp(walDir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::map<int, int> expected;
+    {
+        DurableAVLTree<int, int> durable(walDir, WAL_SYNC_NONE);
+        for(int i = 0; i < 200; ++i) {
+            durable.insert(std::make_pair(i, i * 3));
+            expected[i] = i * 3;
+        }
+        // the checkpoint holds these, the log what follows
+        durable.checkpoint();
+        for(int i = 0; i < 200; i += 3) {
+            durable.remove(i);
+            expected.erase(i);
+        }
+        durable.update(7, [](int& v) { v = -7; });
+        expected[7] = -7;
+        // through the base class, the hooks still log
+        BinarySearchTree<int, int>& durableBase = durable;
+        durableBase.update(1, [](int& v) { v = 100; });
+        expected[1] = 100;
+        durableBase[1000];
+        expected[1000] = 0;
+        // AVLTree's rebuild would skip the log; the override removes one by one
+        AVLTree<int, int>& durableAvl = durable;
+        durableAvl.erase_if([](const std::pair<const int, int>& item) { return item.first % 10 == 5; });
+        for(int i = 5; i < 200; i += 10) {
+            expected.erase(i);
+        }
+    }
+    DurableAVLTree<int, int> reopened(walDir);
+    size_t reopenedSize = 0;
+    for(BinarySearchTree<int, int>::iterator it = reopened.begin(); it != reopened.end(); ++it) {
+        ++reopenedSize;
+    }
+    bool sameItems = reopenedSize == expected.size();
+    for(std::map<int, int>::iterator it = expected.begin(); sameItems && it != expected.end(); ++it) {
+        BinarySearchTree<int, int>::iterator found = reopened.find(it->first);
+        sameItems = found != reopened.end() && found->second == it->second;
+    }
+    cout << "\nDurableAVLTree reopened with " << reopenedSize << " items, "
+         << reopened.recoveredRecords() << " log records replayed, matches: " << sameItems << endl;
+    unlink((std::string(walDir) + "/wal").c_str());
+    unlink((std::string(walDir) + "/checkpoint").c_str());
+    rmdir(walDir);
+
+    // a commit that fails part way must not leave torn bytes for the retry to follow
+    char tornDir[] = "/tmp/bst-test-XXXXXX";
+    if(mkdtemp(tornDir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    bool tornThrew = false;
+    {
+        DurableAVLTree<int, int> torn(tornDir, WAL_SYNC_NONE);
+        torn.insert(std::make_pair(1, 1));
+        torn.sync();
+        struct stat walStat;
+        stat((std::string(tornDir) + "/wal").c_str(), &walStat);
+        // let the next write land only a few bytes
+        struct rlimit oldLimit;
+        getrlimit(RLIMIT_FSIZE, &oldLimit);
+        struct rlimit tornLimit = oldLimit;
+        tornLimit.rlim_cur = walStat.st_size + 4;
+        void (*oldHandler)(int) = signal(SIGXFSZ, SIG_IGN);
+        setrlimit(RLIMIT_FSIZE, &tornLimit);
+        torn.insert(std::make_pair(2, 2));
+        try {
+            torn.sync();
+        }
+        catch(const std::runtime_error&) {
+            tornThrew = true;
+        }
+        setrlimit(RLIMIT_FSIZE, &oldLimit);
+        signal(SIGXFSZ, oldHandler);
+        torn.sync();
+        torn.insert(std::make_pair(3, 3));
+    }
+    DurableAVLTree<int, int> tornReopened(tornDir);
+    size_t tornItems = 0;
+    for(BinarySearchTree<int, int>::iterator it = tornReopened.begin(); it != tornReopened.end(); ++it) {
+        ++tornItems;
+    }
+    cout << "DurableAVLTree after a torn commit, write failed: " << tornThrew
+         << ", items: " << tornItems << ", records replayed: " << tornReopened.recoveredRecords() << endl;
+    unlink((std::string(tornDir) + "/wal").c_str());
+    rmdir(tornDir);
+
+    // Checkpointed Tree Tests: write during a checkpoint, load it back
+    char ckptDir[] = "/tmp/bst-test-XXXXXX";
+    if(mkdtemp(ckptDir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    CheckpointedTree<int, int> live(16, 64);
+    std::map<int, int> snapshot;
+    for(int i = 0; i < 5000; ++i) {
+        live.insert(std::make_pair(i, i));
+        snapshot[i] = i;
+    }
+    live.startCheckpoint(std::string(ckptDir) + "/checkpoint");
+    // none of these may reach the file
+    for(int i = 0; i < 5000; i += 2) {
+        live.remove(i);
+        live.insert(std::make_pair(i + 1, -i));
+        live.insert(std::make_pair(5000 + i, i));
+    }
+    BinarySearchTree<int, int>& liveBase = live;
+    liveBase.update(4999, [](int& v) { v = -1; });
+    liveBase[9999];
+    CheckpointStats stats = live.waitCheckpoint();
+    {
+        DurableAVLTree<int, int> loaded(ckptDir);
+        bool sameSnapshot = stats.items == snapshot.size();
+        size_t loadedSize = 0;
+        for(BinarySearchTree<int, int>::iterator it = loaded.begin(); it != loaded.end(); ++it) {
+            std::map<int, int>::iterator want = snapshot.find(it->first);
+            sameSnapshot = sameSnapshot && want != snapshot.end() && want->second == it->second;
+            ++loadedSize;
+        }
+        sameSnapshot = sameSnapshot && loadedSize == snapshot.size();
+        cout << "\nCheckpointedTree checkpoint of " << stats.items << " items loaded by DurableAVLTree, "
+             << "matches the tree at the start: " << sameSnapshot << endl;
+    }
+    // clear() goes through the wrapped tree, which keeps its own counts
+    CheckpointedTree<int, int, LazyAVLTree<int, int> > lazyLive;
+    for(int i = 0; i < 10; ++i) {
+        lazyLive.insert(std::make_pair(i, i));
+    }
+    lazyLive.clear();
+    cout << "LazyAVLTree under CheckpointedTree after clear, live: " << lazyLive.size() << endl;
+    unlink((std::string(ckptDir) + "/wal").c_str());
+    unlink((std::string(ckptDir) + "/checkpoint").c_str());
+    rmdir(ckptDir);
 
     return 0;
 }
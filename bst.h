@@ -4,7 +4,11 @@
 #include <iostream>
 #include <exception>
 #include <cstdlib>
+#include <functional>
 #include <utility>
+#include <vector>
+#include <typeinfo>
+#include "latency.h"
 
 /**
  * A templated class for a Node in a search tree.
@@ -186,6 +190,14 @@ void Node<Key, Value>::setValue(const Value& value)
   ---------------------------------------
 */
 
+// bulk operations over a whole tree, see parallel.h
+template <typename Key, typename Value>
+class ParallelTreeOps;
+
+// streaming DOT/JSON/text output of a tree, see treeexport.h
+template <typename Key, typename Value>
+class TreeExporter;
+
 /**
 * A templated unbalanced binary search tree.
 */
@@ -195,15 +207,16 @@ class BinarySearchTree
 public:
     BinarySearchTree(); //TODO -> DONE
     virtual ~BinarySearchTree(); //TODO -> DONE
-    virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO -> DONE
     virtual void remove(const Key& key); //TODO -> DONE
-    void clear(); //TODO -> DONE
+    virtual void clear(); //TODO -> DONE
     bool isBalanced() const; //TODO -> DONE
     void print() const;
     bool empty() const;
 
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    friend class ParallelTreeOps<Key, Value>;
+    friend class TreeExporter<Key, Value>;
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
@@ -228,16 +241,43 @@ public:
     };
 
 public:
+    // like std::map: the item's iterator, and true if key was new (false if
+    // its value was overwritten)
+    virtual std::pair<iterator, bool> insert(const std::pair<const Key, Value>& keyValuePair); //TODO -> DONE
     iterator begin() const;
     iterator end() const;
     iterator find(const Key& key) const;
+    void find_many(const std::vector<Key>& keys, std::vector<iterator>& results) const;
+    iterator lower_bound(const Key& key) const;
+    // key's value, inserting Value() first if key is missing (like std::map).
+    // A const tree cannot insert, so there it throws like at().
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
+    // key's value; throws std::out_of_range if key is missing
+    Value& at(const Key& key);
+    Value const & at(const Key& key) const;
+    // call fn(value) on key's value in place, inserting Value() first if key
+    // is missing; returns the item and whether it was inserted
+    template<typename Fn>
+    std::pair<iterator, bool> update(const Key& key, Fn fn);
+
+    // remove every item in [first, last)
+    void erase(iterator first, iterator last);
+    // remove every item whose key is in [lo, hi)
+    void erase_range(const Key& lo, const Key& hi);
+    // remove every item for which pred(item) is true
+    template<typename Pred>
+    void erase_if(Pred pred);
+
+    // move every item of other into this tree, leaving other empty. Nodes are
+    // relinked rather than copied; on equal keys other's value wins.
+    void merge(BinarySearchTree<Key, Value>&& other);
 
 protected:
     // Mandatory helper functions
     Node<Key, Value>* internalFind(const Key& k) const; // TODO
     Node<Key, Value> *getSmallestNode() const;  // TODO
+    Node<Key, Value>* internalLowerBound(const Key& k) const;
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
@@ -253,12 +293,74 @@ protected:
     // helper functions for isBalanced
     int getHeight(Node<Key, Value>* node) const;
     
-    // recursive helper for isBalanced
-    bool balanceHelper(Node<Key, Value>* node) const;
+    // recursive helper for isBalanced: height of the subtree, or -1 if any
+    // node in it is unbalanced
+    int balancedHeight(Node<Key, Value>* node) const;
 
     // recursive helper for clear
     void clearSubtree(Node<Key, Value>* node);
 
+    // iterator at node, for derived trees (only this class can build one)
+    static iterator iteratorAt(Node<Key, Value>* node);
+
+    // the one descent behind insert, operator[] and update: the node holding
+    // key, or a new node holding value linked where key belongs (created is
+    // then true). Balanced trees override it to rebalance after linking.
+    virtual Node<Key, Value>* findOrCreate(const Key& key, const Value& value, bool& created);
+    // called after a node's value was changed in place, for trees that
+    // keep something derived from values up to date. Nothing here.
+    virtual void valueChanged(Node<Key, Value>* node);
+    // insert without a latency scope, for derived trees that time their own
+    std::pair<iterator, bool> insertItem(const std::pair<const Key, Value>& keyValuePair);
+
+    // remove every key in [*lo, *hi); a NULL bound means unbounded on that side
+    virtual void eraseKeys(const Key* lo, const Key* hi);
+    // erase_if() lands here, so derived trees override one virtual for it
+    typedef std::function<bool(const std::pair<const Key, Value>&)> ItemPredicate;
+    virtual void eraseMatching(const ItemPredicate& pred);
+
+    // hand over the whole node structure, leaving this tree empty
+    virtual Node<Key, Value>* releaseNodes();
+
+    // take ownership of the detached tree at root, released by source
+    virtual void absorbNodes(Node<Key, Value>* root, const BinarySearchTree<Key, Value>& source);
+
+    // fallback for absorbNodes when nodes cannot be reused: insert() a copy
+    // of every item, then free the detached tree
+    void absorbByInsert(Node<Key, Value>* root);
+
+    // bulk building hooks, called from several threads at once on disjoint
+    // nodes. createBuildNode allocates a detached node; finishBuildNode runs
+    // once the node's subtrees (of heights leftH and rightH) are linked below
+    // it. depth counts from the built root, which sits on a tree of treeHeight.
+    virtual Node<Key, Value>* createBuildNode(const Key& key, const Value& value);
+    virtual void finishBuildNode(Node<Key, Value>* node, int leftH, int rightH, int depth, int treeHeight);
+
+    // true for a node that is linked in but is not an item (a LazyAVLTree
+    // tombstone); iterators of such trees skip it and so must whole-tree walks.
+    // The lookups here (find, find_many, lower_bound, at, begin) skip it too, so
+    // they answer right through a BinarySearchTree&, but this class's
+    // iterator does not: iterate such a tree through its own type.
+    virtual bool isHiddenNode(Node<Key, Value>* node) const;
+    // internalFind that treats hidden nodes as missing
+    Node<Key, Value>* visibleFind(const Key& key) const;
+    // the first node in key order at or after node that is not hidden
+    Node<Key, Value>* firstVisible(Node<Key, Value>* node) const;
+
+    // true for a multi tree, where equal keys are separate items: bulk
+    // builds must keep duplicates instead of letting the last one win
+    virtual bool keepsDuplicates() const;
+
+    // per-node metadata for exporters: append (name, value) pairs such as an
+    // AVL balance to fields. Nothing here.
+    virtual void annotateNode(Node<Key, Value>* node, std::vector<std::pair<const char*, int> >& fields) const;
+
+    // number of searches find_many advances in lockstep
+    static const size_t FIND_BATCH = 8;
+
+    // hint the cache to start loading a node we are about to visit
+    static void prefetchNode(const Node<Key, Value>* node);
+
 
 protected:
     Node<Key, Value>* root_;
@@ -405,7 +507,7 @@ template<class Key, class Value>
 typename BinarySearchTree<Key, Value>::iterator
 BinarySearchTree<Key, Value>::begin() const
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
+    BinarySearchTree<Key, Value>::iterator begin(firstVisible(getSmallestNode()));
     return begin;
 }
 
@@ -428,30 +530,137 @@ template<class Key, class Value>
 typename BinarySearchTree<Key, Value>::iterator
 BinarySearchTree<Key, Value>::find(const Key & k) const
 {
-    Node<Key, Value> *curr = internalFind(k);
+    BST_LATENCY_SCOPE(LAT_BST_FIND);
+    Node<Key, Value> *curr = visibleFind(k);
     BinarySearchTree<Key, Value>::iterator it(curr);
     return it;
 }
 
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or the end iterator if there is none
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::lower_bound(const Key& key) const
+{
+    return iterator(firstVisible(internalLowerBound(key)));
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::iteratorAt(Node<Key, Value>* node)
+{
+    return iterator(node);
+}
+
+/**
+* Looks up every key in keys and stores the matching iterator (or end())
+* at the same index of results.
+*
+* The searches are run FIND_BATCH at a time in lockstep: each round moves every
+* unfinished search down one level and prefetches the child it will visit next,
+* so the cache misses of independent lookups overlap instead of adding up.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::find_many(const std::vector<Key>& keys, std::vector<iterator>& results) const
+{
+    results.assign(keys.size(), end());
+
+    for(size_t base = 0; base < keys.size(); base += FIND_BATCH) {
+        size_t batch = keys.size() - base;
+        if(batch > FIND_BATCH) { batch = FIND_BATCH; }
+
+        // current node of each search in the batch, NULL once it is done
+        Node<Key, Value>* curr[FIND_BATCH];
+        for(size_t i = 0; i < batch; ++i) {
+            curr[i] = root_;
+        }
+
+        size_t active = (root_ == NULL) ? 0 : batch;
+        while(active > 0) {
+            active = 0;
+            for(size_t i = 0; i < batch; ++i) {
+                if(curr[i] == NULL) { continue; }
+
+                const Key& key = keys[base + i];
+                // key found - record it (unless hidden) and retire this search
+                if(key == curr[i]->getKey()) {
+                    if(!isHiddenNode(curr[i])) {
+                        results[base + i] = iterator(curr[i]);
+                    }
+                    curr[i] = NULL;
+                    continue;
+                }
+                // otherwise step down and start loading the next node
+                else if(key < curr[i]->getKey()) {
+                    curr[i] = curr[i]->getLeft();
+                }
+                else {
+                    curr[i] = curr[i]->getRight();
+                }
+
+                if(curr[i] != NULL) {
+                    prefetchNode(curr[i]);
+                    ++active;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Returns the value associated with the key, after inserting
+ * the key with a default-constructed value if it is missing
+ */
+template<class Key, class Value>
+Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+{
+    bool created = false;
+    return findOrCreate(key, Value(), created)->getValue();
+}
+template<class Key, class Value>
+Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+{
+    return at(key);
+}
+
 /**
  * @precondition The key exists in the map
  * Returns the value associated with the key
  */
 template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+Value& BinarySearchTree<Key, Value>::at(const Key& key)
 {
-    Node<Key, Value> *curr = internalFind(key);
+    Node<Key, Value> *curr = visibleFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
     return curr->getValue();
 }
 template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+Value const & BinarySearchTree<Key, Value>::at(const Key& key) const
 {
-    Node<Key, Value> *curr = internalFind(key);
+    Node<Key, Value> *curr = visibleFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
     return curr->getValue();
 }
 
+/**
+ * Applies fn to the value of key where it lies, so a read-modify-write
+ * costs one descent instead of a find() and an insert(). A missing key is
+ * inserted with a default-constructed value first.
+ */
+template<class Key, class Value>
+template<typename Fn>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+BinarySearchTree<Key, Value>::update(const Key& key, Fn fn)
+{
+    bool created = false;
+    Node<Key, Value>* node = findOrCreate(key, Value(), created);
+    fn(node->getValue());
+    valueChanged(node);
+    return std::make_pair(iterator(node), created);
+}
+
 /**
 * An insert method to insert into a Binary Search Tree.
 * The tree will not remain balanced when inserting.
@@ -459,47 +668,78 @@ Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
 * overwrite the current value with the updated value.
 */
 template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
 {
+    BST_LATENCY_SCOPE(LAT_BST_INSERT);
     // TODO -> DONE
-        // case 1: tree is empty, insert at root
-        if (root_ == NULL) {
-            root_ = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, NULL);
-            return;
-        }
+    return insertItem(keyValuePair);
+}
 
-        // case 2: tree is not empty, find correct position to insert
-        Node<Key, Value>* curr = root_;
-        Node<Key, Value>* parent = NULL;
+template<class Key, class Value>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+BinarySearchTree<Key, Value>::insertItem(const std::pair<const Key, Value> &keyValuePair)
+{
+    bool created = false;
+    Node<Key, Value>* node = findOrCreate(keyValuePair.first, keyValuePair.second, created);
+    // key exists, overwrite value
+    if(!created) {
+        node->setValue(keyValuePair.second);
+        valueChanged(node);
+    }
+    return std::make_pair(iterator(node), created);
+}
 
-        // traverse tree to find insertion point
-        while (curr != NULL) {
-            parent = curr;
-            // key exists, overwrite value
-            if (keyValuePair.first == curr->getKey()){
-                curr->setValue(keyValuePair.second);
-                return;
-            }
-            // go left if key is less than current node
-            else if (keyValuePair.first < curr->getKey()) {
-                curr = curr->getLeft();
-            }
-            // go right if key is greater than current node
-            else {
-                curr = curr->getRight();
-            }
-        }
+template<class Key, class Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::findOrCreate(const Key& key, const Value& value, bool& created)
+{
+    created = false;
+    // case 1: tree is empty, insert at root
+    if (root_ == NULL) {
+        root_ = new Node<Key, Value>(key, value, NULL);
+        created = true;
+        return root_;
+    }
 
-        // insert new node as child of parent
-        Node<Key, Value>* newNode = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, parent);
-        // insert as left child
-        if (keyValuePair.first < parent->getKey()) {
-            parent->setLeft(newNode);
+    // case 2: tree is not empty, find correct position to insert
+    Node<Key, Value>* curr = root_;
+    Node<Key, Value>* parent = NULL;
+
+    // traverse tree to find insertion point
+    while (curr != NULL) {
+        parent = curr;
+        // key exists, hand back its node
+        if (key == curr->getKey()){
+            return curr;
         }
-        // insert as right child
+        // go left if key is less than current node
+        else if (key < curr->getKey()) {
+            curr = curr->getLeft();
+        }
+        // go right if key is greater than current node
         else {
-            parent->setRight(newNode);
+            curr = curr->getRight();
         }
+    }
+
+    // insert new node as child of parent
+    Node<Key, Value>* newNode = new Node<Key, Value>(key, value, parent);
+    // insert as left child
+    if (key < parent->getKey()) {
+        parent->setLeft(newNode);
+    }
+    // insert as right child
+    else {
+        parent->setRight(newNode);
+    }
+    created = true;
+    return newNode;
+}
+
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::valueChanged(Node<Key, Value>* /*node*/)
+{
+
 }
 
 
@@ -511,6 +751,7 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::remove(const Key& key)
 {
+    BST_LATENCY_SCOPE(LAT_BST_REMOVE);
     // TODO -> DONE
         // find the node to remove with specific key
         Node<Key, Value>* rNode = internalFind(key);
@@ -559,6 +800,218 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
 
 
 
+/**
+* Removes every item in [first, last). The bounds are turned into keys before
+* anything is removed, so derived trees can restructure freely.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::erase(iterator first, iterator last)
+{
+    if(first == last) { return; }
+
+    Key lo = first->first;
+    if(last == end()) {
+        eraseKeys(&lo, NULL);
+    }
+    else {
+        Key hi = last->first;
+        eraseKeys(&lo, &hi);
+    }
+}
+
+/**
+* Removes every item whose key is in [lo, hi).
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::erase_range(const Key& lo, const Key& hi)
+{
+    BST_LATENCY_SCOPE(LAT_BST_ERASE_RANGE);
+    eraseKeys(&lo, &hi);
+}
+
+template<typename Key, typename Value>
+template<typename Pred>
+void BinarySearchTree<Key, Value>::erase_if(Pred pred)
+{
+    eraseMatching(ItemPredicate(pred));
+}
+
+/**
+* Removes every item for which pred(item) returns true, with one remove()
+* per match. AVLTree overrides this with an O(n) rebuild.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::eraseMatching(const ItemPredicate& pred)
+{
+    // collect first: removing while walking would invalidate the walk
+    std::vector<Key> doomed;
+    for(Node<Key, Value>* curr = getSmallestNode(); curr != NULL; curr = successor(curr)) {
+        if(!isHiddenNode(curr) && pred(curr->getItem())) {
+            doomed.push_back(curr->getKey());
+        }
+    }
+    for(size_t i = 0; i < doomed.size(); ++i) {
+        this->remove(doomed[i]);
+    }
+}
+
+// helper - collect the keys in [*lo, *hi) in order, then remove them one by one,
+// O(k * height). Derived trees override this with something faster.
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::eraseKeys(const Key* lo, const Key* hi)
+{
+    std::vector<Key> doomed;
+    Node<Key, Value>* curr = (lo != NULL) ? internalLowerBound(*lo) : getSmallestNode();
+    while(curr != NULL && (hi == NULL || curr->getKey() < *hi)) {
+        doomed.push_back(curr->getKey());
+        curr = successor(curr);
+    }
+    for(size_t i = 0; i < doomed.size(); ++i) {
+        this->remove(doomed[i]);
+    }
+}
+
+/**
+* Moves every item of other into this tree and leaves other empty. Which
+* strategy is used depends on the two trees; see absorbNodes().
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::merge(BinarySearchTree<Key, Value>&& other)
+{
+    BST_LATENCY_SCOPE(LAT_BST_MERGE);
+    if(&other == this) { return; }
+
+    Node<Key, Value>* root = other.releaseNodes();
+    if(root != NULL) {
+        absorbNodes(root, other);
+    }
+}
+
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::releaseNodes()
+{
+    Node<Key, Value>* root = root_;
+    root_ = NULL;
+    return root;
+}
+
+/**
+* When both trees are the same type, each detached node is relinked as a new
+* leaf: no allocation and no copy of keys or values. A node whose key is
+* already present only hands over its value and is freed. Node types must not
+* be mixed (derived nodes cast their links), so other sources are copied.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::absorbNodes(Node<Key, Value>* root, const BinarySearchTree<Key, Value>& source)
+{
+    if(typeid(source) != typeid(*this)) {
+        absorbByInsert(root);
+        return;
+    }
+    if(root_ == NULL) {
+        root_ = root;
+        return;
+    }
+
+    // collect first: relinking would break the successor walk
+    std::vector<Node<Key, Value>*> nodes;
+    Node<Key, Value>* curr = root;
+    while(curr->getLeft() != NULL) { curr = curr->getLeft(); }
+    for( ; curr != NULL; curr = successor(curr)) {
+        nodes.push_back(curr);
+    }
+
+    for(size_t i = 0; i < nodes.size(); ++i) {
+        Node<Key, Value>* node = nodes[i];
+        node->setLeft(NULL);
+        node->setRight(NULL);
+
+        Node<Key, Value>* parent = NULL;
+        curr = root_;
+        while(curr != NULL && curr->getKey() != node->getKey()) {
+            parent = curr;
+            curr = (node->getKey() < curr->getKey()) ? curr->getLeft() : curr->getRight();
+        }
+
+        // key already here - take the value only
+        if(curr != NULL) {
+            curr->setValue(node->getValue());
+            delete node;
+            continue;
+        }
+
+        node->setParent(parent);
+        if(node->getKey() < parent->getKey()) {
+            parent->setLeft(node);
+        }
+        else {
+            parent->setRight(node);
+        }
+    }
+}
+
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::absorbByInsert(Node<Key, Value>* root)
+{
+    Node<Key, Value>* curr = root;
+    while(curr->getLeft() != NULL) { curr = curr->getLeft(); }
+    for( ; curr != NULL; curr = successor(curr)) {
+        this->insert(curr->getItem());
+    }
+    clearSubtree(root);
+}
+
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::createBuildNode(const Key& key, const Value& value)
+{
+    return new Node<Key, Value>(key, value, NULL);
+}
+
+// helper - plain nodes carry nothing to fix up
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::finishBuildNode(Node<Key, Value>* /*node*/, int /*leftH*/, int /*rightH*/,
+                                                   int /*depth*/, int /*treeHeight*/)
+{
+
+}
+
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::isHiddenNode(Node<Key, Value>* /*node*/) const
+{
+    return false;
+}
+
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::visibleFind(const Key& key) const
+{
+    Node<Key, Value>* node = internalFind(key);
+    if(node != NULL && isHiddenNode(node)) {
+        return NULL;
+    }
+    return node;
+}
+
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::firstVisible(Node<Key, Value>* node) const
+{
+    while(node != NULL && isHiddenNode(node)) {
+        node = successor(node);
+    }
+    return node;
+}
+
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::keepsDuplicates() const
+{
+    return false;
+}
+
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::annotateNode(Node<Key, Value>* /*node*/, std::vector<std::pair<const char*, int> >& /*fields*/) const
+{
+
+}
+
 template<class Key, class Value>
 Node<Key, Value>*
 BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* curr)
@@ -619,6 +1072,7 @@ BinarySearchTree<Key, Value>::successor(Node<Key, Value>* curr)
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::clear()
 {
+    BST_LATENCY_SCOPE(LAT_BST_CLEAR);
     // TODO -> DONE
         // tree is empty
         if (root_ == NULL) { return;}
@@ -693,6 +1147,39 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) con
     return NULL; // key not found
 }
 
+// helper - prefetch for reading; a no-op on compilers without the builtin
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::prefetchNode(const Node<Key, Value>* node)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(node, 0, 1);
+#else
+    (void)node;
+#endif
+}
+
+/**
+* Helper function to find the node with the smallest key that is not less than k,
+* or NULL if every key in the tree is less than k.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::internalLowerBound(const Key& key) const
+{
+    Node<Key, Value>* curr = root_;
+    Node<Key, Value>* best = NULL;
+    while(curr != NULL) {
+        // curr is a candidate, look for a smaller one on the left
+        if(!(curr->getKey() < key)) {
+            best = curr;
+            curr = curr->getLeft();
+        }
+        else {
+            curr = curr->getRight();
+        }
+    }
+    return best;
+}
+
 /**
  * Return true iff the BST is balanced.
  */
@@ -703,7 +1190,7 @@ bool BinarySearchTree<Key, Value>::isBalanced() const
         // base case: empty tree is balanced
         if (root_ == nullptr) { return true; }
 
-        return balanceHelper(root_);
+        return balancedHeight(root_) >= 0;
 }
 
 // helper function to recursively get height of subtree rooted at given node
@@ -729,28 +1216,26 @@ int BinarySearchTree<Key, Value>::getHeight(Node<Key, Value>* node) const {
 }
 
 // helper function to check if subtree rooted at given node is balanced
+// heights come back up with the answer, so every node is visited once, O(n)
 template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::balanceHelper(Node<Key, Value>* node) const {
+int BinarySearchTree<Key, Value>::balancedHeight(Node<Key, Value>* node) const {
     
     // base case: empty subtree is balanced
-    if (node == NULL) { return true; }
+    if (node == NULL) { return 0; }
     
-    // get heights of left and right subtrees
-    int leftH = getHeight(node->getLeft());
-    int rightH = getHeight(node->getRight());
+    // get heights of left and right subtrees, stopping at the first imbalance
+    int leftH = balancedHeight(node->getLeft());
+    if (leftH < 0) { return -1; }
+    int rightH = balancedHeight(node->getRight());
+    if (rightH < 0) { return -1; }
     
     // compute absolute value and check height difference
     int diff = leftH - rightH;
     if (diff < 0) { diff = -diff; } // absolute value
 
-    if (diff > 1) { return false; } 
+    if (diff > 1) { return -1; } 
 
-    
-    // recursively check left and right subtrees
-    bool lBalance = balanceHelper(node->getLeft()); 
-    bool rBalance = balanceHelper(node->getRight());
-
-    return lBalance && rBalance;
+    return ((leftH > rightH) ? leftH : rightH) + 1; // add 1 for current node
 }
 
 template<typename Key, typename Value>
@@ -846,6 +1331,9 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
    It will print up to 5 levels of the tree rooted at the passed node,
    in ASCII graphics format.
    We hope it will make debugging easier!
+
+   For trees of any height, exportTree() in treeexport.h streams the whole
+   tree (or a few levels of it) as indented text, Graphviz DOT or JSON.
   */
 
 // include print function (in its own file because it's fairly long)
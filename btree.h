@@ -0,0 +1,698 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+/**
+* Default number of keys per B-tree node: enough keys to fill 256 bytes (4 cache lines),
+* but never fewer than 4.
+*/
+template <typename Key>
+struct BTreeDefaultFanout
+{
+    static const int value = (256 / sizeof(Key)) < 4 ? 4 : (int)(256 / sizeof(Key));
+};
+
+/**
+* A cache-conscious ordered map (a B+ tree). Each node keeps up to Fanout keys in a
+* sorted contiguous array, so a lookup touches about log_Fanout(n) nodes instead of
+* log_2(n). Values are only stored in the leaves, and the leaves are linked so the
+* iterator walks them in order without going back up the tree.
+*
+* insert overwrites existing keys and remove of a missing key does nothing, as in
+* BinarySearchTree. operator[] differs on purpose: it keeps the original throwing
+* lookup (std::out_of_range for a missing key) instead of inserting a default
+* value, so reading a map never splits a node.
+* Key and Value must be default constructible since node arrays are preallocated.
+*/
+template <typename Key, typename Value, int Fanout = BTreeDefaultFanout<Key>::value>
+class BTreeMap
+{
+public:
+    BTreeMap();
+    ~BTreeMap();
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    int height() const;
+
+private:
+    // nodes must be able to split into two halves that are at least half full
+    static_assert(Fanout >= 4, "BTreeMap needs a fanout of at least 4");
+
+    static const int MIN_KEYS = Fanout / 2;
+
+    struct NodeBase
+    {
+        int count;  // number of keys in use
+        bool leaf;
+    };
+
+    struct LeafNode : public NodeBase
+    {
+        LeafNode* prev;
+        LeafNode* next;
+        Key keys[Fanout];
+        Value values[Fanout];
+    };
+
+    // children[i] holds keys in [keys[i-1], keys[i])
+    struct InnerNode : public NodeBase
+    {
+        Key keys[Fanout];
+        NodeBase* children[Fanout + 1];
+    };
+
+public:
+    /**
+    * Reference to one entry of the map. Entries are not stored as pairs (keys and
+    * values live in separate arrays), so the iterator hands out this proxy instead.
+    */
+    struct ItemRef
+    {
+        const Key& first;
+        Value& second;
+    };
+
+    /**
+    * An in-order iterator over the leaves.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        ItemRef operator*() const;
+
+        // operator-> needs something that itself has an operator->
+        struct ArrowProxy
+        {
+            ItemRef ref;
+            ItemRef* operator->() { return &ref; }
+        };
+        ArrowProxy operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class BTreeMap<Key, Value, Fanout>;
+        iterator(LeafNode* leaf, int index);
+        LeafNode* leaf_;
+        int index_;
+    };
+
+public:
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+private:
+    // number of keys < key (lower bound) and number of keys <= key (upper bound)
+    static int lowerBound(const Key* keys, int count, const Key& key);
+    static int upperBound(const Key* keys, int count, const Key& key);
+    static int lowerBound(const Key* keys, int count, const Key& key, std::true_type);
+    static int lowerBound(const Key* keys, int count, const Key& key, std::false_type);
+    static int upperBound(const Key* keys, int count, const Key& key, std::true_type);
+    static int upperBound(const Key* keys, int count, const Key& key, std::false_type);
+
+    // find the leaf and slot of key, or NULL if not present
+    LeafNode* findLeaf(const Key& key, int& index) const;
+
+    // recursive insert; on split returns the new right sibling and its separator
+    NodeBase* insertHelper(NodeBase* node, const std::pair<const Key, Value>& item, Key& sepOut);
+
+    // recursive remove; returns true if something was removed
+    bool removeHelper(NodeBase* node, const Key& key);
+
+    // fix child idx of parent after it dropped below MIN_KEYS
+    void fixUnderflow(InnerNode* parent, int idx);
+
+    // recursive helper for clear
+    void clearSubtree(NodeBase* node);
+
+    NodeBase* root_;
+    size_t size_;
+    int height_;
+};
+
+/*
+---------------------------------------------------
+Begin implementations for the BTreeMap::iterator class.
+---------------------------------------------------
+*/
+
+template<typename Key, typename Value, int Fanout>
+BTreeMap<Key, Value, Fanout>::iterator::iterator()
+    : leaf_(NULL), index_(0)
+{
+
+}
+
+template<typename Key, typename Value, int Fanout>
+BTreeMap<Key, Value, Fanout>::iterator::iterator(LeafNode* leaf, int index)
+    : leaf_(leaf), index_(index)
+{
+
+}
+
+/**
+* Provides access to the item.
+*/
+template<typename Key, typename Value, int Fanout>
+typename BTreeMap<Key, Value, Fanout>::ItemRef
+BTreeMap<Key, Value, Fanout>::iterator::operator*() const
+{
+    ItemRef ref = { leaf_->keys[index_], leaf_->values[index_] };
+    return ref;
+}
+
+/**
+* Provides member access to the item.
+*/
+template<typename Key, typename Value, int Fanout>
+typename BTreeMap<Key, Value, Fanout>::iterator::ArrowProxy
+BTreeMap<Key, Value, Fanout>::iterator::operator->() const
+{
+    ArrowProxy proxy = { { leaf_->keys[index_], leaf_->values[index_] } };
+    return proxy;
+}
+
+template<typename Key, typename Value, int Fanout>
+bool BTreeMap<Key, Value, Fanout>::iterator::operator==(const iterator& rhs) const
+{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+template<typename Key, typename Value, int Fanout>
+bool BTreeMap<Key, Value, Fanout>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances to the next slot, moving to the next leaf when this one is used up.
+*/
+template<typename Key, typename Value, int Fanout>
+typename BTreeMap<Key, Value, Fanout>::iterator&
+BTreeMap<Key, Value, Fanout>::iterator::operator++()
+{
+    ++index_;
+    if(index_ >= leaf_->count) {
+        leaf_ = leaf_->next;
+        index_ = 0;
+    }
+    return *this;
+}
+
+/*
+-------------------------------------------------
+End implementations for the BTreeMap::iterator class.
+-------------------------------------------------
+*/
+
+/*
+-------------------------------------------
+Begin implementations for the BTreeMap class.
+-------------------------------------------
+*/
+
+template<typename Key, typename Value, int Fanout>
+BTreeMap<Key, Value, Fanout>::BTreeMap()
+    : root_(NULL), size_(0), height_(0)
+{
+
+}
+
+template<typename Key, typename Value, int Fanout>
+BTreeMap<Key, Value, Fanout>::~BTreeMap()
+{
+    clear();
+}
+
+template<typename Key, typename Value, int Fanout>
+bool BTreeMap<Key, Value, Fanout>::empty() const
+{
+    return root_ == NULL;
+}
+
+template<typename Key, typename Value, int Fanout>
+size_t BTreeMap<Key, Value, Fanout>::size() const
+{
+    return size_;
+}
+
+/**
+* Number of levels in the tree (0 for an empty tree, 1 for a single leaf).
+*/
+template<typename Key, typename Value, int Fanout>
+int BTreeMap<Key, Value, Fanout>::height() const
+{
+    return height_;
+}
+
+/**
+* Returns an iterator to the smallest item (the first slot of the leftmost leaf).
+*/
+template<typename Key, typename Value, int Fanout>
+typename BTreeMap<Key, Value, Fanout>::iterator
+BTreeMap<Key, Value, Fanout>::begin() const
+{
+    NodeBase* curr = root_;
+    if(curr == NULL) { return end(); }
+    while(!curr->leaf) {
+        curr = static_cast<InnerNode*>(curr)->children[0];
+    }
+    return iterator(static_cast<LeafNode*>(curr), 0);
+}
+
+template<typename Key, typename Value, int Fanout>
+typename BTreeMap<Key, Value, Fanout>::iterator
+BTreeMap<Key, Value, Fanout>::end() const
+{
+    return iterator(NULL, 0);
+}
+
+template<typename Key, typename Value, int Fanout>
+typename BTreeMap<Key, Value, Fanout>::iterator
+BTreeMap<Key, Value, Fanout>::find(const Key& key) const
+{
+    int index = 0;
+    LeafNode* leaf = findLeaf(key, index);
+    if(leaf == NULL) { return end(); }
+    return iterator(leaf, index);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value, int Fanout>
+Value& BTreeMap<Key, Value, Fanout>::operator[](const Key& key)
+{
+    int index = 0;
+    LeafNode* leaf = findLeaf(key, index);
+    if(leaf == NULL) throw std::out_of_range("Invalid key");
+    return leaf->values[index];
+}
+template<typename Key, typename Value, int Fanout>
+Value const & BTreeMap<Key, Value, Fanout>::operator[](const Key& key) const
+{
+    int index = 0;
+    LeafNode* leaf = findLeaf(key, index);
+    if(leaf == NULL) throw std::out_of_range("Invalid key");
+    return leaf->values[index];
+}
+
+/**
+* Inserts the pair, overwriting the value if the key already exists.
+*/
+template<typename Key, typename Value, int Fanout>
+void BTreeMap<Key, Value, Fanout>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    // case 1: empty tree - new leaf root
+    if(root_ == NULL) {
+        LeafNode* leaf = new LeafNode();
+        leaf->count = 1;
+        leaf->leaf = true;
+        leaf->prev = leaf->next = NULL;
+        leaf->keys[0] = keyValuePair.first;
+        leaf->values[0] = keyValuePair.second;
+        root_ = leaf;
+        size_ = 1;
+        height_ = 1;
+        return;
+    }
+
+    // case 2: insert below the root, growing a new root if the old one split
+    Key sep;
+    NodeBase* right = insertHelper(root_, keyValuePair, sep);
+    if(right != NULL) {
+        InnerNode* newRoot = new InnerNode();
+        newRoot->count = 1;
+        newRoot->leaf = false;
+        newRoot->keys[0] = sep;
+        newRoot->children[0] = root_;
+        newRoot->children[1] = right;
+        root_ = newRoot;
+        ++height_;
+    }
+}
+
+template<typename Key, typename Value, int Fanout>
+typename BTreeMap<Key, Value, Fanout>::NodeBase*
+BTreeMap<Key, Value, Fanout>::insertHelper(NodeBase* node, const std::pair<const Key, Value>& item, Key& sepOut)
+{
+    if(node->leaf) {
+        LeafNode* leaf = static_cast<LeafNode*>(node);
+        int pos = lowerBound(leaf->keys, leaf->count, item.first);
+
+        // key exists, overwrite value
+        if(pos < leaf->count && leaf->keys[pos] == item.first) {
+            leaf->values[pos] = item.second;
+            return NULL;
+        }
+        ++size_;
+
+        // room in this leaf - shift the tail right by one
+        if(leaf->count < Fanout) {
+            std::copy_backward(leaf->keys + pos, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+            std::copy_backward(leaf->values + pos, leaf->values + leaf->count, leaf->values + leaf->count + 1);
+            leaf->keys[pos] = item.first;
+            leaf->values[pos] = item.second;
+            ++leaf->count;
+            return NULL;
+        }
+
+        // full leaf - move the upper half into a new right sibling
+        LeafNode* right = new LeafNode();
+        right->leaf = true;
+        int leftCount = (Fanout + 1) / 2;
+        int moved = Fanout - leftCount;
+        if(pos < leftCount) {
+            // new key lands in the left half, so it keeps one less of the old keys
+            --leftCount;
+            ++moved;
+        }
+        std::copy(leaf->keys + leftCount, leaf->keys + Fanout, right->keys);
+        std::copy(leaf->values + leftCount, leaf->values + Fanout, right->values);
+        right->count = moved;
+        leaf->count = leftCount;
+
+        LeafNode* target = leaf;
+        if(pos > leftCount) {
+            target = right;
+            pos -= leftCount;
+        }
+        std::copy_backward(target->keys + pos, target->keys + target->count, target->keys + target->count + 1);
+        std::copy_backward(target->values + pos, target->values + target->count, target->values + target->count + 1);
+        target->keys[pos] = item.first;
+        target->values[pos] = item.second;
+        ++target->count;
+
+        // link the new leaf into the leaf list
+        right->prev = leaf;
+        right->next = leaf->next;
+        if(leaf->next != NULL) { leaf->next->prev = right; }
+        leaf->next = right;
+
+        sepOut = right->keys[0];
+        return right;
+    }
+
+    InnerNode* inner = static_cast<InnerNode*>(node);
+    int idx = upperBound(inner->keys, inner->count, item.first);
+    Key childSep;
+    NodeBase* childRight = insertHelper(inner->children[idx], item, childSep);
+    if(childRight == NULL) { return NULL; }
+
+    // room in this node - add the separator and new child after idx
+    if(inner->count < Fanout) {
+        std::copy_backward(inner->keys + idx, inner->keys + inner->count, inner->keys + inner->count + 1);
+        std::copy_backward(inner->children + idx + 1, inner->children + inner->count + 1, inner->children + inner->count + 2);
+        inner->keys[idx] = childSep;
+        inner->children[idx + 1] = childRight;
+        ++inner->count;
+        return NULL;
+    }
+
+    // full inner node - build the overflowing arrays, then push the middle key up
+    Key keys[Fanout + 1];
+    NodeBase* children[Fanout + 2];
+    std::copy(inner->keys, inner->keys + idx, keys);
+    keys[idx] = childSep;
+    std::copy(inner->keys + idx, inner->keys + Fanout, keys + idx + 1);
+    std::copy(inner->children, inner->children + idx + 1, children);
+    children[idx + 1] = childRight;
+    std::copy(inner->children + idx + 1, inner->children + Fanout + 1, children + idx + 2);
+
+    int leftCount = Fanout / 2;
+    InnerNode* right = new InnerNode();
+    right->leaf = false;
+    right->count = Fanout - leftCount;
+    inner->count = leftCount;
+    std::copy(keys, keys + leftCount, inner->keys);
+    std::copy(children, children + leftCount + 1, inner->children);
+    std::copy(keys + leftCount + 1, keys + Fanout + 1, right->keys);
+    std::copy(children + leftCount + 1, children + Fanout + 2, right->children);
+
+    sepOut = keys[leftCount];
+    return right;
+}
+
+/**
+* Removes the key if it exists, merging or borrowing to keep nodes at least half full.
+*/
+template<typename Key, typename Value, int Fanout>
+void BTreeMap<Key, Value, Fanout>::remove(const Key& key)
+{
+    if(root_ == NULL) { return; }
+    if(!removeHelper(root_, key)) { return; }
+
+    // shrink the root if it ran out of keys
+    if(root_->count == 0) {
+        NodeBase* old = root_;
+        if(old->leaf) {
+            root_ = NULL;
+            delete static_cast<LeafNode*>(old);
+        }
+        else {
+            root_ = static_cast<InnerNode*>(old)->children[0];
+            delete static_cast<InnerNode*>(old);
+        }
+        --height_;
+    }
+}
+
+template<typename Key, typename Value, int Fanout>
+bool BTreeMap<Key, Value, Fanout>::removeHelper(NodeBase* node, const Key& key)
+{
+    if(node->leaf) {
+        LeafNode* leaf = static_cast<LeafNode*>(node);
+        int pos = lowerBound(leaf->keys, leaf->count, key);
+        if(pos == leaf->count || !(leaf->keys[pos] == key)) { return false; }
+        std::copy(leaf->keys + pos + 1, leaf->keys + leaf->count, leaf->keys + pos);
+        std::copy(leaf->values + pos + 1, leaf->values + leaf->count, leaf->values + pos);
+        --leaf->count;
+        --size_;
+        return true;
+    }
+
+    InnerNode* inner = static_cast<InnerNode*>(node);
+    int idx = upperBound(inner->keys, inner->count, key);
+    if(!removeHelper(inner->children[idx], key)) { return false; }
+    if(inner->children[idx]->count < MIN_KEYS) {
+        fixUnderflow(inner, idx);
+    }
+    return true;
+}
+
+// helper - borrow from a sibling with spare keys, otherwise merge with one
+template<typename Key, typename Value, int Fanout>
+void BTreeMap<Key, Value, Fanout>::fixUnderflow(InnerNode* parent, int idx)
+{
+    NodeBase* child = parent->children[idx];
+    NodeBase* leftSib = idx > 0 ? parent->children[idx - 1] : NULL;
+    NodeBase* rightSib = idx < parent->count ? parent->children[idx + 1] : NULL;
+
+    if(child->leaf) {
+        LeafNode* c = static_cast<LeafNode*>(child);
+        LeafNode* l = static_cast<LeafNode*>(leftSib);
+        LeafNode* r = static_cast<LeafNode*>(rightSib);
+
+        // case 1: borrow the last entry of the left sibling
+        if(l != NULL && l->count > MIN_KEYS) {
+            std::copy_backward(c->keys, c->keys + c->count, c->keys + c->count + 1);
+            std::copy_backward(c->values, c->values + c->count, c->values + c->count + 1);
+            c->keys[0] = l->keys[l->count - 1];
+            c->values[0] = l->values[l->count - 1];
+            ++c->count;
+            --l->count;
+            parent->keys[idx - 1] = c->keys[0];
+            return;
+        }
+        // case 2: borrow the first entry of the right sibling
+        if(r != NULL && r->count > MIN_KEYS) {
+            c->keys[c->count] = r->keys[0];
+            c->values[c->count] = r->values[0];
+            ++c->count;
+            std::copy(r->keys + 1, r->keys + r->count, r->keys);
+            std::copy(r->values + 1, r->values + r->count, r->values);
+            --r->count;
+            parent->keys[idx] = r->keys[0];
+            return;
+        }
+        // case 3: merge with a sibling - always fold the right node into the left one
+        if(l == NULL) {
+            l = c;
+            c = r;
+            ++idx;
+        }
+        std::copy(c->keys, c->keys + c->count, l->keys + l->count);
+        std::copy(c->values, c->values + c->count, l->values + l->count);
+        l->count += c->count;
+        l->next = c->next;
+        if(c->next != NULL) { c->next->prev = l; }
+        delete c;
+    }
+    else {
+        InnerNode* c = static_cast<InnerNode*>(child);
+        InnerNode* l = static_cast<InnerNode*>(leftSib);
+        InnerNode* r = static_cast<InnerNode*>(rightSib);
+
+        // case 1: rotate a key through the parent from the left sibling
+        if(l != NULL && l->count > MIN_KEYS) {
+            std::copy_backward(c->keys, c->keys + c->count, c->keys + c->count + 1);
+            std::copy_backward(c->children, c->children + c->count + 1, c->children + c->count + 2);
+            c->keys[0] = parent->keys[idx - 1];
+            c->children[0] = l->children[l->count];
+            ++c->count;
+            parent->keys[idx - 1] = l->keys[l->count - 1];
+            --l->count;
+            return;
+        }
+        // case 2: rotate a key through the parent from the right sibling
+        if(r != NULL && r->count > MIN_KEYS) {
+            c->keys[c->count] = parent->keys[idx];
+            c->children[c->count + 1] = r->children[0];
+            ++c->count;
+            parent->keys[idx] = r->keys[0];
+            std::copy(r->keys + 1, r->keys + r->count, r->keys);
+            std::copy(r->children + 1, r->children + r->count + 1, r->children);
+            --r->count;
+            return;
+        }
+        // case 3: merge, pulling the separator down between the two halves
+        if(l == NULL) {
+            l = c;
+            c = r;
+            ++idx;
+        }
+        l->keys[l->count] = parent->keys[idx - 1];
+        std::copy(c->keys, c->keys + c->count, l->keys + l->count + 1);
+        std::copy(c->children, c->children + c->count + 1, l->children + l->count + 1);
+        l->count += c->count + 1;
+        delete c;
+    }
+
+    // drop the separator and the merged-away child from the parent
+    std::copy(parent->keys + idx, parent->keys + parent->count, parent->keys + idx - 1);
+    std::copy(parent->children + idx + 1, parent->children + parent->count + 1, parent->children + idx);
+    --parent->count;
+}
+
+/**
+* A method to remove all contents of the tree and
+* reset the values in the tree for use again.
+*/
+template<typename Key, typename Value, int Fanout>
+void BTreeMap<Key, Value, Fanout>::clear()
+{
+    if(root_ == NULL) { return; }
+    clearSubtree(root_);
+    root_ = NULL;
+    size_ = 0;
+    height_ = 0;
+}
+
+template<typename Key, typename Value, int Fanout>
+void BTreeMap<Key, Value, Fanout>::clearSubtree(NodeBase* node)
+{
+    if(node->leaf) {
+        delete static_cast<LeafNode*>(node);
+        return;
+    }
+    InnerNode* inner = static_cast<InnerNode*>(node);
+    for(int i = 0; i <= inner->count; ++i) {
+        clearSubtree(inner->children[i]);
+    }
+    delete inner;
+}
+
+/**
+* Descends to the leaf that would hold key and returns it along with the slot,
+* or NULL if the key is not in the tree.
+*/
+template<typename Key, typename Value, int Fanout>
+typename BTreeMap<Key, Value, Fanout>::LeafNode*
+BTreeMap<Key, Value, Fanout>::findLeaf(const Key& key, int& index) const
+{
+    NodeBase* curr = root_;
+    if(curr == NULL) { return NULL; }
+    while(!curr->leaf) {
+        InnerNode* inner = static_cast<InnerNode*>(curr);
+        curr = inner->children[upperBound(inner->keys, inner->count, key)];
+    }
+    LeafNode* leaf = static_cast<LeafNode*>(curr);
+    int pos = lowerBound(leaf->keys, leaf->count, key);
+    if(pos == leaf->count || !(leaf->keys[pos] == key)) { return NULL; }
+    index = pos;
+    return leaf;
+}
+
+// helpers - in-node search. Small arithmetic keys use a branchless linear count
+// that the compiler can vectorize; other keys use binary search.
+template<typename Key, typename Value, int Fanout>
+int BTreeMap<Key, Value, Fanout>::lowerBound(const Key* keys, int count, const Key& key)
+{
+    return lowerBound(keys, count, key, typename std::is_arithmetic<Key>::type());
+}
+
+template<typename Key, typename Value, int Fanout>
+int BTreeMap<Key, Value, Fanout>::upperBound(const Key* keys, int count, const Key& key)
+{
+    return upperBound(keys, count, key, typename std::is_arithmetic<Key>::type());
+}
+
+template<typename Key, typename Value, int Fanout>
+int BTreeMap<Key, Value, Fanout>::lowerBound(const Key* keys, int count, const Key& key, std::true_type)
+{
+    int n = 0;
+    for(int i = 0; i < count; ++i) {
+        n += (keys[i] < key);
+    }
+    return n;
+}
+
+template<typename Key, typename Value, int Fanout>
+int BTreeMap<Key, Value, Fanout>::lowerBound(const Key* keys, int count, const Key& key, std::false_type)
+{
+    return (int)(std::lower_bound(keys, keys + count, key) - keys);
+}
+
+template<typename Key, typename Value, int Fanout>
+int BTreeMap<Key, Value, Fanout>::upperBound(const Key* keys, int count, const Key& key, std::true_type)
+{
+    int n = 0;
+    for(int i = 0; i < count; ++i) {
+        n += !(key < keys[i]);
+    }
+    return n;
+}
+
+template<typename Key, typename Value, int Fanout>
+int BTreeMap<Key, Value, Fanout>::upperBound(const Key* keys, int count, const Key& key, std::false_type)
+{
+    return (int)(std::upper_bound(keys, keys + count, key) - keys);
+}
+
+/*
+-----------------------------------------
+End implementations for the BTreeMap class.
+-----------------------------------------
+*/
+
+#endif
@@ -0,0 +1,513 @@
+#ifndef CHECKPOINTTREE_H
+#define CHECKPOINTTREE_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include "avlbst.h"
+#include "durableavl.h"
+
+/**
+* What one background checkpoint did, including how the foreground writers
+* fared while it ran. Latencies cover every insert/remove issued during the
+* checkpoint, lock waits included; percentiles are rounded up to a power of two.
+*/
+struct CheckpointStats
+{
+    size_t items;           // items written
+    size_t bytes;           // file size
+    double seconds;         // start to finish
+    size_t peakPreimages;   // most pre-images held at once
+    size_t writerOps;       // writes issued while the checkpoint ran
+    uint64_t writerP50Ns;
+    uint64_t writerP99Ns;
+    uint64_t writerMaxNs;
+};
+
+/**
+* Adds non-blocking checkpoints to any BinarySearchTree-derived Tree.
+*
+* startCheckpoint() captures the map as it is at that moment and streams it to
+* a file from a background thread while insert() and remove() keep running.
+* The thread walks the tree in key order, a chunk at a time, holding the tree
+* mutex only while it copies that chunk. A write to a key the walk has not
+* reached yet first saves the key's pre-image (its old value, or that it was
+* absent), and the walk emits pre-images instead of the live items. Pre-images
+* are dropped once the walk passes them, and maxPreimages bounds how many can
+* exist: a writer that would exceed it waits for the walk to catch up.
+*
+* The file uses DurableAVLTree's checkpoint format (sorted, WalCodec encoded),
+* written to path.tmp and renamed over path when complete, so a
+* DurableAVLTree can load it.
+*
+* Writes are seen through the findOrCreate() hook, which saves the pre-image
+* before any key is created or changed, so update() and the base operator[]
+* are covered even through a BinarySearchTree&. operator[] and at() are
+* read-only here. Merging into this tree inserts item by item while a
+* checkpoint runs, and clear() and merging out of this tree wait for a
+* running checkpoint.
+* Reads need no locking from the thread that writes.
+*/
+template <class Key, class Value, class Tree = AVLTree<Key, Value> >
+class CheckpointedTree : public Tree
+{
+public:
+    explicit CheckpointedTree(size_t chunkSize = 256, size_t maxPreimages = 65536);
+    virtual ~CheckpointedTree();
+
+    virtual std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+        insert (const std::pair<const Key, Value> &new_item);
+    virtual void remove(const Key& key);
+    void clear();
+
+    Value const & operator[](const Key& key) const;
+    Value const & at(const Key& key) const;
+
+    // begin a background checkpoint to path; throws if one is running
+    void startCheckpoint(const std::string& path);
+    bool checkpointRunning() const;
+    // wait for the running checkpoint; throws if writing it failed
+    CheckpointStats waitCheckpoint();
+
+protected:
+    // pre-image of a key: whether it existed when the checkpoint started, and its value
+    typedef std::pair<bool, Value> Preimage;
+
+    virtual void eraseKeys(const Key* lo, const Key* hi);
+    // erase_if: one remove per match, so every match gets its pre-image
+    virtual void eraseMatching(const typename BinarySearchTree<Key, Value>::ItemPredicate& pred);
+    virtual Node<Key,Value>* releaseNodes();
+    virtual void absorbNodes(Node<Key,Value>* root, const BinarySearchTree<Key, Value>& source);
+    // every insert(), update() and operator[] descends here first: save the
+    // pre-image, then create or find the node under the lock
+    virtual Node<Key,Value>* findOrCreate(const Key& key, const Value& value, bool& created);
+    virtual void valueChanged(Node<Key,Value>* node);
+
+    // called with lock held before a write to key; may wait for room
+    void savePreimage(const Key& key, std::unique_lock<std::recursive_mutex>& lock);
+    // true if the walk already wrote key (so it needs no pre-image)
+    bool alreadyWritten(const Key& key) const;
+
+    // the background thread
+    void runCheckpoint(std::string path);
+    // copy the next chunk of the snapshot into buf; false once the walk is done
+    bool copyChunk(std::string& buf, size_t& items);
+
+    // record the latency of one foreground write
+    void recordLatency(std::chrono::steady_clock::time_point start);
+    static uint64_t percentile(const std::vector<size_t>& buckets, size_t total, double fraction);
+
+    size_t chunkSize_;
+    size_t maxPreimages_;
+
+    // recursive: a base eraseKeys may call back into remove()
+    mutable std::recursive_mutex mutex_;
+    std::condition_variable_any room_;  // signaled when pre-images are dropped
+    std::thread worker_;
+    bool active_;
+
+    // walk state, guarded by mutex_
+    bool started_;          // false until the first key is written
+    Key cursor_;            // last key written
+    std::map<Key, Preimage> preimages_;
+
+    // results, guarded by mutex_
+    CheckpointStats stats_;
+    std::vector<size_t> latencyBuckets_;    // bucket i counts writes under 2^i ns
+    std::string error_;
+};
+
+/*
+----------------------------------------------
+Begin implementations for the CheckpointedTree class.
+----------------------------------------------
+*/
+
+template<class Key, class Value, class Tree>
+CheckpointedTree<Key, Value, Tree>::CheckpointedTree(size_t chunkSize, size_t maxPreimages)
+    : chunkSize_(chunkSize == 0 ? 1 : chunkSize), maxPreimages_(maxPreimages == 0 ? 1 : maxPreimages),
+      active_(false), started_(false), cursor_(), stats_(), latencyBuckets_(64, 0)
+{
+
+}
+
+// the worker reads the tree, so it must finish before the tree goes away
+template<class Key, class Value, class Tree>
+CheckpointedTree<Key, Value, Tree>::~CheckpointedTree()
+{
+    if(worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+template<class Key, class Value, class Tree>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+CheckpointedTree<Key, Value, Tree>::insert (const std::pair<const Key, Value> &new_item)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::unique_lock<std::recursive_mutex> lock(mutex_);
+    bool timed = active_;
+    // save it here, where waiting for room unlocks the only hold on the lock;
+    // findOrCreate then finds the pre-image in place and does not wait
+    savePreimage(new_item.first, lock);
+    std::pair<typename BinarySearchTree<Key, Value>::iterator, bool> result = Tree::insert(new_item);
+    if(timed) { recordLatency(start); }
+    return result;
+}
+
+template<class Key, class Value, class Tree>
+void CheckpointedTree<Key, Value, Tree>::remove(const Key& key)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::unique_lock<std::recursive_mutex> lock(mutex_);
+    bool timed = active_;
+    savePreimage(key, lock);
+    Tree::remove(key);
+    if(timed) { recordLatency(start); }
+}
+
+template<class Key, class Value, class Tree>
+void CheckpointedTree<Key, Value, Tree>::clear()
+{
+    if(worker_.joinable()) {
+        worker_.join();
+    }
+    Tree::clear();
+}
+
+template<class Key, class Value, class Tree>
+void CheckpointedTree<Key, Value, Tree>::eraseMatching(const typename BinarySearchTree<Key, Value>::ItemPredicate& pred)
+{
+    BinarySearchTree<Key, Value>::eraseMatching(pred);
+}
+
+template<class Key, class Value, class Tree>
+Value const & CheckpointedTree<Key, Value, Tree>::operator[](const Key& key) const
+{
+    return Tree::operator[](key);
+}
+
+template<class Key, class Value, class Tree>
+Value const & CheckpointedTree<Key, Value, Tree>::at(const Key& key) const
+{
+    return Tree::at(key);
+}
+
+/**
+* The value may then change outside the lock: the walk never reads the value
+* of a key that has a pre-image or that it has already written.
+*/
+template<class Key, class Value, class Tree>
+Node<Key,Value>* CheckpointedTree<Key, Value, Tree>::findOrCreate(const Key& key, const Value& value, bool& created)
+{
+    std::unique_lock<std::recursive_mutex> lock(mutex_);
+    savePreimage(key, lock);
+    return Tree::findOrCreate(key, value, created);
+}
+
+template<class Key, class Value, class Tree>
+void CheckpointedTree<Key, Value, Tree>::valueChanged(Node<Key,Value>* node)
+{
+    // the pre-image was saved by findOrCreate; derived data changes under the lock
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    Tree::valueChanged(node);
+}
+
+template<class Key, class Value, class Tree>
+void CheckpointedTree<Key, Value, Tree>::startCheckpoint(const std::string& path)
+{
+    std::unique_lock<std::recursive_mutex> lock(mutex_);
+    if(active_) {
+        throw std::logic_error("a checkpoint is already running");
+    }
+    lock.unlock();
+    // a finished worker still has to be joined before it is replaced
+    if(worker_.joinable()) {
+        worker_.join();
+    }
+    lock.lock();
+
+    active_ = true;
+    started_ = false;
+    preimages_.clear();
+    stats_ = CheckpointStats();
+    latencyBuckets_.assign(64, 0);
+    error_.clear();
+    worker_ = std::thread(&CheckpointedTree<Key, Value, Tree>::runCheckpoint, this, path);
+}
+
+template<class Key, class Value, class Tree>
+bool CheckpointedTree<Key, Value, Tree>::checkpointRunning() const
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return active_;
+}
+
+template<class Key, class Value, class Tree>
+CheckpointStats CheckpointedTree<Key, Value, Tree>::waitCheckpoint()
+{
+    if(worker_.joinable()) {
+        worker_.join();
+    }
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if(!error_.empty()) {
+        throw std::runtime_error(error_);
+    }
+    return stats_;
+}
+
+// helper - save pre-images for every key the walk has not written yet
+template<class Key, class Value, class Tree>
+void CheckpointedTree<Key, Value, Tree>::eraseKeys(const Key* lo, const Key* hi)
+{
+    std::unique_lock<std::recursive_mutex> lock(mutex_);
+    if(active_) {
+        // collect first: waiting for room below lets the walk run
+        std::vector<Key> keys;
+        Node<Key,Value>* curr = (lo != NULL) ? this->internalLowerBound(*lo) : this->getSmallestNode();
+        for( ; curr != NULL && (hi == NULL || curr->getKey() < *hi);
+            curr = BinarySearchTree<Key, Value>::successor(curr)) {
+            if(!alreadyWritten(curr->getKey())) {
+                keys.push_back(curr->getKey());
+            }
+        }
+        for(size_t i = 0; i < keys.size(); ++i) {
+            savePreimage(keys[i], lock);
+        }
+    }
+    Tree::eraseKeys(lo, hi);
+}
+
+// helper - merging this tree into another empties it; let the walk finish first
+template<class Key, class Value, class Tree>
+Node<Key,Value>* CheckpointedTree<Key, Value, Tree>::releaseNodes()
+{
+    if(worker_.joinable()) {
+        worker_.join();
+    }
+    return Tree::releaseNodes();
+}
+
+// helper - relinked nodes would bypass the pre-images, so insert them one by one
+template<class Key, class Value, class Tree>
+void CheckpointedTree<Key, Value, Tree>::absorbNodes(Node<Key,Value>* root, const BinarySearchTree<Key, Value>& source)
+{
+    if(checkpointRunning()) {
+        this->absorbByInsert(root);
+    }
+    else {
+        Tree::absorbNodes(root, source);
+    }
+}
+
+/**
+* Keeps the first pre-image of each key ahead of the walk. When maxPreimages
+* are already held the writer waits, unlocked, for the walk to drop some.
+*/
+template<class Key, class Value, class Tree>
+void CheckpointedTree<Key, Value, Tree>::savePreimage(const Key& key, std::unique_lock<std::recursive_mutex>& lock)
+{
+    while(active_ && !alreadyWritten(key) && preimages_.find(key) == preimages_.end()) {
+        if(preimages_.size() < maxPreimages_) {
+            Node<Key,Value>* node = this->internalFind(key);
+            if(node != NULL) {
+                preimages_.insert(std::make_pair(key, Preimage(true, node->getValue())));
+            }
+            else {
+                preimages_.insert(std::make_pair(key, Preimage(false, Value())));
+            }
+            if(preimages_.size() > stats_.peakPreimages) {
+                stats_.peakPreimages = preimages_.size();
+            }
+            return;
+        }
+        room_.wait(lock);
+    }
+}
+
+template<class Key, class Value, class Tree>
+bool CheckpointedTree<Key, Value, Tree>::alreadyWritten(const Key& key) const
+{
+    return started_ && !(cursor_ < key);
+}
+
+/**
+* Streams the snapshot: copy a chunk under the lock, write it without the lock.
+* The item count in the header is filled in at the end.
+*/
+template<class Key, class Value, class Tree>
+void CheckpointedTree<Key, Value, Tree>::runCheckpoint(std::string path)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::string tmpPath = path + ".tmp";
+    std::string error;
+    size_t items = 0;
+    size_t bytes = 0;
+
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        error = "cannot open " + tmpPath + ": " + std::strerror(errno);
+    }
+
+    std::string buf("AVLCKPT1", 8);
+    WalCodec<uint64_t>::encode(0, buf);
+    bool more = true;
+    while(more) {
+        more = copyChunk(buf, items);
+        room_.notify_all();
+
+        if(error.empty()) {
+            ssize_t put = 0;
+            for(size_t done = 0; done < buf.size(); done += put) {
+                put = write(fd, buf.data() + done, buf.size() - done);
+                if(put < 0) {
+                    if(errno == EINTR) { put = 0; continue; }
+                    error = "cannot write " + tmpPath + ": " + std::strerror(errno);
+                    break;
+                }
+            }
+        }
+        bytes += buf.size();
+        buf.clear();
+    }
+
+    if(error.empty()) {
+        std::string count;
+        WalCodec<uint64_t>::encode(items, count);
+        if(pwrite(fd, count.data(), count.size(), 8) != (ssize_t)count.size() || fsync(fd) != 0) {
+            error = "cannot finish " + tmpPath + ": " + std::strerror(errno);
+        }
+    }
+    if(fd >= 0) {
+        close(fd);
+    }
+    if(error.empty() && rename(tmpPath.c_str(), path.c_str()) != 0) {
+        error = "cannot rename " + tmpPath + ": " + std::strerror(errno);
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    active_ = false;
+    preimages_.clear();
+    room_.notify_all();
+
+    stats_.items = items;
+    stats_.bytes = bytes;
+    stats_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t total = 0;
+    for(size_t i = 0; i < latencyBuckets_.size(); ++i) {
+        total += latencyBuckets_[i];
+    }
+    stats_.writerOps = total;
+    stats_.writerP50Ns = percentile(latencyBuckets_, total, 0.50);
+    stats_.writerP99Ns = percentile(latencyBuckets_, total, 0.99);
+    error_ = error;
+}
+
+/**
+* Advances the walk by up to chunkSize keys, merging the live tree with the
+* pre-images in key order. A key with a pre-image was written to after the
+* checkpoint started, so the pre-image wins (and an absent pre-image means
+* the key did not exist yet); a removed key survives only as a pre-image.
+*/
+template<class Key, class Value, class Tree>
+bool CheckpointedTree<Key, Value, Tree>::copyChunk(std::string& buf, size_t& items)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    // resume just after the last key written
+    Node<Key,Value>* node = NULL;
+    typename std::map<Key, Preimage>::iterator pre = preimages_.begin();
+    if(started_) {
+        node = this->internalLowerBound(cursor_);
+        if(node != NULL && !(cursor_ < node->getKey())) {
+            node = BinarySearchTree<Key, Value>::successor(node);
+        }
+        pre = preimages_.upper_bound(cursor_);
+    }
+    else {
+        node = this->getSmallestNode();
+    }
+
+    for(size_t step = 0; step < chunkSize_; ++step) {
+        if(node == NULL && pre == preimages_.end()) {
+            return false;
+        }
+
+        bool usePre = (node == NULL) || (pre != preimages_.end() && !(node->getKey() < pre->first));
+        if(usePre) {
+            // the live node, if it has the same key, is newer than the snapshot
+            if(node != NULL && !(pre->first < node->getKey())) {
+                node = BinarySearchTree<Key, Value>::successor(node);
+            }
+            cursor_ = pre->first;
+            if(pre->second.first) {
+                WalCodec<Key>::encode(pre->first, buf);
+                WalCodec<Value>::encode(pre->second.second, buf);
+                ++items;
+            }
+            preimages_.erase(pre++);
+        }
+        else {
+            cursor_ = node->getKey();
+            WalCodec<Key>::encode(node->getKey(), buf);
+            WalCodec<Value>::encode(node->getValue(), buf);
+            ++items;
+            node = BinarySearchTree<Key, Value>::successor(node);
+        }
+        started_ = true;
+    }
+    return node != NULL || pre != preimages_.end();
+}
+
+// helper - called with the lock held
+template<class Key, class Value, class Tree>
+void CheckpointedTree<Key, Value, Tree>::recordLatency(std::chrono::steady_clock::time_point start)
+{
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    size_t bucket = 0;
+    while(bucket + 1 < latencyBuckets_.size() && ((uint64_t)1 << bucket) <= ns) {
+        ++bucket;
+    }
+    ++latencyBuckets_[bucket];
+    if(ns > stats_.writerMaxNs) {
+        stats_.writerMaxNs = ns;
+    }
+}
+
+template<class Key, class Value, class Tree>
+uint64_t CheckpointedTree<Key, Value, Tree>::percentile(const std::vector<size_t>& buckets, size_t total,
+                                                        double fraction)
+{
+    if(total == 0) { return 0; }
+    size_t rank = (size_t)(fraction * (double)(total - 1));
+    size_t seen = 0;
+    for(size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if(seen > rank) {
+            return (uint64_t)1 << i;
+        }
+    }
+    return (uint64_t)1 << (buckets.size() - 1);
+}
+
+/*
+--------------------------------------------
+End implementations for the CheckpointedTree class.
+--------------------------------------------
+*/
+
+#endif
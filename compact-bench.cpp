@@ -0,0 +1,107 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <unistd.h>
+#include <malloc.h>
+#include "bst.h"
+#include "avlbst.h"
+#include "rbbst.h"
+#include "compactavl.h"
+#include "pathavl.h"
+
+using namespace std;
+
+// Usage: ./compact-bench [numKeys] [numLookups]
+//
+// Loads numKeys random <uint64_t, uint64_t> pairs into a CompactAVLTree, a
+// PathAVLTree and a pointer-based AVLTree, and reports resident memory per
+// entry and random lookup time.
+
+typedef chrono::steady_clock Clock;
+
+// resident set size of this process in bytes
+size_t residentBytes()
+{
+    ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+template<typename Tree>
+void measure(const char* name, const vector<uint64_t>& keys, const vector<uint64_t>& lookups, Tree& tree)
+{
+    size_t before = residentBytes();
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(make_pair(keys[i], (uint64_t)i));
+    }
+    size_t after = residentBytes();
+
+    size_t found = 0;
+    Clock::time_point start = Clock::now();
+    for(size_t i = 0; i < lookups.size(); ++i) {
+        if(tree.find(lookups[i]) != tree.end()) {
+            ++found;
+        }
+    }
+    Clock::time_point stop = Clock::now();
+
+    cout << left << setw(16) << name << right << fixed << setprecision(1)
+         << setw(14) << (double)(after - before) / keys.size()
+         << setw(16) << chrono::duration<double, nano>(stop - start).count() / lookups.size()
+         << setw(10) << found << endl;
+}
+
+// give freed nodes back to the OS so the next tree's RSS growth is not hidden
+// by reused heap pages
+void releaseFreedMemory()
+{
+    malloc_trim(0);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t numKeys = 1000000;
+    size_t numLookups = 1000000;
+    if(argc > 1) { numKeys = strtoul(argv[1], NULL, 10); }
+    if(argc > 2) { numLookups = strtoul(argv[2], NULL, 10); }
+
+    mt19937_64 gen(290);
+    vector<uint64_t> keys(numKeys);
+    for(size_t i = 0; i < numKeys; ++i) {
+        keys[i] = gen();
+    }
+    vector<uint64_t> lookups(numLookups);
+    for(size_t i = 0; i < numLookups; ++i) {
+        // half hits, half (almost surely) misses
+        lookups[i] = (i % 2) ? keys[gen() % numKeys] : gen();
+    }
+
+    cout << "entries: " << numKeys << ", lookups: " << numLookups << endl;
+    cout << "sizeof(AVLNode<uint64_t,uint64_t>) = " << sizeof(AVLNode<uint64_t, uint64_t>)
+         << ", sizeof(RBNode<uint64_t,uint64_t>) = " << sizeof(RBNode<uint64_t, uint64_t>) << endl;
+    cout << left << setw(16) << "tree" << right << setw(14) << "RSS B/entry"
+         << setw(16) << "ns/lookup" << setw(10) << "found" << endl;
+
+    {
+        CompactAVLTree<uint64_t, uint64_t> compact;
+        compact.reserve(numKeys);
+        measure("CompactAVLTree", keys, lookups, compact);
+    }
+    releaseFreedMemory();
+    {
+        PathAVLTree<uint64_t, uint64_t> pathTree;
+        measure("PathAVLTree", keys, lookups, pathTree);
+    }
+    releaseFreedMemory();
+    {
+        AVLTree<uint64_t, uint64_t> pointerTree;
+        measure("AVLTree", keys, lookups, pointerTree);
+    }
+
+    return 0;
+}
@@ -0,0 +1,661 @@
+#ifndef COMPACTAVL_H
+#define COMPACTAVL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+* A compact AVL tree. All nodes live in one contiguous pool and link to each other
+* with 32-bit indices instead of pointers, and the balance factor is packed into the
+* two spare bits of the parent index. Nodes have no vptr and no malloc header, so a
+* <uint64_t, uint64_t> node is 32 bytes instead of the 56 bytes of an AVLNode plus
+* allocator overhead.
+*
+* The pool stays dense: remove moves the last node into the freed slot. Like a
+* std::vector, insert and remove may therefore invalidate iterators and references.
+* The tree holds at most 2^30 - 1 nodes.
+*/
+template <class Key, class Value>
+class CompactAVLTree
+{
+public:
+    CompactAVLTree();
+    ~CompactAVLTree();
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool isBalanced() const;
+    bool empty() const;
+    size_t size() const;
+
+    // preallocate room for n nodes so that loading a tree of known size never
+    // leaves the pool with unused capacity
+    void reserve(size_t n);
+
+    // bytes held by the node pool (capacity, not just the nodes in use)
+    size_t memoryUsage() const;
+
+private:
+    static const uint32_t NIL = 0x3FFFFFFF;     // 30-bit "no node" index
+    static const uint32_t INDEX_MASK = 0x3FFFFFFF;
+
+    struct CompactNode
+    {
+        std::pair<const Key, Value> item;
+        uint32_t left;
+        uint32_t right;
+        uint32_t parentBits;    // low 30 bits: parent index, high 2 bits: balance + 1
+
+        CompactNode(const Key& key, const Value& value, uint32_t parent) :
+            item(key, value), left(NIL), right(NIL), parentBits(parent | (1u << 30))
+        {
+
+        }
+    };
+
+public:
+    /**
+    * An in-order iterator holding a node index.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key,Value>& operator*() const;
+        std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class CompactAVLTree<Key, Value>;
+        iterator(CompactAVLTree<Key, Value>* tree, uint32_t index);
+        CompactAVLTree<Key, Value>* tree_;
+        uint32_t index_;
+    };
+
+public:
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+private:
+    // access a node by its pool index
+    CompactNode& node(uint32_t i);
+    const CompactNode& node(uint32_t i) const;
+
+    // packed field accessors
+    uint32_t getParent(uint32_t i) const;
+    void setParent(uint32_t i, uint32_t parent);
+    int getBalance(uint32_t i) const;
+    void setBalance(uint32_t i, int balance);
+
+    uint32_t internalFind(const Key& key) const;
+    uint32_t successor(uint32_t i) const;
+
+    // point parent's link (or the root) that referenced oldChild at newChild
+    void replaceChild(uint32_t parent, uint32_t oldChild, uint32_t newChild);
+
+    // rotations only relink; rotateFix sets the balances afterwards
+    void rotateL(uint32_t x);
+    void rotateR(uint32_t z);
+
+    // fix node i whose balance would be +-2 (passed in as b, since the packed
+    // field cannot hold it); returns the new subtree root
+    uint32_t rotateFix(uint32_t i, int b);
+
+    // walk up from a subtree that grew / shrank, updating balances
+    void retraceInsert(uint32_t child);
+    void retraceRemove(uint32_t parent, bool leftShrank);
+
+    // move the last pool slot into the freed slot so the pool stays dense
+    void fillHole(uint32_t hole);
+
+    // recursive helper for isBalanced: height of subtree or -1 if not balanced
+    int checkHeight(uint32_t i) const;
+
+    std::vector<CompactNode> pool_;
+    uint32_t root_;
+};
+
+/*
+-----------------------------------------------------
+Begin implementations for the CompactAVLTree::iterator class.
+-----------------------------------------------------
+*/
+
+template<class Key, class Value>
+CompactAVLTree<Key, Value>::iterator::iterator()
+    : tree_(NULL), index_(NIL)
+{
+
+}
+
+template<class Key, class Value>
+CompactAVLTree<Key, Value>::iterator::iterator(CompactAVLTree<Key, Value>* tree, uint32_t index)
+    : tree_(tree), index_(index)
+{
+
+}
+
+template<class Key, class Value>
+std::pair<const Key,Value>&
+CompactAVLTree<Key, Value>::iterator::operator*() const
+{
+    return tree_->node(index_).item;
+}
+
+template<class Key, class Value>
+std::pair<const Key,Value>*
+CompactAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(tree_->node(index_).item);
+}
+
+template<class Key, class Value>
+bool CompactAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return index_ == rhs.index_;
+}
+
+template<class Key, class Value>
+bool CompactAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return index_ != rhs.index_;
+}
+
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator&
+CompactAVLTree<Key, Value>::iterator::operator++()
+{
+    index_ = tree_->successor(index_);
+    return *this;
+}
+
+/*
+---------------------------------------------------
+End implementations for the CompactAVLTree::iterator class.
+---------------------------------------------------
+*/
+
+/*
+-------------------------------------------------
+Begin implementations for the CompactAVLTree class.
+-------------------------------------------------
+*/
+
+template<class Key, class Value>
+CompactAVLTree<Key, Value>::CompactAVLTree()
+    : root_(NIL)
+{
+
+}
+
+template<class Key, class Value>
+CompactAVLTree<Key, Value>::~CompactAVLTree()
+{
+
+}
+
+template<class Key, class Value>
+bool CompactAVLTree<Key, Value>::empty() const
+{
+    return root_ == NIL;
+}
+
+template<class Key, class Value>
+size_t CompactAVLTree<Key, Value>::size() const
+{
+    return pool_.size();
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::reserve(size_t n)
+{
+    pool_.reserve(n);
+}
+
+template<class Key, class Value>
+size_t CompactAVLTree<Key, Value>::memoryUsage() const
+{
+    return pool_.capacity() * sizeof(CompactNode);
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::clear()
+{
+    pool_.clear();
+    root_ = NIL;
+}
+
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator
+CompactAVLTree<Key, Value>::begin() const
+{
+    uint32_t curr = root_;
+    if(curr != NIL) {
+        while(node(curr).left != NIL) {
+            curr = node(curr).left;
+        }
+    }
+    return iterator(const_cast<CompactAVLTree<Key, Value>*>(this), curr);
+}
+
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator
+CompactAVLTree<Key, Value>::end() const
+{
+    return iterator(const_cast<CompactAVLTree<Key, Value>*>(this), NIL);
+}
+
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator
+CompactAVLTree<Key, Value>::find(const Key& key) const
+{
+    return iterator(const_cast<CompactAVLTree<Key, Value>*>(this), internalFind(key));
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value>
+Value& CompactAVLTree<Key, Value>::operator[](const Key& key)
+{
+    uint32_t curr = internalFind(key);
+    if(curr == NIL) throw std::out_of_range("Invalid key");
+    return node(curr).item.second;
+}
+template<class Key, class Value>
+Value const & CompactAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    uint32_t curr = internalFind(key);
+    if(curr == NIL) throw std::out_of_range("Invalid key");
+    return node(curr).item.second;
+}
+
+/*
+ * If key is already in the tree, the current value is overwritten.
+ */
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    uint32_t curr = root_;
+    uint32_t parent = NIL;
+    bool goLeft = false;
+
+    // find the insertion point
+    while(curr != NIL) {
+        parent = curr;
+        const Key& currKey = node(curr).item.first;
+        if(keyValuePair.first == currKey) {
+            node(curr).item.second = keyValuePair.second;
+            return;
+        }
+        goLeft = keyValuePair.first < currKey;
+        curr = goLeft ? node(curr).left : node(curr).right;
+    }
+
+    if(pool_.size() >= NIL) {
+        throw std::length_error("CompactAVLTree is full");
+    }
+
+    // append the new node to the pool (may reallocate, so link afterwards by index)
+    uint32_t newIndex = (uint32_t)pool_.size();
+    pool_.push_back(CompactNode(keyValuePair.first, keyValuePair.second, parent));
+
+    if(parent == NIL) {
+        root_ = newIndex;
+        return;
+    }
+    if(goLeft) {
+        node(parent).left = newIndex;
+    }
+    else {
+        node(parent).right = newIndex;
+    }
+    retraceInsert(newIndex);
+}
+
+/*
+ * A node with 2 children is replaced by its predecessor, matching the other trees.
+ */
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::remove(const Key& key)
+{
+    uint32_t z = internalFind(key);
+    if(z == NIL) { return; }
+
+    uint32_t retraceFrom;
+    bool leftShrank;
+
+    if(node(z).left != NIL && node(z).right != NIL) {
+        // predecessor y: rightmost node of z's left subtree (has no right child)
+        uint32_t y = node(z).left;
+        while(node(y).right != NIL) {
+            y = node(y).right;
+        }
+
+        if(y == node(z).left) {
+            // y is z's left child and keeps its own left subtree, which is one
+            // shorter than the subtree z had on that side
+            retraceFrom = y;
+            leftShrank = true;
+        }
+        else {
+            // unlink y, its left child moves up into y's old spot
+            uint32_t yp = getParent(y);
+            uint32_t yl = node(y).left;
+            node(yp).right = yl;
+            if(yl != NIL) { setParent(yl, yp); }
+
+            node(y).left = node(z).left;
+            setParent(node(y).left, y);
+            retraceFrom = yp;
+            leftShrank = false;
+        }
+
+        // y takes z's place, right subtree, and balance
+        uint32_t zp = getParent(z);
+        node(y).right = node(z).right;
+        setParent(node(y).right, y);
+        setParent(y, zp);
+        setBalance(y, getBalance(z));
+        replaceChild(zp, z, y);
+    }
+    else {
+        // 0 or 1 child: splice the child into z's place
+        uint32_t child = node(z).left != NIL ? node(z).left : node(z).right;
+        uint32_t zp = getParent(z);
+        if(child != NIL) { setParent(child, zp); }
+        leftShrank = (zp != NIL && node(zp).left == z);
+        replaceChild(zp, z, child);
+        retraceFrom = zp;
+    }
+
+    if(retraceFrom != NIL) {
+        retraceRemove(retraceFrom, leftShrank);
+    }
+
+    // retrace never touches z, so its slot can be reused now
+    fillHole(z);
+}
+
+/**
+ * Return true iff every node's subtrees differ in height by at most 1.
+ */
+template<class Key, class Value>
+bool CompactAVLTree<Key, Value>::isBalanced() const
+{
+    return checkHeight(root_) >= 0;
+}
+
+template<class Key, class Value>
+int CompactAVLTree<Key, Value>::checkHeight(uint32_t i) const
+{
+    if(i == NIL) { return 0; }
+    int leftH = checkHeight(node(i).left);
+    int rightH = checkHeight(node(i).right);
+    if(leftH < 0 || rightH < 0) { return -1; }
+    int diff = leftH - rightH;
+    if(diff > 1 || diff < -1) { return -1; }
+    return (leftH > rightH ? leftH : rightH) + 1;
+}
+
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::CompactNode&
+CompactAVLTree<Key, Value>::node(uint32_t i)
+{
+    return pool_[i];
+}
+
+template<class Key, class Value>
+const typename CompactAVLTree<Key, Value>::CompactNode&
+CompactAVLTree<Key, Value>::node(uint32_t i) const
+{
+    return pool_[i];
+}
+
+template<class Key, class Value>
+uint32_t CompactAVLTree<Key, Value>::getParent(uint32_t i) const
+{
+    return node(i).parentBits & INDEX_MASK;
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::setParent(uint32_t i, uint32_t parent)
+{
+    node(i).parentBits = (node(i).parentBits & ~INDEX_MASK) | parent;
+}
+
+template<class Key, class Value>
+int CompactAVLTree<Key, Value>::getBalance(uint32_t i) const
+{
+    return (int)(node(i).parentBits >> 30) - 1;
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::setBalance(uint32_t i, int balance)
+{
+    node(i).parentBits = (node(i).parentBits & INDEX_MASK) | ((uint32_t)(balance + 1) << 30);
+}
+
+template<class Key, class Value>
+uint32_t CompactAVLTree<Key, Value>::internalFind(const Key& key) const
+{
+    uint32_t curr = root_;
+    while(curr != NIL) {
+        const Key& currKey = node(curr).item.first;
+        if(key == currKey) {
+            return curr;
+        }
+        curr = (key < currKey) ? node(curr).left : node(curr).right;
+    }
+    return NIL;
+}
+
+template<class Key, class Value>
+uint32_t CompactAVLTree<Key, Value>::successor(uint32_t curr) const
+{
+    if(curr == NIL) { return NIL; }
+
+    // case 1: right child exists - go down right, then all the way left
+    if(node(curr).right != NIL) {
+        curr = node(curr).right;
+        while(node(curr).left != NIL) {
+            curr = node(curr).left;
+        }
+        return curr;
+    }
+
+    // case 2: go up until we come from a left child
+    uint32_t parent = getParent(curr);
+    while(parent != NIL && curr == node(parent).right) {
+        curr = parent;
+        parent = getParent(parent);
+    }
+    return parent;
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::replaceChild(uint32_t parent, uint32_t oldChild, uint32_t newChild)
+{
+    if(parent == NIL) {
+        root_ = newChild;
+    }
+    else if(node(parent).left == oldChild) {
+        node(parent).left = newChild;
+    }
+    else {
+        node(parent).right = newChild;
+    }
+}
+
+// helper - single left rotation, x's right child y takes x's place
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::rotateL(uint32_t x)
+{
+    uint32_t y = node(x).right;
+    uint32_t p = getParent(x);
+
+    node(x).right = node(y).left;
+    if(node(x).right != NIL) { setParent(node(x).right, x); }
+    node(y).left = x;
+    setParent(y, p);
+    setParent(x, y);
+    replaceChild(p, x, y);
+}
+
+// helper - single right rotation, z's left child y takes z's place
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::rotateR(uint32_t z)
+{
+    uint32_t y = node(z).left;
+    uint32_t p = getParent(z);
+
+    node(z).left = node(y).right;
+    if(node(z).left != NIL) { setParent(node(z).left, z); }
+    node(y).right = z;
+    setParent(y, p);
+    setParent(z, y);
+    replaceChild(p, z, y);
+}
+
+// helper - single or double rotation at i; balances follow the standard AVL cases
+template<class Key, class Value>
+uint32_t CompactAVLTree<Key, Value>::rotateFix(uint32_t i, int b)
+{
+    // left-heavy
+    if(b > 0) {
+        uint32_t l = node(i).left;
+        int lb = getBalance(l);
+        // case 1: left-left (lb == 0 only happens on remove)
+        if(lb >= 0) {
+            rotateR(i);
+            setBalance(i, lb == 0 ? 1 : 0);
+            setBalance(l, lb == 0 ? -1 : 0);
+            return l;
+        }
+        // case 2: left-right
+        uint32_t g = node(l).right;
+        int gb = getBalance(g);
+        rotateL(l);
+        rotateR(i);
+        setBalance(l, gb == -1 ? 1 : 0);
+        setBalance(i, gb == 1 ? -1 : 0);
+        setBalance(g, 0);
+        return g;
+    }
+
+    // right-heavy
+    uint32_t r = node(i).right;
+    int rb = getBalance(r);
+    // case 3: right-right
+    if(rb <= 0) {
+        rotateL(i);
+        setBalance(i, rb == 0 ? -1 : 0);
+        setBalance(r, rb == 0 ? 1 : 0);
+        return r;
+    }
+    // case 4: right-left
+    uint32_t g = node(r).left;
+    int gb = getBalance(g);
+    rotateR(r);
+    rotateL(i);
+    setBalance(r, gb == 1 ? -1 : 0);
+    setBalance(i, gb == -1 ? 1 : 0);
+    setBalance(g, 0);
+    return g;
+}
+
+// The 2-bit balance field can only hold -1..1, so the +-2 intermediate state is
+// never stored: the rotation is chosen from the old balance instead.
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::retraceInsert(uint32_t child)
+{
+    uint32_t parent = getParent(child);
+    while(parent != NIL) {
+        int b = getBalance(parent) + (node(parent).left == child ? 1 : -1);
+        if(b == 0) {
+            setBalance(parent, 0);
+            return;
+        }
+        if(b == 1 || b == -1) {
+            setBalance(parent, b);
+            child = parent;
+            parent = getParent(parent);
+            continue;
+        }
+        // +-2: one (single or double) rotation restores the old height
+        rotateFix(parent, b);
+        return;
+    }
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::retraceRemove(uint32_t parent, bool leftShrank)
+{
+    while(parent != NIL) {
+        int b = getBalance(parent) + (leftShrank ? -1 : 1);
+        uint32_t subtree = parent;
+        if(b == 1 || b == -1) {
+            // height unchanged
+            setBalance(parent, b);
+            return;
+        }
+        if(b == 0) {
+            setBalance(parent, 0);
+        }
+        else {
+            subtree = rotateFix(parent, b);
+            // a rotation that leaves the new root leaning keeps the old height
+            if(getBalance(subtree) != 0) {
+                return;
+            }
+        }
+        // subtree got shorter, keep going up
+        uint32_t up = getParent(subtree);
+        if(up != NIL) {
+            leftShrank = (node(up).left == subtree);
+        }
+        parent = up;
+    }
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::fillHole(uint32_t hole)
+{
+    uint32_t last = (uint32_t)pool_.size() - 1;
+    if(hole != last) {
+        // relink everything that points at the last slot
+        CompactNode& moved = node(last);
+        uint32_t p = moved.parentBits & INDEX_MASK;
+        replaceChild(p, last, hole);
+        if(moved.left != NIL) { setParent(moved.left, hole); }
+        if(moved.right != NIL) { setParent(moved.right, hole); }
+
+        // rebuild the slot in place since the key is const
+        pool_[hole].~CompactNode();
+        new (&pool_[hole]) CompactNode(moved);
+    }
+    pool_.pop_back();
+}
+
+/*
+-----------------------------------------------
+End implementations for the CompactAVLTree class.
+-----------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,674 @@
+#ifndef DURABLEAVL_H
+#define DURABLEAVL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "avlbst.h"
+
+/**
+* Byte encoding of keys and values for the write-ahead log and checkpoints.
+* The default copies the object's bytes, which is right for plain arithmetic
+* and POD types. Specialize it for anything that owns memory; std::string is
+* provided.
+*
+* decode() reads one object starting at p, advances p past it, and returns
+* false if [p, end) is too short.
+*/
+template <typename T>
+struct WalCodec
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "WalCodec must be specialized for types that are not trivially copyable");
+
+    static void encode(const T& item, std::string& out)
+    {
+        out.append(reinterpret_cast<const char*>(&item), sizeof(T));
+    }
+    static bool decode(const char*& p, const char* end, T& item)
+    {
+        if((size_t)(end - p) < sizeof(T)) { return false; }
+        std::memcpy(&item, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+};
+
+template <>
+struct WalCodec<std::string>
+{
+    static void encode(const std::string& item, std::string& out)
+    {
+        uint32_t len = (uint32_t)item.size();
+        WalCodec<uint32_t>::encode(len, out);
+        out.append(item);
+    }
+    static bool decode(const char*& p, const char* end, std::string& item)
+    {
+        uint32_t len = 0;
+        if(!WalCodec<uint32_t>::decode(p, end, len) || (size_t)(end - p) < len) { return false; }
+        item.assign(p, len);
+        p += len;
+        return true;
+    }
+};
+
+/**
+* When the write-ahead log reaches the disk:
+*   WAL_SYNC_EVERY  write and fsync after every operation
+*   WAL_SYNC_GROUP  buffer operations and write + fsync them as one group once
+*                   groupSize have accumulated (group commit)
+*   WAL_SYNC_NONE   write in large batches and leave flushing to the OS
+* In every mode sync() commits whatever is buffered, and checkpoint() and the
+* destructor do so too. An operation is durable once a commit has fsynced it.
+*/
+enum WalSyncPolicy
+{
+    WAL_SYNC_EVERY,
+    WAL_SYNC_GROUP,
+    WAL_SYNC_NONE
+};
+
+/**
+* An AVLTree whose contents survive a crash. It keeps two files in dir:
+*   checkpoint  the full map at some moment, sorted, written atomically
+*   wal         every change since that checkpoint, one record per operation
+* The constructor recovers by loading the checkpoint and replaying the log.
+* A torn record at the end of the log (a crash mid-write) fails its checksum
+* and is cut off.
+*
+* Log records are blind writes (set a key, drop a key or a range), so
+* replaying a log prefix that the checkpoint already contains is harmless.
+* That makes checkpoint() crash-safe at every step.
+*
+* Every key that insert(), update() or the base operator[] creates, and every
+* value insert() or update() leaves, is logged as an insert from the
+* findOrCreate() and valueChanged() hooks, so the base-class calls are logged
+* too. A write through a returned reference cannot be: operator[] and at()
+* are read-only here, and through a BinarySearchTree& operator[] only logs
+* the Value() it inserts.
+*/
+template <class Key, class Value>
+class DurableAVLTree : public AVLTree<Key, Value>
+{
+public:
+    // opens (creating if needed) the map stored in dir and recovers it
+    explicit DurableAVLTree(const std::string& dir, WalSyncPolicy policy = WAL_SYNC_GROUP,
+                            size_t groupSize = 64);
+    virtual ~DurableAVLTree();
+
+    virtual void remove(const Key& key);
+    void clear();
+
+    Value const & operator[](const Key& key) const;
+    Value const & at(const Key& key) const;
+
+    // commit every buffered log record and fsync the log
+    void sync();
+    // write the whole map to a new checkpoint and empty the log, O(n)
+    void checkpoint();
+
+    // fsyncs issued so far, to compare against the number of operations
+    size_t syncCount() const;
+    // log records replayed by the constructor
+    size_t recoveredRecords() const;
+
+protected:
+    enum WalOp
+    {
+        OP_INSERT = 1,
+        OP_REMOVE = 2,
+        OP_ERASE_RANGE = 3,
+        OP_CLEAR = 4
+    };
+
+    // insert(), update() and operator[] are logged from these: a created key
+    // and a changed value are both logged as an insert of the node's item
+    virtual Node<Key,Value>* findOrCreate(const Key& key, const Value& value, bool& created);
+    virtual void valueChanged(Node<Key,Value>* node);
+    void logInsert(const Key& key, const Value& value);
+
+    // range erase and merge (on either side) go through the log too
+    virtual void eraseKeys(const Key* lo, const Key* hi);
+    // erase_if: one logged remove per match
+    virtual void eraseMatching(const typename BinarySearchTree<Key, Value>::ItemPredicate& pred);
+    virtual Node<Key,Value>* releaseNodes();
+    virtual void absorbNodes(Node<Key,Value>* root, const BinarySearchTree<Key, Value>& source);
+
+    // recovery
+    void loadCheckpoint();
+    void replayLog();
+    // apply one record's payload without logging it; false if it is malformed
+    bool applyRecord(const char* p, const char* end);
+
+    // log a record payload: frame it, buffer it, and commit if the policy says so
+    void logRecord(const std::string& payload);
+    // write the buffered records, then fsync if asked
+    void commit(bool doSync);
+    // cut the log back to the end of the last complete write
+    void rewindLog();
+
+    std::string path(const char* name) const;
+    static void writeAll(int fd, const char* data, size_t len);
+    // writeAll of buf to the open checkpoint.tmp, then empties buf; closes fd
+    // before letting a write error out
+    static void writeTmp(int fd, std::string& buf, const std::string& tmpPath);
+    static void throwErrno(const std::string& what);
+    static uint32_t crc32(const char* data, size_t len);
+    static std::vector<uint32_t> crcTable();
+
+    std::string dir_;
+    WalSyncPolicy policy_;
+    size_t groupSize_;
+    int walFd_;
+    off_t walEnd_;          // log length after the last complete write
+    bool walTorn_;          // a write failed and rewindLog() has not yet succeeded
+
+    std::string pending_;   // framed records not yet written
+    size_t pendingOps_;
+    size_t syncs_;
+    size_t recovered_;
+
+    // a record is [u32 payload length][u32 crc32 of payload][payload]
+    static const size_t FRAME_HEADER = 8;
+    // WAL_SYNC_NONE writes once this much is buffered
+    static const size_t WRITE_BATCH_BYTES = 64 * 1024;
+};
+
+/*
+----------------------------------------------
+Begin implementations for the DurableAVLTree class.
+----------------------------------------------
+*/
+
+template<class Key, class Value>
+DurableAVLTree<Key, Value>::DurableAVLTree(const std::string& dir, WalSyncPolicy policy, size_t groupSize)
+    : dir_(dir), policy_(policy), groupSize_(groupSize == 0 ? 1 : groupSize), walFd_(-1),
+      walEnd_(0), walTorn_(false), pendingOps_(0), syncs_(0), recovered_(0)
+{
+    if(mkdir(dir_.c_str(), 0755) != 0 && errno != EEXIST) {
+        throwErrno("cannot create " + dir_);
+    }
+
+    loadCheckpoint();
+
+    walFd_ = open(path("wal").c_str(), O_RDWR | O_CREAT, 0644);
+    if(walFd_ < 0) {
+        throwErrno("cannot open " + path("wal"));
+    }
+    replayLog();
+}
+
+/**
+* Commits anything still buffered. Errors cannot be reported from here; call
+* sync() first to see them.
+*/
+template<class Key, class Value>
+DurableAVLTree<Key, Value>::~DurableAVLTree()
+{
+    try {
+        commit(true);
+    }
+    catch(const std::exception&) {
+    }
+    close(walFd_);
+}
+
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::remove(const Key& key)
+{
+    if(this->internalFind(key) == NULL) { return; }
+    AVLTree<Key, Value>::remove(key);
+
+    std::string payload(1, (char)OP_REMOVE);
+    WalCodec<Key>::encode(key, payload);
+    logRecord(payload);
+}
+
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::clear()
+{
+    BinarySearchTree<Key, Value>::clear();
+    logRecord(std::string(1, (char)OP_CLEAR));
+}
+
+// helper - the base version removes match by match, and remove() logs
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::eraseMatching(const typename BinarySearchTree<Key, Value>::ItemPredicate& pred)
+{
+    BinarySearchTree<Key, Value>::eraseMatching(pred);
+}
+
+template<class Key, class Value>
+Value const & DurableAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    return AVLTree<Key, Value>::operator[](key);
+}
+
+template<class Key, class Value>
+Value const & DurableAVLTree<Key, Value>::at(const Key& key) const
+{
+    return AVLTree<Key, Value>::at(key);
+}
+
+template<class Key, class Value>
+Node<Key,Value>* DurableAVLTree<Key, Value>::findOrCreate(const Key& key, const Value& value, bool& created)
+{
+    Node<Key,Value>* node = AVLTree<Key, Value>::findOrCreate(key, value, created);
+    if(created) {
+        logInsert(key, value);
+    }
+    return node;
+}
+
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::valueChanged(Node<Key,Value>* node)
+{
+    AVLTree<Key, Value>::valueChanged(node);
+    logInsert(node->getKey(), node->getValue());
+}
+
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::logInsert(const Key& key, const Value& value)
+{
+    std::string payload(1, (char)OP_INSERT);
+    WalCodec<Key>::encode(key, payload);
+    WalCodec<Value>::encode(value, payload);
+    logRecord(payload);
+}
+
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::sync()
+{
+    commit(true);
+}
+
+/**
+* Writes checkpoint.tmp, fsyncs it, renames it over checkpoint, and only then
+* empties the log. A crash before the rename leaves the old checkpoint and
+* log; a crash after it replays an already-applied log, which is harmless.
+* Buffered records are only dropped once the rename succeeded, so if the
+* checkpoint throws they are still committed by the next sync().
+*/
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::checkpoint()
+{
+    std::string tmpPath = path("checkpoint.tmp");
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        throwErrno("cannot open " + tmpPath);
+    }
+
+    // header: magic, then the item count
+    std::string buf("AVLCKPT1", 8);
+    uint64_t count = 0;
+    for(Node<Key,Value>* curr = this->getSmallestNode(); curr != NULL;
+        curr = BinarySearchTree<Key, Value>::successor(curr)) {
+        ++count;
+    }
+    WalCodec<uint64_t>::encode(count, buf);
+
+    for(Node<Key,Value>* curr = this->getSmallestNode(); curr != NULL;
+        curr = BinarySearchTree<Key, Value>::successor(curr)) {
+        WalCodec<Key>::encode(curr->getKey(), buf);
+        WalCodec<Value>::encode(curr->getValue(), buf);
+        if(buf.size() >= WRITE_BATCH_BYTES) {
+            writeTmp(fd, buf, tmpPath);
+        }
+    }
+    writeTmp(fd, buf, tmpPath);
+    if(fsync(fd) != 0) {
+        close(fd);
+        throwErrno("cannot fsync " + tmpPath);
+    }
+    close(fd);
+
+    if(rename(tmpPath.c_str(), path("checkpoint").c_str()) != 0) {
+        throwErrno("cannot rename " + tmpPath);
+    }
+    // the new checkpoint contains the buffered changes
+    pending_.clear();
+    pendingOps_ = 0;
+    // make the rename itself durable
+    int dirFd = open(dir_.c_str(), O_RDONLY);
+    if(dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+
+    if(ftruncate(walFd_, 0) != 0 || lseek(walFd_, 0, SEEK_SET) < 0 || fsync(walFd_) != 0) {
+        throwErrno("cannot reset " + path("wal"));
+    }
+    walEnd_ = 0;
+    walTorn_ = false;
+    ++syncs_;
+}
+
+template<class Key, class Value>
+size_t DurableAVLTree<Key, Value>::syncCount() const
+{
+    return syncs_;
+}
+
+template<class Key, class Value>
+size_t DurableAVLTree<Key, Value>::recoveredRecords() const
+{
+    return recovered_;
+}
+
+// helper - log the range, then let AVLTree split it out
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::eraseKeys(const Key* lo, const Key* hi)
+{
+    AVLTree<Key, Value>::eraseKeys(lo, hi);
+
+    std::string payload(1, (char)OP_ERASE_RANGE);
+    payload.push_back((char)((lo != NULL ? 1 : 0) | (hi != NULL ? 2 : 0)));
+    if(lo != NULL) { WalCodec<Key>::encode(*lo, payload); }
+    if(hi != NULL) { WalCodec<Key>::encode(*hi, payload); }
+    logRecord(payload);
+}
+
+// helper - a tree merged into another one is left empty, so log a clear
+template<class Key, class Value>
+Node<Key,Value>* DurableAVLTree<Key, Value>::releaseNodes()
+{
+    logRecord(std::string(1, (char)OP_CLEAR));
+    return AVLTree<Key, Value>::releaseNodes();
+}
+
+// helper - merged items are inserted (and so logged) one by one
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::absorbNodes(Node<Key,Value>* root, const BinarySearchTree<Key, Value>& source)
+{
+    (void)source;
+    this->absorbByInsert(root);
+}
+
+/**
+* Reads the checkpoint, which is sorted, and links its items straight into a
+* balanced tree in O(n).
+*/
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::loadCheckpoint()
+{
+    std::string data;
+    int fd = open(path("checkpoint").c_str(), O_RDONLY);
+    if(fd < 0) {
+        if(errno == ENOENT) { return; }
+        throwErrno("cannot open " + path("checkpoint"));
+    }
+    char chunk[64 * 1024];
+    ssize_t got = 0;
+    while((got = read(fd, chunk, sizeof(chunk))) > 0) {
+        data.append(chunk, got);
+    }
+    close(fd);
+    if(got < 0) {
+        throwErrno("cannot read " + path("checkpoint"));
+    }
+
+    const char* p = data.data();
+    const char* end = p + data.size();
+    uint64_t count = 0;
+    if(data.size() < 8 || data.compare(0, 8, "AVLCKPT1") != 0) {
+        throw std::runtime_error(path("checkpoint") + " is not a checkpoint");
+    }
+    p += 8;
+    if(!WalCodec<uint64_t>::decode(p, end, count)) {
+        throw std::runtime_error(path("checkpoint") + " is truncated");
+    }
+
+    std::vector<AVLNode<Key,Value>*> nodes;
+    nodes.reserve(count);
+    for(uint64_t i = 0; i < count; ++i) {
+        Key key;
+        Value value;
+        if(!WalCodec<Key>::decode(p, end, key) || !WalCodec<Value>::decode(p, end, value)) {
+            for(size_t j = 0; j < nodes.size(); ++j) { delete nodes[j]; }
+            throw std::runtime_error(path("checkpoint") + " is truncated");
+        }
+        nodes.push_back(this->createNode(key, value, NULL));
+    }
+
+    int height = 0;
+    this->root_ = this->buildBalanced(nodes, 0, nodes.size(), NULL, height);
+}
+
+/**
+* Replays every intact record. The first record that is short or fails its
+* checksum marks the end of the log: it and anything after it are cut off so
+* new records append cleanly.
+*/
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::replayLog()
+{
+    std::string data;
+    char chunk[64 * 1024];
+    ssize_t got = 0;
+    while((got = read(walFd_, chunk, sizeof(chunk))) > 0) {
+        data.append(chunk, got);
+    }
+    if(got < 0) {
+        throwErrno("cannot read " + path("wal"));
+    }
+
+    size_t offset = 0;
+    while(data.size() - offset >= FRAME_HEADER) {
+        const char* frame = data.data() + offset;
+        uint32_t len = 0;
+        uint32_t crc = 0;
+        std::memcpy(&len, frame, 4);
+        std::memcpy(&crc, frame + 4, 4);
+        if(data.size() - offset - FRAME_HEADER < len) { break; }
+
+        const char* payload = frame + FRAME_HEADER;
+        if(crc32(payload, len) != crc || !applyRecord(payload, payload + len)) { break; }
+
+        offset += FRAME_HEADER + len;
+        ++recovered_;
+    }
+
+    // drop a torn tail and leave the file offset at the end of the good part
+    if(offset != data.size() && ftruncate(walFd_, offset) != 0) {
+        throwErrno("cannot truncate " + path("wal"));
+    }
+    if(lseek(walFd_, offset, SEEK_SET) < 0) {
+        throwErrno("cannot seek " + path("wal"));
+    }
+    walEnd_ = (off_t)offset;
+}
+
+template<class Key, class Value>
+bool DurableAVLTree<Key, Value>::applyRecord(const char* p, const char* end)
+{
+    if(p == end) { return false; }
+    char op = *p++;
+
+    if(op == OP_INSERT) {
+        Key key;
+        Value value;
+        if(!WalCodec<Key>::decode(p, end, key) || !WalCodec<Value>::decode(p, end, value)) { return false; }
+        // the AVLTree hooks, which do not log
+        bool created = false;
+        Node<Key,Value>* node = AVLTree<Key, Value>::findOrCreate(key, value, created);
+        if(!created) {
+            node->setValue(value);
+            AVLTree<Key, Value>::valueChanged(node);
+        }
+    }
+    else if(op == OP_REMOVE) {
+        Key key;
+        if(!WalCodec<Key>::decode(p, end, key)) { return false; }
+        AVLTree<Key, Value>::remove(key);
+    }
+    else if(op == OP_ERASE_RANGE) {
+        if(p == end) { return false; }
+        char bounds = *p++;
+        Key lo;
+        Key hi;
+        if((bounds & 1) && !WalCodec<Key>::decode(p, end, lo)) { return false; }
+        if((bounds & 2) && !WalCodec<Key>::decode(p, end, hi)) { return false; }
+        AVLTree<Key, Value>::eraseKeys((bounds & 1) ? &lo : NULL, (bounds & 2) ? &hi : NULL);
+    }
+    else if(op == OP_CLEAR) {
+        BinarySearchTree<Key, Value>::clear();
+    }
+    else {
+        return false;
+    }
+    return p == end;
+}
+
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::logRecord(const std::string& payload)
+{
+    uint32_t len = (uint32_t)payload.size();
+    uint32_t crc = crc32(payload.data(), payload.size());
+    pending_.append(reinterpret_cast<const char*>(&len), 4);
+    pending_.append(reinterpret_cast<const char*>(&crc), 4);
+    pending_.append(payload);
+    ++pendingOps_;
+
+    if(policy_ == WAL_SYNC_EVERY) {
+        commit(true);
+    }
+    else if(policy_ == WAL_SYNC_GROUP && pendingOps_ >= groupSize_) {
+        commit(true);
+    }
+    else if(policy_ == WAL_SYNC_NONE && pending_.size() >= WRITE_BATCH_BYTES) {
+        commit(false);
+    }
+}
+
+/**
+* A write that fails part way leaves a torn record in the log. The log is cut
+* back to walEnd_ before the error goes out, and again before the next commit
+* if that cut failed too, so a retry writes all of pending_ after the last
+* complete record and replay never stops early at the torn bytes.
+*/
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::commit(bool doSync)
+{
+    if(pending_.empty()) { return; }
+
+    if(walTorn_) {
+        rewindLog();
+    }
+    try {
+        writeAll(walFd_, pending_.data(), pending_.size());
+    }
+    catch(const std::runtime_error&) {
+        walTorn_ = true;
+        try {
+            rewindLog();
+        }
+        catch(const std::runtime_error&) {
+            // still torn; the next commit tries again
+        }
+        throw;
+    }
+    walEnd_ += (off_t)pending_.size();
+    pending_.clear();
+    pendingOps_ = 0;
+    if(doSync) {
+        if(fdatasync(walFd_) != 0) {
+            throwErrno("cannot fsync " + path("wal"));
+        }
+        ++syncs_;
+    }
+}
+
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::rewindLog()
+{
+    if(ftruncate(walFd_, walEnd_) != 0 || lseek(walFd_, walEnd_, SEEK_SET) < 0) {
+        throwErrno("cannot truncate " + path("wal"));
+    }
+    walTorn_ = false;
+}
+
+template<class Key, class Value>
+std::string DurableAVLTree<Key, Value>::path(const char* name) const
+{
+    return dir_ + "/" + name;
+}
+
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::writeAll(int fd, const char* data, size_t len)
+{
+    while(len > 0) {
+        ssize_t put = write(fd, data, len);
+        if(put < 0) {
+            if(errno == EINTR) { continue; }
+            throwErrno("write failed");
+        }
+        data += put;
+        len -= put;
+    }
+}
+
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::writeTmp(int fd, std::string& buf, const std::string& tmpPath)
+{
+    try {
+        writeAll(fd, buf.data(), buf.size());
+    }
+    catch(const std::runtime_error& e) {
+        close(fd);
+        throw std::runtime_error(tmpPath + ": " + e.what());
+    }
+    buf.clear();
+}
+
+template<class Key, class Value>
+void DurableAVLTree<Key, Value>::throwErrno(const std::string& what)
+{
+    throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+// helper - standard CRC-32 (IEEE)
+template<class Key, class Value>
+uint32_t DurableAVLTree<Key, Value>::crc32(const char* data, size_t len)
+{
+    // built once; static initialization is thread-safe
+    static const std::vector<uint32_t> table = crcTable();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for(size_t i = 0; i < len; ++i) {
+        crc = table[(crc ^ (unsigned char)data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+template<class Key, class Value>
+std::vector<uint32_t> DurableAVLTree<Key, Value>::crcTable()
+{
+    std::vector<uint32_t> table(256);
+    for(uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for(int k = 0; k < 8; ++k) {
+            c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+        }
+        table[i] = c;
+    }
+    return table;
+}
+
+/*
+--------------------------------------------
+End implementations for the DurableAVLTree class.
+--------------------------------------------
+*/
+
+#endif
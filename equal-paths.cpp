@@ -8,25 +8,25 @@ using namespace std;
 
 
 // You may add any prototypes of helper functions here
-   // helper function to find the depth of the first leaf int
-    int findDepth(Node* node) {
+   // helper function: the depth shared by every leaf under node, or -1 if two
+   // leaves differ. Each node is visited once, so equalPaths is O(n).
+    int leafDepth(Node* node) {
         // base case: empty tree (root == NULL)
         if (node == nullptr) { return 0;}
 
-        // if it's a leaf node -> return depth
-        if (node->left == nullptr && node->right == nullptr) { return 1;}
+        // recursive step: both subtrees must have equal paths themselves
+        int L = leafDepth(node->left);
+        if (L < 0) { return -1;}
+        int R = leafDepth(node->right);
+        if (R < 0) { return -1;}
 
-        // // recursive step: recursively find the depth of left and right subtrees
-        int L = findDepth(node->left);
-        int R = findDepth(node->right);
+        // if only 1 subtree exists, its leaves are the only ones (one path)
+        if (node->left == nullptr) { return R + 1;}
+        if (node->right == nullptr) { return L + 1;}
 
-        // return the larger depth + 1
-        if (L > R) {
-            return L + 1;
-        }
-        else {
-            return R + 1;
-        }
+        // both exist (equal depth)
+        if (L != R) { return -1;}
+        return L + 1;
     }
    
 
@@ -34,24 +34,6 @@ using namespace std;
 bool equalPaths(Node * root)
 {
     // Add your code below
-    // case 1: empty tree has equal paths
-    if (root == nullptr) {
-        return true;  
-    }
-
-    // recursively check children subtrees must also have equal paths
-    if (!equalPaths(root->left)){  return false;}
-    if (!equalPaths(root->right)){ return false;}
-
-
-    int leftDepth  = findDepth(root->left);
-    int rightDepth = findDepth(root->right);
-
-    // if only 1 subtree exists, still true (only one path)
-    if (root->left == nullptr || root->right == nullptr) {
-        return true;
-    }
-
-    // both exist (equal depth)
-    return leftDepth == rightDepth;
+    // case 1: empty tree has equal paths (leafDepth returns 0)
+    return leafDepth(root) >= 0;
 }
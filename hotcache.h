@@ -0,0 +1,298 @@
+#ifndef HOTCACHE_H
+#define HOTCACHE_H
+
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "avlmulti.h"
+
+/**
+* A tree with a small set-associative cache in front of find(), at() and
+* operator[], for skewed workloads where a few hot keys take most lookups.
+* Each key hash picks a set of WAYS entries holding (hash, node) pairs; a hit
+* skips the root-to-leaf descent, a miss does the descent and caches the node
+* it found in the set's front way, evicting the set's last.
+*
+* Entries point straight at tree nodes. They stay valid while a node moves
+* around the tree (rotations and nodeSwap relink nodes, they do not copy
+* them), so only freeing a node matters: remove() drops the entries of its
+* key and bulk removals (erase_range, erase_if, clear, merging this tree into
+* another) drop the whole cache. Absent keys are not cached, so inserts
+* never have to invalidate anything; a key operator[] inserts is cached.
+*
+* find() const updates the cache, so even readers must not share one tree
+* between threads.
+*
+* Tree cannot be an AVLMultiTree: its removeOne() frees a node of a key that
+* may still be cached, and a key there names several nodes, not one.
+*/
+template <class Key, class Value, class Tree = AVLTree<Key, Value> >
+class HotKeyCachedTree : public Tree
+{
+    static_assert(!std::is_base_of<AVLMultiTree<Key, Value>, Tree>::value,
+                  "HotKeyCachedTree needs a tree with unique keys");
+
+public:
+    // capacity is the number of cached nodes, rounded up to a power of two
+    // and to at least one set
+    explicit HotKeyCachedTree(size_t capacity = 1024);
+
+    virtual void remove(const Key& key);
+    typename Tree::iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+    Value& at(const Key& key);
+    Value const & at(const Key& key) const;
+    void clear();
+
+    // lookups answered from the cache and lookups that had to descend; a
+    // lookup of an absent key is always a miss
+    size_t cacheHits() const;
+    size_t cacheMisses() const;
+    size_t cacheCapacity() const;
+    void resetCacheStats();
+
+protected:
+    virtual void eraseKeys(const Key* lo, const Key* hi);
+    virtual void eraseMatching(const typename BinarySearchTree<Key, Value>::ItemPredicate& pred);
+    virtual Node<Key,Value>* releaseNodes();
+
+    struct CacheEntry
+    {
+        size_t hash;
+        Node<Key,Value>* node;      // NULL if the entry is empty
+    };
+
+    // the node holding key or NULL, through the cache
+    Node<Key,Value>* cachedFind(const Key& key) const;
+    // the cached node for key, or NULL on a miss
+    Node<Key,Value>* cacheLookup(const Key& key, size_t hash) const;
+    // cache node in the front way of its set, evicting the set's last
+    void cacheFill(size_t hash, Node<Key,Value>* node) const;
+    // drop the entries that might hold key
+    void invalidate(const Key& key);
+    void invalidateAll();
+
+    static const size_t WAYS = 4;
+
+    mutable std::vector<CacheEntry> cache_;
+    size_t setMask_;    // number of sets - 1
+    mutable size_t hits_;
+    mutable size_t misses_;
+};
+
+/*
+-----------------------------------------------
+Begin implementations for the HotKeyCachedTree class.
+-----------------------------------------------
+*/
+
+template<class Key, class Value, class Tree>
+HotKeyCachedTree<Key, Value, Tree>::HotKeyCachedTree(size_t capacity)
+    : setMask_(0), hits_(0), misses_(0)
+{
+    size_t sets = 1;
+    while(sets * WAYS < capacity) {
+        sets *= 2;
+    }
+    setMask_ = sets - 1;
+    CacheEntry empty = { 0, NULL };
+    cache_.assign(sets * WAYS, empty);
+}
+
+template<class Key, class Value, class Tree>
+void HotKeyCachedTree<Key, Value, Tree>::remove(const Key& key)
+{
+    // before the node is freed
+    invalidate(key);
+    Tree::remove(key);
+}
+
+template<class Key, class Value, class Tree>
+typename Tree::iterator HotKeyCachedTree<Key, Value, Tree>::find(const Key& key) const
+{
+    BST_LATENCY_SCOPE(LAT_BST_FIND);
+    return Tree::iteratorAt(cachedFind(key));
+}
+
+/**
+* Inserts Value() for a missing key with the same single descent that
+* missed, and caches the new node.
+*/
+template<class Key, class Value, class Tree>
+Value& HotKeyCachedTree<Key, Value, Tree>::operator[](const Key& key)
+{
+    size_t hash = std::hash<Key>()(key);
+    Node<Key,Value>* node = cacheLookup(key, hash);
+    if(node == NULL) {
+        ++misses_;
+        bool created = false;
+        node = this->findOrCreate(key, Value(), created);
+        cacheFill(hash, node);
+    }
+    return node->getValue();
+}
+
+template<class Key, class Value, class Tree>
+Value const & HotKeyCachedTree<Key, Value, Tree>::operator[](const Key& key) const
+{
+    return at(key);
+}
+
+template<class Key, class Value, class Tree>
+Value& HotKeyCachedTree<Key, Value, Tree>::at(const Key& key)
+{
+    Node<Key,Value>* node = cachedFind(key);
+    if(node == NULL) throw std::out_of_range("Invalid key");
+    return node->getValue();
+}
+
+template<class Key, class Value, class Tree>
+Value const & HotKeyCachedTree<Key, Value, Tree>::at(const Key& key) const
+{
+    Node<Key,Value>* node = cachedFind(key);
+    if(node == NULL) throw std::out_of_range("Invalid key");
+    return node->getValue();
+}
+
+template<class Key, class Value, class Tree>
+void HotKeyCachedTree<Key, Value, Tree>::clear()
+{
+    invalidateAll();
+    Tree::clear();
+}
+
+template<class Key, class Value, class Tree>
+void HotKeyCachedTree<Key, Value, Tree>::eraseMatching(const typename BinarySearchTree<Key, Value>::ItemPredicate& pred)
+{
+    // AVLTree's version frees nodes without going through remove()
+    invalidateAll();
+    Tree::eraseMatching(pred);
+}
+
+template<class Key, class Value, class Tree>
+size_t HotKeyCachedTree<Key, Value, Tree>::cacheHits() const
+{
+    return hits_;
+}
+
+template<class Key, class Value, class Tree>
+size_t HotKeyCachedTree<Key, Value, Tree>::cacheMisses() const
+{
+    return misses_;
+}
+
+template<class Key, class Value, class Tree>
+size_t HotKeyCachedTree<Key, Value, Tree>::cacheCapacity() const
+{
+    return cache_.size();
+}
+
+template<class Key, class Value, class Tree>
+void HotKeyCachedTree<Key, Value, Tree>::resetCacheStats()
+{
+    hits_ = 0;
+    misses_ = 0;
+}
+
+template<class Key, class Value, class Tree>
+void HotKeyCachedTree<Key, Value, Tree>::eraseKeys(const Key* lo, const Key* hi)
+{
+    invalidateAll();
+    Tree::eraseKeys(lo, hi);
+}
+
+template<class Key, class Value, class Tree>
+Node<Key,Value>* HotKeyCachedTree<Key, Value, Tree>::releaseNodes()
+{
+    // the nodes now belong to another tree, which may free them
+    invalidateAll();
+    return Tree::releaseNodes();
+}
+
+template<class Key, class Value, class Tree>
+Node<Key,Value>* HotKeyCachedTree<Key, Value, Tree>::cachedFind(const Key& key) const
+{
+    size_t hash = std::hash<Key>()(key);
+    Node<Key,Value>* node = cacheLookup(key, hash);
+    if(node != NULL) {
+        return node;
+    }
+
+    ++misses_;
+    node = this->internalFind(key);
+    // a LazyAVLTree tombstone is absent, and compaction may free it later
+    if(node != NULL && this->isHiddenNode(node)) {
+        node = NULL;
+    }
+    if(node != NULL) {
+        cacheFill(hash, node);
+    }
+    return node;
+}
+
+/**
+* Checks the ways of key's set; a hit moves up one way, so that keys that
+* stay hot drift to the front and are the last to be evicted.
+*/
+template<class Key, class Value, class Tree>
+Node<Key,Value>* HotKeyCachedTree<Key, Value, Tree>::cacheLookup(const Key& key, size_t hash) const
+{
+    CacheEntry* set = &cache_[(hash & setMask_) * WAYS];
+    for(size_t i = 0; i < WAYS; ++i) {
+        if(set[i].node != NULL && set[i].hash == hash && set[i].node->getKey() == key) {
+            ++hits_;
+            if(i > 0) {
+                std::swap(set[i], set[i - 1]);
+                return set[i - 1].node;
+            }
+            return set[i].node;
+        }
+    }
+    return NULL;
+}
+
+template<class Key, class Value, class Tree>
+void HotKeyCachedTree<Key, Value, Tree>::cacheFill(size_t hash, Node<Key,Value>* node) const
+{
+    CacheEntry* set = &cache_[(hash & setMask_) * WAYS];
+    for(size_t i = WAYS - 1; i > 0; --i) {
+        set[i] = set[i - 1];
+    }
+    set[0].hash = hash;
+    set[0].node = node;
+}
+
+// helper - compares hashes only, so it never touches a node
+template<class Key, class Value, class Tree>
+void HotKeyCachedTree<Key, Value, Tree>::invalidate(const Key& key)
+{
+    size_t hash = std::hash<Key>()(key);
+    CacheEntry* set = &cache_[(hash & setMask_) * WAYS];
+    for(size_t i = 0; i < WAYS; ++i) {
+        if(set[i].hash == hash) {
+            set[i].node = NULL;
+        }
+    }
+}
+
+template<class Key, class Value, class Tree>
+void HotKeyCachedTree<Key, Value, Tree>::invalidateAll()
+{
+    for(size_t i = 0; i < cache_.size(); ++i) {
+        cache_[i].node = NULL;
+    }
+}
+
+/*
+-----------------------------------------------
+End implementations for the HotKeyCachedTree class.
+-----------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,259 @@
+#ifndef INTERVALTREE_H
+#define INTERVALTREE_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* A closed interval [lo, hi], ordered by lo and then hi.
+*/
+template <typename T>
+struct Interval
+{
+    Interval() : lo(), hi() { }
+    Interval(const T& l, const T& h) : lo(l), hi(h) { }
+
+    T lo;
+    T hi;
+};
+
+template <typename T>
+bool operator<(const Interval<T>& a, const Interval<T>& b)
+{
+    return a.lo < b.lo || (!(b.lo < a.lo) && a.hi < b.hi);
+}
+
+template <typename T>
+bool operator==(const Interval<T>& a, const Interval<T>& b)
+{
+    return !(a < b) && !(b < a);
+}
+
+template <typename T>
+bool operator!=(const Interval<T>& a, const Interval<T>& b)
+{
+    return !(a == b);
+}
+
+// so trees keyed by intervals can be printed
+template <typename T>
+std::ostream& operator<<(std::ostream& os, const Interval<T>& interval)
+{
+    return os << "[" << interval.lo << "," << interval.hi << "]";
+}
+
+/**
+* An AVLNode keyed by an Interval that also stores the largest hi in its
+* subtree.
+*/
+template <typename T, typename Value>
+class IntervalNode : public AVLNode<Interval<T>, Value>
+{
+public:
+    IntervalNode(const Interval<T>& key, const Value& value, AVLNode<Interval<T>, Value>* parent);
+    virtual ~IntervalNode();
+
+    const T& getMaxEnd() const;
+    void setMaxEnd(const T& maxEnd);
+
+protected:
+    T maxEnd_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the IntervalNode class.
+  -------------------------------------------------
+*/
+
+template<class T, class Value>
+IntervalNode<T, Value>::IntervalNode(const Interval<T>& key, const Value& value,
+                                     AVLNode<Interval<T>, Value> *parent) :
+    AVLNode<Interval<T>, Value>(key, value, parent), maxEnd_(key.hi)
+{
+
+}
+
+template<class T, class Value>
+IntervalNode<T, Value>::~IntervalNode()
+{
+
+}
+
+template<class T, class Value>
+const T& IntervalNode<T, Value>::getMaxEnd() const
+{
+    return maxEnd_;
+}
+
+template<class T, class Value>
+void IntervalNode<T, Value>::setMaxEnd(const T& maxEnd)
+{
+    maxEnd_ = maxEnd;
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the IntervalNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An AVLTree of closed intervals [lo, hi], ordered by (lo, hi). Each node keeps
+* the largest hi in its subtree, which AVLTree keeps current through every
+* rotation, nodeSwap, insert and remove via the updateNode() hook.
+*
+* A subtree whose largest hi is below a query's lo cannot overlap it, and
+* nothing right of a node whose lo is past the query's hi can either. That
+* prunes the search to:
+*   - findOverlap()/stab(): one root-to-leaf path, O(log n)
+*   - overlapping()/stabbing(): the subtrees that hold a match, O(log n + k)
+*     when matches cluster, O(k log n) at worst
+*/
+template <class T, class Value>
+class IntervalTree : public AVLTree<Interval<T>, Value>
+{
+public:
+    typedef typename BinarySearchTree<Interval<T>, Value>::iterator iterator;
+
+    using AVLTree<Interval<T>, Value>::insert;
+    // @precondition lo <= hi
+    void insert(const T& lo, const T& hi, const Value& value);
+
+    // some interval overlapping [lo, hi], or end()
+    iterator findOverlap(const T& lo, const T& hi) const;
+    // some interval containing point, or end()
+    iterator stab(const T& point) const;
+
+    // every interval overlapping [lo, hi] (or containing point), in order
+    void overlapping(const T& lo, const T& hi, std::vector<iterator>& results) const;
+    void stabbing(const T& point, std::vector<iterator>& results) const;
+
+protected:
+    virtual AVLNode<Interval<T>,Value>* createNode(const Interval<T>& key, const Value& value, AVLNode<Interval<T>,Value>* parent);
+    virtual void updateNode(AVLNode<Interval<T>,Value>* node);
+
+    // recursive helper for overlapping
+    void collectOverlaps(AVLNode<Interval<T>,Value>* node, const T& lo, const T& hi,
+                         std::vector<iterator>& results) const;
+
+    static bool overlaps(const Interval<T>& interval, const T& lo, const T& hi);
+    static IntervalNode<T,Value>* asInterval(AVLNode<Interval<T>,Value>* node);
+};
+
+/*
+----------------------------------------------
+Begin implementations for the IntervalTree class.
+----------------------------------------------
+*/
+
+template<class T, class Value>
+void IntervalTree<T, Value>::insert(const T& lo, const T& hi, const Value& value)
+{
+    this->insert(std::make_pair(Interval<T>(lo, hi), value));
+}
+
+/**
+* Walks down one path: go left whenever the left subtree can still hold an
+* overlap. If it cannot, nothing on the left overlaps and the right subtree
+* is the only place left to look.
+*/
+template<class T, class Value>
+typename IntervalTree<T, Value>::iterator
+IntervalTree<T, Value>::findOverlap(const T& lo, const T& hi) const
+{
+    AVLNode<Interval<T>,Value>* curr = static_cast<AVLNode<Interval<T>,Value>*>(this->root_);
+    while(curr != NULL && !overlaps(curr->getKey(), lo, hi)) {
+        IntervalNode<T,Value>* left = asInterval(curr->getLeft());
+        if(left != NULL && !(left->getMaxEnd() < lo)) {
+            curr = left;
+        }
+        else {
+            curr = curr->getRight();
+        }
+    }
+    return this->iteratorAt(curr);
+}
+
+template<class T, class Value>
+typename IntervalTree<T, Value>::iterator
+IntervalTree<T, Value>::stab(const T& point) const
+{
+    return findOverlap(point, point);
+}
+
+template<class T, class Value>
+void IntervalTree<T, Value>::overlapping(const T& lo, const T& hi, std::vector<iterator>& results) const
+{
+    results.clear();
+    collectOverlaps(static_cast<AVLNode<Interval<T>,Value>*>(this->root_), lo, hi, results);
+}
+
+template<class T, class Value>
+void IntervalTree<T, Value>::stabbing(const T& point, std::vector<iterator>& results) const
+{
+    overlapping(point, point, results);
+}
+
+template<class T, class Value>
+AVLNode<Interval<T>,Value>* IntervalTree<T, Value>::createNode(const Interval<T>& key, const Value& value,
+                                                               AVLNode<Interval<T>,Value>* parent)
+{
+    return new IntervalNode<T,Value>(key, value, parent);
+}
+
+// helper - maxEnd = largest of the node's own hi and its children's maxEnd
+template<class T, class Value>
+void IntervalTree<T, Value>::updateNode(AVLNode<Interval<T>,Value>* node)
+{
+    IntervalNode<T,Value>* curr = asInterval(node);
+    T maxEnd = curr->getKey().hi;
+    IntervalNode<T,Value>* left = asInterval(curr->getLeft());
+    IntervalNode<T,Value>* right = asInterval(curr->getRight());
+    if(left != NULL && maxEnd < left->getMaxEnd()) { maxEnd = left->getMaxEnd(); }
+    if(right != NULL && maxEnd < right->getMaxEnd()) { maxEnd = right->getMaxEnd(); }
+    curr->setMaxEnd(maxEnd);
+}
+
+// helper - in-order walk that skips subtrees which cannot overlap [lo, hi]
+template<class T, class Value>
+void IntervalTree<T, Value>::collectOverlaps(AVLNode<Interval<T>,Value>* node, const T& lo, const T& hi,
+                                             std::vector<iterator>& results) const
+{
+    // nothing in this subtree reaches lo
+    if(node == NULL || asInterval(node)->getMaxEnd() < lo) { return; }
+
+    collectOverlaps(node->getLeft(), lo, hi, results);
+
+    // this node and everything right of it start after hi
+    if(hi < node->getKey().lo) { return; }
+
+    if(overlaps(node->getKey(), lo, hi)) {
+        results.push_back(this->iteratorAt(node));
+    }
+    collectOverlaps(node->getRight(), lo, hi, results);
+}
+
+template<class T, class Value>
+bool IntervalTree<T, Value>::overlaps(const Interval<T>& interval, const T& lo, const T& hi)
+{
+    return !(hi < interval.lo) && !(interval.hi < lo);
+}
+
+template<class T, class Value>
+IntervalNode<T,Value>* IntervalTree<T, Value>::asInterval(AVLNode<Interval<T>,Value>* node)
+{
+    return static_cast<IntervalNode<T,Value>*>(node);
+}
+
+/*
+--------------------------------------------
+End implementations for the IntervalTree class.
+--------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,66 @@
+#include <iostream>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <thread>
+#include "bst.h"
+#include "avlbst.h"
+
+using namespace std;
+
+// Usage: ./latency-bench [numKeys] [numThreads]
+//
+// Built with -DBST_LATENCY_STATS. Each thread fills its own BinarySearchTree
+// and AVLTree with numKeys random keys, then runs finds, removes and a range
+// erase, merges in a second BST and clears everything; the per-operation
+// latency percentiles merged over all threads are printed at the end. The
+// averages hide the outliers this shows: a clear() or a remove near the root
+// of a degenerate BST costs orders of magnitude more than the median op.
+
+void runThread(size_t numKeys, unsigned seed)
+{
+    mt19937 gen(seed);
+    uniform_int_distribution<int> keyDist(0, 4 * (int)numKeys);
+
+    BinarySearchTree<int, int> bst, other;
+    AVLTree<int, int> avl;
+    for(size_t i = 0; i < numKeys; ++i) {
+        int key = keyDist(gen);
+        bst.insert(make_pair(key, (int)i));
+        avl.insert(make_pair(key, (int)i));
+        other.insert(make_pair(keyDist(gen), (int)i));
+    }
+    for(size_t i = 0; i < 4 * numKeys; ++i) {
+        bst.find(keyDist(gen));
+    }
+    for(size_t i = 0; i < numKeys / 2; ++i) {
+        int key = keyDist(gen);
+        bst.remove(key);
+        avl.remove(key);
+    }
+    bst.erase_range(0, (int)numKeys);
+    bst.merge(std::move(other));
+    bst.clear();
+    avl.clear();
+}
+
+int main(int argc, char *argv[])
+{
+    size_t numKeys = 20000;
+    size_t numThreads = 2;
+    if(argc > 1) { numKeys = strtoul(argv[1], NULL, 10); }
+    if(argc > 2) { numThreads = strtoul(argv[2], NULL, 10); }
+    if(numThreads == 0) { numThreads = 1; }
+
+    vector<thread> threads;
+    for(size_t t = 0; t < numThreads; ++t) {
+        threads.push_back(thread(runThread, numKeys, 420 + (unsigned)t));
+    }
+    for(size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+
+    cout << "keys: " << numKeys << ", threads: " << numThreads << endl;
+    latencyReport(cout);
+    return 0;
+}
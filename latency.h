@@ -0,0 +1,442 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+/**
+* Opt-in latency recording for the public tree operations. Build with
+* -DBST_LATENCY_STATS to record; otherwise BST_LATENCY_SCOPE expands to
+* nothing and this header declares nothing else, so it costs nothing.
+*
+* Each thread records into its own histograms with no locking or atomic
+* read-modify-write; reading merges every thread's histograms (plus those of
+* threads that have exited). Histograms are log-bucketed like HdrHistogram:
+* 16 sub-buckets per power of two, so a reported percentile is at most 1/16
+* (about 6%) above the true value.
+*/
+
+#ifndef BST_LATENCY_STATS
+
+#define BST_LATENCY_SCOPE(op)
+
+#else
+
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+// the recorded operations
+enum LatencyOp
+{
+    LAT_BST_INSERT,
+    LAT_BST_REMOVE,
+    LAT_BST_FIND,
+    LAT_BST_CLEAR,
+    LAT_BST_ERASE_RANGE,
+    LAT_BST_MERGE,
+    LAT_AVL_INSERT,
+    LAT_AVL_REMOVE,
+    LAT_OP_COUNT
+};
+
+inline const char* latencyOpName(LatencyOp op)
+{
+    static const char* const names[LAT_OP_COUNT] = {
+        "BST insert", "BST remove", "BST find", "BST clear",
+        "BST erase_range", "BST merge", "AVL insert", "AVL remove"
+    };
+    return names[op];
+}
+
+/**
+* A merged, read-side histogram of latencies in nanoseconds.
+*/
+class LatencyHistogram
+{
+public:
+    // 16 sub-buckets per power of two up to 2^48 ns (about three days)
+    static const int SUB_BITS = 4;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int MAX_EXPONENT = 47;
+    static const int BUCKETS = (MAX_EXPONENT - SUB_BITS + 2) * SUB_COUNT;
+
+    LatencyHistogram();
+
+    void record(uint64_t ns);
+    void merge(const LatencyHistogram& other);
+    void reset();
+
+    uint64_t count() const;
+    uint64_t max() const;
+    double mean() const;
+    // the latency at or below which fraction of all recorded ones fall,
+    // rounded up to the top of its bucket; 0 when empty
+    uint64_t percentile(double fraction) const;
+
+    static int bucketOf(uint64_t ns);
+    static uint64_t bucketTop(int bucket);
+
+protected:
+    friend struct ThreadLatency;
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_;
+    uint64_t max_;
+    double sum_;
+};
+
+/**
+* The histograms one thread records into. Only the owning thread writes; the
+* counters are atomics only so that readers merging them see whole values.
+*/
+struct ThreadLatency
+{
+    ThreadLatency();
+    void record(LatencyOp op, uint64_t ns);
+    void mergeInto(LatencyOp op, LatencyHistogram& out) const;
+    void reset();
+
+    std::atomic<uint64_t> counts[LAT_OP_COUNT][LatencyHistogram::BUCKETS];
+    std::atomic<uint64_t> sumNs[LAT_OP_COUNT];
+    std::atomic<uint64_t> maxNs[LAT_OP_COUNT];
+};
+
+/**
+* Every live thread's histograms plus the merged histograms of exited threads.
+*/
+class LatencyRegistry
+{
+public:
+    static LatencyRegistry& instance();
+
+    void attach(ThreadLatency* thread);
+    // folds an exiting thread's histograms into the retired ones
+    void detach(ThreadLatency* thread);
+
+    void snapshot(LatencyOp op, LatencyHistogram& out);
+    // zeroes everything; operations finishing meanwhile may or may not count
+    void reset();
+
+protected:
+    std::mutex lock_;
+    std::vector<ThreadLatency*> threads_;
+    LatencyHistogram retired_[LAT_OP_COUNT];
+};
+
+// the calling thread's histograms, registered on first use
+ThreadLatency& threadLatency();
+
+// merged histogram of op across all threads, past and present
+void latencySnapshot(LatencyOp op, LatencyHistogram& out);
+// count, mean, p50, p99, p99.9 and max for every op recorded so far
+void latencyReport(std::ostream& os);
+void latencyReset();
+
+/**
+* Times the enclosing scope and records it under op.
+*/
+class LatencyScope
+{
+public:
+    explicit LatencyScope(LatencyOp op);
+    ~LatencyScope();
+
+protected:
+    LatencyOp op_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#define BST_LATENCY_SCOPE(op) LatencyScope latencyScope_(op)
+
+/*
+----------------------------------------------
+Begin implementations for the LatencyHistogram class.
+----------------------------------------------
+*/
+
+inline LatencyHistogram::LatencyHistogram()
+    : counts_(BUCKETS, 0), total_(0), max_(0), sum_(0)
+{
+
+}
+
+inline void LatencyHistogram::record(uint64_t ns)
+{
+    ++counts_[bucketOf(ns)];
+    ++total_;
+    sum_ += (double)ns;
+    if(ns > max_) { max_ = ns; }
+}
+
+inline void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for(int i = 0; i < BUCKETS; ++i) {
+        counts_[i] += other.counts_[i];
+    }
+    total_ += other.total_;
+    sum_ += other.sum_;
+    if(other.max_ > max_) { max_ = other.max_; }
+}
+
+inline void LatencyHistogram::reset()
+{
+    counts_.assign(BUCKETS, 0);
+    total_ = 0;
+    max_ = 0;
+    sum_ = 0;
+}
+
+inline uint64_t LatencyHistogram::count() const
+{
+    return total_;
+}
+
+inline uint64_t LatencyHistogram::max() const
+{
+    return max_;
+}
+
+inline double LatencyHistogram::mean() const
+{
+    return (total_ == 0) ? 0 : sum_ / (double)total_;
+}
+
+inline uint64_t LatencyHistogram::percentile(double fraction) const
+{
+    if(total_ == 0) { return 0; }
+    // the 1-based rank of the wanted value, at least 1 and at most total_
+    uint64_t rank = (uint64_t)(fraction * (double)total_ + 0.5);
+    if(rank < 1) { rank = 1; }
+    if(rank > total_) { rank = total_; }
+
+    uint64_t seen = 0;
+    for(int i = 0; i < BUCKETS; ++i) {
+        seen += counts_[i];
+        if(seen >= rank) {
+            uint64_t top = bucketTop(i);
+            return (top < max_) ? top : max_;
+        }
+    }
+    return max_;
+}
+
+/**
+* Values below 16 get a bucket each. Above that, a value whose highest set bit
+* is e falls in one of 16 equal slices of [2^e, 2^(e+1)).
+*/
+inline int LatencyHistogram::bucketOf(uint64_t ns)
+{
+    if(ns < (uint64_t)SUB_COUNT) {
+        return (int)ns;
+    }
+    int e = 63 - __builtin_clzll(ns);
+    if(e > MAX_EXPONENT) {
+        return BUCKETS - 1;
+    }
+    int sub = (int)(ns >> (e - SUB_BITS)) - SUB_COUNT;
+    return (e - SUB_BITS + 1) * SUB_COUNT + sub;
+}
+
+// the largest value that falls in bucket
+inline uint64_t LatencyHistogram::bucketTop(int bucket)
+{
+    if(bucket < SUB_COUNT) {
+        return bucket;
+    }
+    int e = bucket / SUB_COUNT + SUB_BITS - 1;
+    uint64_t sub = bucket % SUB_COUNT;
+    return ((SUB_COUNT + sub + 1) << (e - SUB_BITS)) - 1;
+}
+
+/*
+--------------------------------------------
+End implementations for the LatencyHistogram class.
+--------------------------------------------
+*/
+
+/*
+----------------------------------------------
+Begin implementations for the ThreadLatency and LatencyRegistry classes.
+----------------------------------------------
+*/
+
+inline ThreadLatency::ThreadLatency()
+{
+    reset();
+}
+
+// helper - load then store rather than fetch_add, since only this thread writes
+inline void ThreadLatency::record(LatencyOp op, uint64_t ns)
+{
+    std::atomic<uint64_t>& count = counts[op][LatencyHistogram::bucketOf(ns)];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sumNs[op].store(sumNs[op].load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+    if(ns > maxNs[op].load(std::memory_order_relaxed)) {
+        maxNs[op].store(ns, std::memory_order_relaxed);
+    }
+}
+
+inline void ThreadLatency::mergeInto(LatencyOp op, LatencyHistogram& out) const
+{
+    for(int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+        uint64_t count = counts[op][i].load(std::memory_order_relaxed);
+        out.counts_[i] += count;
+        out.total_ += count;
+    }
+    out.sum_ += (double)sumNs[op].load(std::memory_order_relaxed);
+    uint64_t max = maxNs[op].load(std::memory_order_relaxed);
+    if(max > out.max_) { out.max_ = max; }
+}
+
+inline void ThreadLatency::reset()
+{
+    for(int op = 0; op < LAT_OP_COUNT; ++op) {
+        for(int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+            counts[op][i].store(0, std::memory_order_relaxed);
+        }
+        sumNs[op].store(0, std::memory_order_relaxed);
+        maxNs[op].store(0, std::memory_order_relaxed);
+    }
+}
+
+inline LatencyRegistry& LatencyRegistry::instance()
+{
+    static LatencyRegistry registry;
+    return registry;
+}
+
+inline void LatencyRegistry::attach(ThreadLatency* thread)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    threads_.push_back(thread);
+}
+
+inline void LatencyRegistry::detach(ThreadLatency* thread)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    for(int op = 0; op < LAT_OP_COUNT; ++op) {
+        thread->mergeInto((LatencyOp)op, retired_[op]);
+    }
+    for(size_t i = 0; i < threads_.size(); ++i) {
+        if(threads_[i] == thread) {
+            threads_[i] = threads_.back();
+            threads_.pop_back();
+            break;
+        }
+    }
+}
+
+inline void LatencyRegistry::snapshot(LatencyOp op, LatencyHistogram& out)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    out.reset();
+    out.merge(retired_[op]);
+    for(size_t i = 0; i < threads_.size(); ++i) {
+        threads_[i]->mergeInto(op, out);
+    }
+}
+
+inline void LatencyRegistry::reset()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    for(int op = 0; op < LAT_OP_COUNT; ++op) {
+        retired_[op].reset();
+    }
+    for(size_t i = 0; i < threads_.size(); ++i) {
+        threads_[i]->reset();
+    }
+}
+
+// helper - owns a thread's histograms and hands them to the registry on exit
+struct ThreadLatencyHandle
+{
+    ThreadLatencyHandle() : thread(new ThreadLatency)
+    {
+        LatencyRegistry::instance().attach(thread);
+    }
+
+    ~ThreadLatencyHandle()
+    {
+        LatencyRegistry::instance().detach(thread);
+        delete thread;
+    }
+
+    ThreadLatency* thread;
+};
+
+/**
+* The registry is constructed inside the handle's constructor, so it outlives
+* every handle, including the main thread's.
+*/
+inline ThreadLatency& threadLatency()
+{
+    static thread_local ThreadLatencyHandle handle;
+    return *handle.thread;
+}
+
+inline void latencySnapshot(LatencyOp op, LatencyHistogram& out)
+{
+    LatencyRegistry::instance().snapshot(op, out);
+}
+
+inline void latencyReport(std::ostream& os)
+{
+    os << std::left << std::setw(18) << "operation" << std::right
+       << std::setw(12) << "count" << std::setw(12) << "mean ns"
+       << std::setw(12) << "p50 ns" << std::setw(12) << "p99 ns"
+       << std::setw(12) << "p99.9 ns" << std::setw(14) << "max ns" << std::endl;
+
+    LatencyHistogram hist;
+    for(int op = 0; op < LAT_OP_COUNT; ++op) {
+        latencySnapshot((LatencyOp)op, hist);
+        if(hist.count() == 0) { continue; }
+        os << std::left << std::setw(18) << latencyOpName((LatencyOp)op) << std::right
+           << std::setw(12) << hist.count()
+           << std::setw(12) << (uint64_t)hist.mean()
+           << std::setw(12) << hist.percentile(0.5)
+           << std::setw(12) << hist.percentile(0.99)
+           << std::setw(12) << hist.percentile(0.999)
+           << std::setw(14) << hist.max() << std::endl;
+    }
+}
+
+inline void latencyReset()
+{
+    LatencyRegistry::instance().reset();
+}
+
+/*
+--------------------------------------------
+End implementations for the ThreadLatency and LatencyRegistry classes.
+--------------------------------------------
+*/
+
+/*
+----------------------------------------------
+Begin implementations for the LatencyScope class.
+----------------------------------------------
+*/
+
+inline LatencyScope::LatencyScope(LatencyOp op)
+    : op_(op), start_(std::chrono::steady_clock::now())
+{
+
+}
+
+inline LatencyScope::~LatencyScope()
+{
+    std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start_;
+    threadLatency().record(op_, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+/*
+--------------------------------------------
+End implementations for the LatencyScope class.
+--------------------------------------------
+*/
+
+#endif
+
+#endif
@@ -0,0 +1,504 @@
+#ifndef LAZYAVL_H
+#define LAZYAVL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* An AVLTree with lazy deletion. remove() only marks the node as a tombstone
+* (one O(log n) search, no unlinking or rebalancing), and lookups and iterators
+* skip tombstones. Tombstones are physically removed later, either all at once
+* by compact() or a few at a time by compactStep().
+*
+* With auto-compaction on (the default), remove() calls compact() once
+* tombstones make up more than the compaction threshold of all nodes. Turn it
+* off to keep remove() free of O(n) pauses and drive compactStep() instead,
+* e.g. between request batches.
+*/
+template <class Key, class Value>
+class LazyAVLTree : public AVLTree<Key, Value>
+{
+public:
+    LazyAVLTree();
+
+    virtual void remove(const Key& key);
+    void clear();
+
+    // number of live (not deleted) items
+    size_t size() const;
+    // number of tombstones waiting to be compacted
+    size_t tombstones() const;
+
+    // fraction of tombstones (out of all nodes) that triggers auto-compaction
+    void setCompactionThreshold(double ratio);
+    void setAutoCompact(bool autoCompact);
+
+    // physically remove every tombstone and rebuild a perfectly balanced tree, O(n)
+    void compact();
+
+    // visit up to maxSteps nodes in key order from where the last call stopped,
+    // removing the tombstones among them. Returns true once a full pass finished.
+    bool compactStep(size_t maxSteps);
+
+public:
+    /**
+    * Iterator that skips tombstones.
+    */
+    class iterator : public BinarySearchTree<Key, Value>::iterator
+    {
+    public:
+        iterator();
+        iterator& operator++();
+
+    protected:
+        friend class LazyAVLTree<Key, Value>;
+        iterator(Node<Key,Value>* ptr);
+        // adopts a base iterator that already points at a live node (or end)
+        iterator(const typename BinarySearchTree<Key, Value>::iterator& it);
+        void skipTombstones();
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    void find_many(const std::vector<Key>& keys, std::vector<iterator>& results) const;
+    iterator lower_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+    Value& at(const Key& key);
+    Value const & at(const Key& key) const;
+
+protected:
+    // internalFind that treats tombstones as missing
+    AVLNode<Key,Value>* findLive(const Key& key) const;
+    // inserting a key that has a tombstone revives the node in place
+    virtual Node<Key,Value>* findOrCreate(const Key& key, const Value& value, bool& created);
+    // hides BinarySearchTree::iteratorAt, so that wrapping trees hand out
+    // iterators that skip tombstones
+    static iterator iteratorAt(Node<Key,Value>* node);
+
+    // marks the live keys in [*lo, *hi) as tombstones, O(log n + k)
+    virtual void eraseKeys(const Key* lo, const Key* hi);
+    // erase_if: marks every live match as a tombstone, O(n)
+    virtual void eraseMatching(const typename BinarySearchTree<Key, Value>::ItemPredicate& pred);
+
+    // merge() support: compact before handing nodes over, so no tombstone
+    // leaves the tree, and recount after taking nodes in
+    virtual Node<Key,Value>* releaseNodes();
+    virtual void absorbNodes(Node<Key,Value>* root, const BinarySearchTree<Key, Value>& source);
+    // a merged-in key revives its tombstone in place
+    virtual void takeValue(AVLNode<Key,Value>* node, const Value& value);
+
+    // run compact() if auto-compaction is on and the threshold is crossed
+    void maybeCompact();
+
+    static bool isDead(Node<Key,Value>* node);
+    // tombstones are hidden from whole-tree walks
+    virtual bool isHiddenNode(Node<Key,Value>* node) const;
+
+    size_t live_;
+    size_t dead_;
+    double threshold_;
+    bool autoCompact_;
+
+    // resume point of compactStep()
+    bool hasCursor_;
+    Key cursor_;
+};
+
+/*
+--------------------------------------------------
+Begin implementations for the LazyAVLTree::iterator class.
+--------------------------------------------------
+*/
+
+template<class Key, class Value>
+LazyAVLTree<Key, Value>::iterator::iterator()
+    : BinarySearchTree<Key, Value>::iterator()
+{
+
+}
+
+template<class Key, class Value>
+LazyAVLTree<Key, Value>::iterator::iterator(Node<Key,Value>* ptr)
+    : BinarySearchTree<Key, Value>::iterator(ptr)
+{
+    skipTombstones();
+}
+
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator&
+LazyAVLTree<Key, Value>::iterator::operator++()
+{
+    this->current_ = BinarySearchTree<Key, Value>::successor(this->current_);
+    skipTombstones();
+    return *this;
+}
+
+template<class Key, class Value>
+LazyAVLTree<Key, Value>::iterator::iterator(const typename BinarySearchTree<Key, Value>::iterator& it)
+    : BinarySearchTree<Key, Value>::iterator(it)
+{
+
+}
+
+// helper - move forward until current_ is a live node or NULL
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::iterator::skipTombstones()
+{
+    while(isDead(this->current_)) {
+        this->current_ = BinarySearchTree<Key, Value>::successor(this->current_);
+    }
+}
+
+/*
+------------------------------------------------
+End implementations for the LazyAVLTree::iterator class.
+------------------------------------------------
+*/
+
+/*
+----------------------------------------------
+Begin implementations for the LazyAVLTree class.
+----------------------------------------------
+*/
+
+template<class Key, class Value>
+LazyAVLTree<Key, Value>::LazyAVLTree()
+    : live_(0), dead_(0), threshold_(0.25), autoCompact_(true), hasCursor_(false), cursor_()
+{
+
+}
+
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator
+LazyAVLTree<Key, Value>::begin() const
+{
+    return iterator(this->getSmallestNode());
+}
+
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator
+LazyAVLTree<Key, Value>::end() const
+{
+    return iterator(NULL);
+}
+
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator
+LazyAVLTree<Key, Value>::iteratorAt(Node<Key,Value>* node)
+{
+    return iterator(node);
+}
+
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator
+LazyAVLTree<Key, Value>::find(const Key& key) const
+{
+    return iterator(findLive(key));
+}
+
+/**
+ * Batched find(): the base search already treats tombstones as missing, so
+ * its results only need rewrapping as iterators that skip tombstones
+ */
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::find_many(const std::vector<Key>& keys, std::vector<iterator>& results) const
+{
+    std::vector<typename BinarySearchTree<Key, Value>::iterator> found;
+    BinarySearchTree<Key, Value>::find_many(keys, found);
+    results.clear();
+    results.reserve(found.size());
+    for(size_t i = 0; i < found.size(); ++i) {
+        results.push_back(iterator(found[i]));
+    }
+}
+
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator
+LazyAVLTree<Key, Value>::lower_bound(const Key& key) const
+{
+    return iterator(this->internalLowerBound(key));
+}
+
+/**
+ * Returns the value associated with the key, after inserting (or
+ * reviving) the key with a default-constructed value if it is missing
+ */
+template<class Key, class Value>
+Value& LazyAVLTree<Key, Value>::operator[](const Key& key)
+{
+    return BinarySearchTree<Key, Value>::operator[](key);
+}
+template<class Key, class Value>
+Value const & LazyAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    return at(key);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value>
+Value& LazyAVLTree<Key, Value>::at(const Key& key)
+{
+    AVLNode<Key,Value>* curr = findLive(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+template<class Key, class Value>
+Value const & LazyAVLTree<Key, Value>::at(const Key& key) const
+{
+    AVLNode<Key,Value>* curr = findLive(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+/*
+ * A key whose node is a tombstone counts as created: the node takes value
+ * and comes back to life without any relinking.
+ */
+template<class Key, class Value>
+Node<Key,Value>* LazyAVLTree<Key, Value>::findOrCreate(const Key& key, const Value& value, bool& created)
+{
+    AVLNode<Key,Value>* node = static_cast<AVLNode<Key,Value>*>(AVLTree<Key, Value>::findOrCreate(key, value, created));
+    if(created) {
+        ++live_;
+    }
+    else if(node->isTombstone()) {
+        node->setValue(value);
+        node->setTombstone(false);
+        --dead_;
+        ++live_;
+        created = true;
+    }
+    return node;
+}
+
+/*
+ * Marks the key's node as a tombstone; the node stays linked in the tree.
+ */
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::remove(const Key& key)
+{
+    AVLNode<Key,Value>* node = findLive(key);
+    if(node == NULL) { return; }
+
+    node->setTombstone(true);
+    --live_;
+    ++dead_;
+    maybeCompact();
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::clear()
+{
+    BinarySearchTree<Key, Value>::clear();
+    live_ = 0;
+    dead_ = 0;
+    hasCursor_ = false;
+}
+
+template<class Key, class Value>
+size_t LazyAVLTree<Key, Value>::size() const
+{
+    return live_;
+}
+
+template<class Key, class Value>
+size_t LazyAVLTree<Key, Value>::tombstones() const
+{
+    return dead_;
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::setCompactionThreshold(double ratio)
+{
+    threshold_ = ratio;
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::setAutoCompact(bool autoCompact)
+{
+    autoCompact_ = autoCompact;
+}
+
+/**
+* Collects the live nodes in order, frees the tombstones, and relinks the live
+* nodes into a perfectly balanced tree. No live node is reallocated.
+*/
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::compact()
+{
+    std::vector<AVLNode<Key,Value>*> liveNodes;
+    liveNodes.reserve(live_);
+
+    // collect first: successor() walks back up through nodes we already visited,
+    // so nothing can be freed during the traversal
+    std::vector<AVLNode<Key,Value>*> deadNodes;
+    deadNodes.reserve(dead_);
+    for(Node<Key,Value>* curr = this->getSmallestNode(); curr != NULL;
+        curr = BinarySearchTree<Key, Value>::successor(curr)) {
+        AVLNode<Key,Value>* avlCurr = static_cast<AVLNode<Key,Value>*>(curr);
+        if(avlCurr->isTombstone()) {
+            deadNodes.push_back(avlCurr);
+        }
+        else {
+            liveNodes.push_back(avlCurr);
+        }
+    }
+    for(size_t i = 0; i < deadNodes.size(); ++i) {
+        delete deadNodes[i];
+    }
+
+    int height = 0;
+    this->root_ = this->buildBalanced(liveNodes, 0, liveNodes.size(), NULL, height);
+    dead_ = 0;
+    hasCursor_ = false;
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::eraseMatching(const typename BinarySearchTree<Key, Value>::ItemPredicate& pred)
+{
+    for(Node<Key,Value>* curr = this->getSmallestNode(); curr != NULL;
+        curr = BinarySearchTree<Key, Value>::successor(curr)) {
+        AVLNode<Key,Value>* avlCurr = static_cast<AVLNode<Key,Value>*>(curr);
+        if(!avlCurr->isTombstone() && pred(avlCurr->getItem())) {
+            avlCurr->setTombstone(true);
+            --live_;
+            ++dead_;
+        }
+    }
+    maybeCompact();
+}
+
+/*
+ * Range erase keeps the lazy contract: nodes are only marked, and compaction
+ * is considered once at the end instead of per key.
+ */
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::eraseKeys(const Key* lo, const Key* hi)
+{
+    Node<Key,Value>* curr = (lo != NULL) ? this->internalLowerBound(*lo) : this->getSmallestNode();
+    while(curr != NULL && (hi == NULL || curr->getKey() < *hi)) {
+        AVLNode<Key,Value>* avlCurr = static_cast<AVLNode<Key,Value>*>(curr);
+        if(!avlCurr->isTombstone()) {
+            avlCurr->setTombstone(true);
+            --live_;
+            ++dead_;
+        }
+        curr = BinarySearchTree<Key, Value>::successor(curr);
+    }
+    maybeCompact();
+}
+
+template<class Key, class Value>
+Node<Key,Value>* LazyAVLTree<Key, Value>::releaseNodes()
+{
+    if(dead_ > 0) {
+        compact();
+    }
+    live_ = 0;
+    hasCursor_ = false;
+    return AVLTree<Key, Value>::releaseNodes();
+}
+
+/**
+* Reuses AVLTree's merge, which revives our tombstones on matching keys, then
+* recounts live and dead nodes, O(n + m).
+*/
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::absorbNodes(Node<Key,Value>* root, const BinarySearchTree<Key, Value>& source)
+{
+    AVLTree<Key, Value>::absorbNodes(root, source);
+
+    live_ = 0;
+    dead_ = 0;
+    for(Node<Key,Value>* curr = this->getSmallestNode(); curr != NULL;
+        curr = BinarySearchTree<Key, Value>::successor(curr)) {
+        if(isDead(curr)) { ++dead_; }
+        else { ++live_; }
+    }
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::takeValue(AVLNode<Key,Value>* node, const Value& value)
+{
+    node->setValue(value);
+    node->setTombstone(false);
+}
+
+/**
+* Walks at most maxSteps nodes starting at the saved cursor and unlinks the
+* tombstones it meets with the regular AVL remove (O(log n) each).
+*/
+template<class Key, class Value>
+bool LazyAVLTree<Key, Value>::compactStep(size_t maxSteps)
+{
+    Node<Key,Value>* curr = hasCursor_ ? this->internalLowerBound(cursor_) : this->getSmallestNode();
+
+    for(size_t step = 0; step < maxSteps && curr != NULL; ++step) {
+        Node<Key,Value>* next = BinarySearchTree<Key, Value>::successor(curr);
+        if(isDead(curr)) {
+            // remember where to continue, since remove can relink the whole path
+            bool hasNext = (next != NULL);
+            Key nextKey = hasNext ? next->getKey() : Key();
+
+            AVLTree<Key, Value>::remove(curr->getKey());
+            --dead_;
+
+            next = hasNext ? this->internalLowerBound(nextKey) : NULL;
+        }
+        curr = next;
+    }
+
+    // reached the end: the next call starts a new pass
+    if(curr == NULL) {
+        hasCursor_ = false;
+        return true;
+    }
+    hasCursor_ = true;
+    cursor_ = curr->getKey();
+    return false;
+}
+
+template<class Key, class Value>
+AVLNode<Key,Value>* LazyAVLTree<Key, Value>::findLive(const Key& key) const
+{
+    Node<Key,Value>* node = this->internalFind(key);
+    if(isDead(node)) { return NULL; }
+    return static_cast<AVLNode<Key,Value>*>(node);
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::maybeCompact()
+{
+    if(autoCompact_ && (double)dead_ > threshold_ * (double)(live_ + dead_)) {
+        compact();
+    }
+}
+
+template<class Key, class Value>
+bool LazyAVLTree<Key, Value>::isDead(Node<Key,Value>* node)
+{
+    return node != NULL && static_cast<AVLNode<Key,Value>*>(node)->isTombstone();
+}
+
+template<class Key, class Value>
+bool LazyAVLTree<Key, Value>::isHiddenNode(Node<Key,Value>* node) const
+{
+    return isDead(node);
+}
+
+/*
+--------------------------------------------
+End implementations for the LazyAVLTree class.
+--------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,661 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "bst.h"
+
+/**
+* A fork-join pool that lives for one parallel call. Every worker owns a deque
+* of tasks: it pushes and pops at the back, and a worker that runs dry steals
+* from the front of another's, taking the oldest and so largest piece of work.
+*/
+class WorkStealingPool
+{
+public:
+    // a task gets the index of the worker running it, e.g. to spawn() more
+    typedef std::function<void(unsigned)> Task;
+
+    explicit WorkStealingPool(unsigned threads);
+
+    // run task and every task spawned from it, then return. Rethrows the
+    // first exception a task threw, after all other tasks have finished.
+    void run(const Task& task);
+    // queue task on worker's deque; only call from a task running on worker
+    void spawn(unsigned worker, const Task& task);
+    // true when some worker is idle and worker has nothing queued to steal
+    bool hungry(unsigned worker) const;
+    unsigned size() const;
+
+protected:
+    struct Worker
+    {
+        std::mutex lock;
+        std::deque<Task> tasks;
+        std::atomic<size_t> queued;
+    };
+
+    // pop from our own deque, else steal from another
+    bool take(unsigned self, Task& task);
+    void work(unsigned self);
+
+    std::vector<std::unique_ptr<Worker> > workers_;
+    std::atomic<size_t> pending_;   // tasks queued or running
+    std::atomic<unsigned> idle_;    // workers looking for a task
+    std::mutex errorLock_;
+    std::exception_ptr error_;
+};
+
+/**
+* Whole-tree operations that spread their work over several threads. They work
+* on any BinarySearchTree through its protected hooks: builds get AVL balances,
+* red-black colors and derived trees' cached subtree data right, and walks skip
+* hidden nodes such as LazyAVLTree tombstones.
+* Use the free functions below rather than this class.
+*/
+template <typename Key, typename Value>
+class ParallelTreeOps
+{
+public:
+    typedef std::pair<Key, Value> Item;
+
+    // see parallel_build, parallel_for_each and parallel_reduce
+    static void build(BinarySearchTree<Key, Value>& tree, std::vector<Item>& items, unsigned threads);
+    template<typename Function>
+    static void forEach(BinarySearchTree<Key, Value>& tree, Function& fn, unsigned threads);
+    template<typename Result, typename Map, typename Combine>
+    static Result reduce(const BinarySearchTree<Key, Value>& tree, const Result& init, Map& map,
+                         Combine& combine, bool ordered, unsigned threads);
+
+    // 0 threads means one per core
+    static unsigned threadCount(unsigned threads);
+
+protected:
+    // run task(0) .. task(count - 1) on up to threads threads
+    static void runParallel(size_t count, unsigned threads, const std::function<void(size_t)>& task);
+
+    // stable sort by key, then, if unique is set, keep only the last item
+    // of each key
+    static void sortUnique(std::vector<Item>& items, unsigned threads, bool unique);
+    static bool keyLess(const Item& a, const Item& b);
+
+    // build the balanced subtree of items[lo, hi). Below spawnDepth the left
+    // half is built on a new thread while this one builds the right half.
+    static Node<Key, Value>* buildRange(BinarySearchTree<Key, Value>& tree, const std::vector<Item>& items,
+                                        size_t lo, size_t hi, int depth, int treeHeight, int spawnDepth,
+                                        int& height);
+
+    // below this many items one thread does the whole job
+    static const size_t SERIAL_CUTOFF = 1 << 14;
+
+    /**
+    * Walkers say what a walk does with each node. visit() gets the part of
+    * the output the node's task writes to; split() makes the part for a task
+    * split off to cover keys just after the current task's.
+    */
+    template<typename Function>
+    struct ForEachWalker
+    {
+        typedef int Part;
+        void visit(Node<Key, Value>* node, Part /*part*/, unsigned /*worker*/) { fn(node->getItem()); }
+        Part split(Part part) { return part; }
+        Function& fn;
+    };
+
+    // ordered reduce: each task folds its items into its own slot, and slots
+    // are linked in key order
+    template<typename Result>
+    struct Slot
+    {
+        Result value;
+        Slot* next;
+    };
+
+    template<typename Result, typename Map, typename Combine>
+    struct OrderedReduceWalker
+    {
+        typedef Slot<Result>* Part;
+        void visit(Node<Key, Value>* node, Part part, unsigned /*worker*/)
+        {
+            part->value = combine(part->value, map(node->getItem()));
+        }
+        Part split(Part part)
+        {
+            Slot<Result>* next = new Slot<Result>();
+            next->value = init;
+            next->next = part->next;
+            part->next = next;
+            return next;
+        }
+        const Result& init;
+        Map& map;
+        Combine& combine;
+    };
+
+    // relaxed reduce: each worker folds whatever it visits into its own
+    // accumulator, padded so two workers never share a cache line
+    template<typename Result>
+    struct Accumulator
+    {
+        Result value;
+        char pad[64];
+    };
+
+    template<typename Result, typename Map, typename Combine>
+    struct RelaxedReduceWalker
+    {
+        typedef int Part;
+        void visit(Node<Key, Value>* node, Part /*part*/, unsigned worker)
+        {
+            Result& acc = accumulators[worker].value;
+            acc = combine(acc, map(node->getItem()));
+        }
+        Part split(Part part) { return part; }
+        std::vector<Accumulator<Result> >& accumulators;
+        Map& map;
+        Combine& combine;
+    };
+
+    // one task of a walk: in order over the subtree at start, or over start
+    // and its right subtree only when spine is false
+    template<typename Walker>
+    static void walkTask(const BinarySearchTree<Key, Value>* tree, Node<Key, Value>* start, bool spine,
+                         typename Walker::Part part, Walker* walker, WorkStealingPool* pool, unsigned worker);
+
+    static void pushLeftSpine(Node<Key, Value>* node, std::vector<Node<Key, Value>*>& stack);
+};
+
+/**
+* Inserts every item, as if by insert() in order (a later item with the same
+* key wins, and so do items over keys already in the tree), but in parallel:
+* items is sorted by key over threads threads, duplicate keys are dropped,
+* the balanced tree is built with its top levels split across threads, and
+* the result is merged into tree. On an empty tree the merge is O(1).
+* items is left sorted by key without duplicates; Key and Value must be
+* default constructible. threads defaults to one per core.
+* A multi tree (AVLMultiTree) keeps every item, as its insert() does: items
+* is then left sorted with duplicates in input order, and they land after
+* equal keys already in the tree (in counting mode, in their counts).
+*/
+template <typename Key, typename Value>
+void parallel_build(BinarySearchTree<Key, Value>& tree, std::vector<std::pair<Key, Value> >& items,
+                    unsigned threads = 0)
+{
+    ParallelTreeOps<Key, Value>::build(tree, items, threads);
+}
+
+/**
+* Calls fn(item) once on every item, from up to threads threads at once and in
+* no particular order; fn may change values but not keys. Work is split along
+* subtrees and balanced by work stealing, so unbalanced trees scale too.
+* For output in key order use parallel_reduce with ordered set.
+*/
+template <typename Key, typename Value, typename Function>
+void parallel_for_each(BinarySearchTree<Key, Value>& tree, Function fn, unsigned threads = 0)
+{
+    ParallelTreeOps<Key, Value>::forEach(tree, fn, threads);
+}
+
+/**
+* Folds map(item) over every item with combine, starting from init, which
+* must be combine's identity (0 for a sum, an empty vector for a concatenation).
+* With ordered set, combine only has to be associative: results are combined in
+* key order, so e.g. concatenating gives the items sorted. Otherwise combine
+* must also be commutative, and each thread folds what it visits in whatever
+* order, which saves combining one partial result per split.
+* map and combine are called from several threads at once.
+*/
+template <typename Key, typename Value, typename Result, typename Map, typename Combine>
+Result parallel_reduce(const BinarySearchTree<Key, Value>& tree, const Result& init, Map map, Combine combine,
+                       bool ordered = true, unsigned threads = 0)
+{
+    return ParallelTreeOps<Key, Value>::reduce(tree, init, map, combine, ordered, threads);
+}
+
+/*
+----------------------------------------------
+Begin implementations for the WorkStealingPool class.
+----------------------------------------------
+*/
+
+inline WorkStealingPool::WorkStealingPool(unsigned threads)
+    : pending_(0), idle_(0)
+{
+    for(unsigned i = 0; i < (threads == 0 ? 1 : threads); ++i) {
+        workers_.push_back(std::unique_ptr<Worker>(new Worker()));
+        workers_.back()->queued = 0;
+    }
+}
+
+inline void WorkStealingPool::run(const Task& task)
+{
+    pending_ = 0;
+    idle_ = 0;
+    error_ = std::exception_ptr();
+    spawn(0, task);
+
+    std::vector<std::thread> threads;
+    for(unsigned i = 1; i < workers_.size(); ++i) {
+        threads.push_back(std::thread(&WorkStealingPool::work, this, i));
+    }
+    work(0);
+    for(size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    if(error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+inline void WorkStealingPool::spawn(unsigned worker, const Task& task)
+{
+    ++pending_;
+    Worker& w = *workers_[worker];
+    std::lock_guard<std::mutex> guard(w.lock);
+    w.tasks.push_back(task);
+    ++w.queued;
+}
+
+inline bool WorkStealingPool::hungry(unsigned worker) const
+{
+    return idle_.load(std::memory_order_relaxed) != 0
+        && workers_[worker]->queued.load(std::memory_order_relaxed) == 0;
+}
+
+inline unsigned WorkStealingPool::size() const
+{
+    return workers_.size();
+}
+
+inline bool WorkStealingPool::take(unsigned self, Task& task)
+{
+    for(unsigned i = 0; i < workers_.size(); ++i) {
+        Worker& w = *workers_[(self + i) % workers_.size()];
+        std::lock_guard<std::mutex> guard(w.lock);
+        if(w.tasks.empty()) {
+            continue;
+        }
+        // our own newest task, or the victim's oldest
+        if(i == 0) {
+            task = w.tasks.back();
+            w.tasks.pop_back();
+        }
+        else {
+            task = w.tasks.front();
+            w.tasks.pop_front();
+        }
+        --w.queued;
+        return true;
+    }
+    return false;
+}
+
+// helper - run tasks until none are queued or running anywhere
+inline void WorkStealingPool::work(unsigned self)
+{
+    bool idle = false;
+    while(true) {
+        Task task;
+        if(take(self, task)) {
+            if(idle) {
+                --idle_;
+                idle = false;
+            }
+            try {
+                task(self);
+            }
+            catch(...) {
+                std::lock_guard<std::mutex> guard(errorLock_);
+                if(!error_) { error_ = std::current_exception(); }
+            }
+            --pending_;
+        }
+        else {
+            if(pending_ == 0) { break; }
+            if(!idle) {
+                ++idle_;
+                idle = true;
+            }
+            std::this_thread::yield();
+        }
+    }
+    if(idle) { --idle_; }
+}
+
+/*
+--------------------------------------------
+End implementations for the WorkStealingPool class.
+--------------------------------------------
+*/
+
+/*
+----------------------------------------------
+Begin implementations for the ParallelTreeOps class.
+----------------------------------------------
+*/
+
+template<typename Key, typename Value>
+void ParallelTreeOps<Key, Value>::build(BinarySearchTree<Key, Value>& tree, std::vector<Item>& items,
+                                        unsigned threads)
+{
+    threads = threadCount(threads);
+    sortUnique(items, threads, !tree.keepsDuplicates());
+    if(items.empty()) { return; }
+
+    // a middle-split build of n items is as tall as n has bits
+    int treeHeight = 0;
+    for(size_t n = items.size(); n != 0; n >>= 1) { ++treeHeight; }
+    int spawnDepth = 0;
+    while(((unsigned)1 << spawnDepth) < threads) { ++spawnDepth; }
+    if(items.size() < SERIAL_CUTOFF) { spawnDepth = 0; }
+
+    int height = 0;
+    Node<Key, Value>* root = buildRange(tree, items, 0, items.size(), 0, treeHeight, spawnDepth, height);
+    tree.absorbNodes(root, tree);
+}
+
+template<typename Key, typename Value>
+template<typename Function>
+void ParallelTreeOps<Key, Value>::forEach(BinarySearchTree<Key, Value>& tree, Function& fn, unsigned threads)
+{
+    if(tree.root_ == NULL) { return; }
+
+    WorkStealingPool pool(threadCount(threads));
+    ForEachWalker<Function> walker = { fn };
+    pool.run(std::bind(&walkTask<ForEachWalker<Function> >, &tree, tree.root_, true, 0, &walker, &pool,
+                       std::placeholders::_1));
+}
+
+template<typename Key, typename Value>
+template<typename Result, typename Map, typename Combine>
+Result ParallelTreeOps<Key, Value>::reduce(const BinarySearchTree<Key, Value>& tree, const Result& init, Map& map,
+                                           Combine& combine, bool ordered, unsigned threads)
+{
+    if(tree.root_ == NULL) { return init; }
+    WorkStealingPool pool(threadCount(threads));
+
+    if(!ordered) {
+        std::vector<Accumulator<Result> > accumulators(pool.size());
+        for(size_t i = 0; i < accumulators.size(); ++i) {
+            accumulators[i].value = init;
+        }
+        RelaxedReduceWalker<Result, Map, Combine> walker = { accumulators, map, combine };
+        pool.run(std::bind(&walkTask<RelaxedReduceWalker<Result, Map, Combine> >, &tree, tree.root_, true, 0,
+                           &walker, &pool, std::placeholders::_1));
+
+        Result result = accumulators[0].value;
+        for(size_t i = 1; i < accumulators.size(); ++i) {
+            result = combine(result, accumulators[i].value);
+        }
+        return result;
+    }
+
+    Slot<Result>* head = new Slot<Result>();
+    head->value = init;
+    head->next = NULL;
+    OrderedReduceWalker<Result, Map, Combine> walker = { init, map, combine };
+    try {
+        pool.run(std::bind(&walkTask<OrderedReduceWalker<Result, Map, Combine> >, &tree, tree.root_, true, head,
+                           &walker, &pool, std::placeholders::_1));
+    }
+    catch(...) {
+        while(head != NULL) {
+            Slot<Result>* next = head->next;
+            delete head;
+            head = next;
+        }
+        throw;
+    }
+
+    Result result = head->value;
+    for(Slot<Result>* slot = head->next; slot != NULL; slot = slot->next) {
+        result = combine(result, slot->value);
+    }
+    while(head != NULL) {
+        Slot<Result>* next = head->next;
+        delete head;
+        head = next;
+    }
+    return result;
+}
+
+template<typename Key, typename Value>
+unsigned ParallelTreeOps<Key, Value>::threadCount(unsigned threads)
+{
+    if(threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    return (threads == 0) ? 1 : threads;
+}
+
+template<typename Key, typename Value>
+void ParallelTreeOps<Key, Value>::runParallel(size_t count, unsigned threads,
+                                              const std::function<void(size_t)>& task)
+{
+    std::atomic<size_t> next(0);
+    std::function<void()> worker = [&]() {
+        for(size_t i = next++; i < count; i = next++) {
+            task(i);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for(size_t i = 1; i < threads && i < count; ++i) {
+        pool.push_back(std::thread(worker));
+    }
+    worker();
+    for(size_t i = 0; i < pool.size(); ++i) {
+        pool[i].join();
+    }
+}
+
+/**
+* Sorts one chunk per thread, then merges pairs of runs until one is left.
+* Each merge is split into independent pieces at evenly spaced items of the
+* first run, so every round keeps all threads busy. std::merge and the split
+* both put the first run's items ahead of equal keys from the second, so the
+* sort is stable and the last item of each key is the last one given.
+*/
+template<typename Key, typename Value>
+void ParallelTreeOps<Key, Value>::sortUnique(std::vector<Item>& items, unsigned threads, bool unique)
+{
+    size_t n = items.size();
+    if(threads <= 1 || n < SERIAL_CUTOFF) {
+        std::stable_sort(items.begin(), items.end(), keyLess);
+        if(!unique) { return; }
+        size_t kept = 0;
+        for(size_t i = 0; i < n; ++i) {
+            if(i + 1 == n || keyLess(items[i], items[i + 1])) {
+                if(kept != i) { items[kept] = items[i]; }
+                ++kept;
+            }
+        }
+        items.resize(kept);
+        return;
+    }
+
+    // sort one chunk per thread
+    std::vector<size_t> runs;
+    for(size_t i = 0; i <= threads; ++i) {
+        runs.push_back(n * i / threads);
+    }
+    runParallel(threads, threads, [&](size_t i) {
+        std::stable_sort(items.begin() + runs[i], items.begin() + runs[i + 1], keyLess);
+    });
+
+    // merge rounds, ping-ponging between items and scratch
+    std::vector<Item> scratch(n);
+    while(runs.size() > 2) {
+        size_t pairs = (runs.size() - 1) / 2;
+        size_t pieces = std::max<size_t>(1, threads / pairs);
+
+        // piece p of pair j merges items[a[p], a[p+1]) with items[b[p], b[p+1])
+        std::vector<size_t> aBounds;
+        std::vector<size_t> bBounds;
+        for(size_t j = 0; j < pairs; ++j) {
+            size_t aLo = runs[2 * j];
+            size_t aHi = runs[2 * j + 1];
+            size_t bHi = runs[2 * j + 2];
+            for(size_t p = 0; p <= pieces; ++p) {
+                size_t a = aLo + (aHi - aLo) * p / pieces;
+                size_t b = (p == 0) ? aHi : (p == pieces) ? bHi
+                    : std::lower_bound(items.begin() + aHi, items.begin() + bHi, items[a], keyLess) - items.begin();
+                aBounds.push_back(a);
+                bBounds.push_back(b);
+            }
+        }
+        runParallel(pairs * pieces, threads, [&](size_t t) {
+            size_t k = (t / pieces) * (pieces + 1) + t % pieces;
+            size_t out = aBounds[k] + (bBounds[k] - aBounds[(t / pieces) * (pieces + 1) + pieces]);
+            std::merge(items.begin() + aBounds[k], items.begin() + aBounds[k + 1],
+                       items.begin() + bBounds[k], items.begin() + bBounds[k + 1],
+                       scratch.begin() + out, keyLess);
+        });
+
+        // an odd run out is carried over as it is
+        std::vector<size_t> merged;
+        for(size_t j = 0; j < pairs; ++j) {
+            merged.push_back(runs[2 * j]);
+        }
+        if((runs.size() - 1) % 2 == 1) {
+            size_t lo = runs[runs.size() - 2];
+            std::copy(items.begin() + lo, items.end(), scratch.begin() + lo);
+            merged.push_back(lo);
+        }
+        merged.push_back(n);
+        runs.swap(merged);
+        items.swap(scratch);
+    }
+
+    if(!unique) { return; }
+
+    // drop all but the last of each key: count per chunk, then copy to offsets
+    std::vector<size_t> kept(threads + 1, 0);
+    runParallel(threads, threads, [&](size_t c) {
+        for(size_t i = n * c / threads; i < n * (c + 1) / threads; ++i) {
+            if(i + 1 == n || keyLess(items[i], items[i + 1])) { ++kept[c + 1]; }
+        }
+    });
+    for(size_t c = 0; c < threads; ++c) {
+        kept[c + 1] += kept[c];
+    }
+    runParallel(threads, threads, [&](size_t c) {
+        size_t out = kept[c];
+        for(size_t i = n * c / threads; i < n * (c + 1) / threads; ++i) {
+            if(i + 1 == n || keyLess(items[i], items[i + 1])) { scratch[out++] = items[i]; }
+        }
+    });
+    scratch.resize(kept[threads]);
+    items.swap(scratch);
+}
+
+template<typename Key, typename Value>
+bool ParallelTreeOps<Key, Value>::keyLess(const Item& a, const Item& b)
+{
+    return a.first < b.first;
+}
+
+// helper - the middle item becomes the root, as in AVLTree::buildBalanced
+template<typename Key, typename Value>
+Node<Key, Value>* ParallelTreeOps<Key, Value>::buildRange(BinarySearchTree<Key, Value>& tree,
+                                                          const std::vector<Item>& items, size_t lo, size_t hi,
+                                                          int depth, int treeHeight, int spawnDepth, int& height)
+{
+    // base case: empty range
+    if(lo >= hi) {
+        height = 0;
+        return NULL;
+    }
+
+    size_t mid = lo + (hi - lo) / 2;
+    Node<Key, Value>* root = tree.createBuildNode(items[mid].first, items[mid].second);
+    Node<Key, Value>* left = NULL;
+    Node<Key, Value>* right = NULL;
+    int leftH = 0;
+    int rightH = 0;
+
+    if(depth < spawnDepth) {
+        std::thread leftThread([&]() {
+            left = buildRange(tree, items, lo, mid, depth + 1, treeHeight, spawnDepth, leftH);
+        });
+        right = buildRange(tree, items, mid + 1, hi, depth + 1, treeHeight, spawnDepth, rightH);
+        leftThread.join();
+    }
+    else {
+        left = buildRange(tree, items, lo, mid, depth + 1, treeHeight, spawnDepth, leftH);
+        right = buildRange(tree, items, mid + 1, hi, depth + 1, treeHeight, spawnDepth, rightH);
+    }
+
+    root->setLeft(left);
+    root->setRight(right);
+    if(left != NULL) { left->setParent(root); }
+    if(right != NULL) { right->setParent(root); }
+    tree.finishBuildNode(root, leftH, rightH, depth, treeHeight);
+
+    height = std::max(leftH, rightH) + 1;
+    return root;
+}
+
+/**
+* Iterative in-order walk. The stack holds the nodes still to visit, each
+* followed by its right subtree, so its bottom entry covers the keys this task
+* reaches last. When a worker is idle that entry is handed to a new task; the
+* rest of this task's keys all come before it.
+*/
+template<typename Key, typename Value>
+template<typename Walker>
+void ParallelTreeOps<Key, Value>::walkTask(const BinarySearchTree<Key, Value>* tree, Node<Key, Value>* start,
+                                           bool spine, typename Walker::Part part, Walker* walker,
+                                           WorkStealingPool* pool, unsigned worker)
+{
+    std::vector<Node<Key, Value>*> stack;
+    if(spine) {
+        pushLeftSpine(start, stack);
+    }
+    else {
+        stack.push_back(start);
+    }
+
+    while(!stack.empty()) {
+        if(stack.size() > 1 && pool->hungry(worker)) {
+            Node<Key, Value>* tail = stack.front();
+            stack.erase(stack.begin());
+            pool->spawn(worker, std::bind(&walkTask<Walker>, tree, tail, false, walker->split(part), walker, pool,
+                                          std::placeholders::_1));
+        }
+
+        Node<Key, Value>* node = stack.back();
+        stack.pop_back();
+        if(!tree->isHiddenNode(node)) {
+            walker->visit(node, part, worker);
+        }
+        pushLeftSpine(node->getRight(), stack);
+    }
+}
+
+template<typename Key, typename Value>
+void ParallelTreeOps<Key, Value>::pushLeftSpine(Node<Key, Value>* node, std::vector<Node<Key, Value>*>& stack)
+{
+    for( ; node != NULL; node = node->getLeft()) {
+        stack.push_back(node);
+    }
+}
+
+/*
+--------------------------------------------
+End implementations for the ParallelTreeOps class.
+--------------------------------------------
+*/
+
+#endif
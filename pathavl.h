@@ -0,0 +1,540 @@
+#ifndef PATHAVL_H
+#define PATHAVL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <utility>
+
+/**
+* A node without a parent pointer (and without a vptr). Code that needs to walk
+* back up the tree records the path on the way down instead.
+*/
+template <typename Key, typename Value>
+struct PathNode
+{
+    PathNode(const Key& key, const Value& value) :
+        item(key, value), left(NULL), right(NULL), balance(0)
+    {
+
+    }
+
+    std::pair<const Key, Value> item;
+    PathNode<Key, Value>* left;
+    PathNode<Key, Value>* right;
+    int8_t balance;     // height(left) - height(right)
+};
+
+/**
+* An AVL tree built from PathNodes. It has the same interface as AVLTree, but
+* nodes are smaller (40 bytes instead of 56 for <uint64_t, uint64_t>), rotations
+* write fewer pointers, and insert/remove retrace along the recorded descent path.
+* Iterators carry an explicit stack of the ancestors they still have to visit.
+*/
+template <class Key, class Value>
+class PathAVLTree
+{
+public:
+    // deepest path we record; an AVL tree this tall would need over 10^13 nodes
+    static const int MAX_DEPTH = 64;
+
+    PathAVLTree();
+    ~PathAVLTree();
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool isBalanced() const;
+    bool empty() const;
+
+public:
+    /**
+    * An in-order iterator. The top of the stack is the current node; below it are
+    * the ancestors whose left subtree we are in, i.e. the nodes still to be visited.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key,Value>& operator*() const;
+        std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class PathAVLTree<Key, Value>;
+        void pushLeftSpine(PathNode<Key, Value>* node);
+        PathNode<Key, Value>* current() const;
+        PathNode<Key, Value>* stack_[MAX_DEPTH];
+        int depth_;
+    };
+
+public:
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    PathNode<Key, Value>* internalFind(const Key& key) const;
+
+    // the link that points at path[i]: the root pointer or a child pointer of path[i-1]
+    PathNode<Key, Value>*& linkTo(PathNode<Key, Value>** path, int i);
+
+    // rotations replace the subtree stored in slot
+    static void rotateL(PathNode<Key, Value>*& slot);
+    static void rotateR(PathNode<Key, Value>*& slot);
+
+    // single or double rotation for a node whose balance reached +-2
+    static void rotateFix(PathNode<Key, Value>*& slot);
+
+    // walk up the recorded path from index i after its child grew / shrank
+    void retraceInsert(PathNode<Key, Value>** path, int i, PathNode<Key, Value>* child);
+    void retraceRemove(PathNode<Key, Value>** path, int i, bool leftShrank);
+
+    // recursive helpers
+    void clearSubtree(PathNode<Key, Value>* node);
+    int checkHeight(PathNode<Key, Value>* node) const;
+
+    PathNode<Key, Value>* root_;
+};
+
+/*
+--------------------------------------------------
+Begin implementations for the PathAVLTree::iterator class.
+--------------------------------------------------
+*/
+
+template<class Key, class Value>
+PathAVLTree<Key, Value>::iterator::iterator()
+    : depth_(0)
+{
+
+}
+
+template<class Key, class Value>
+PathNode<Key, Value>* PathAVLTree<Key, Value>::iterator::current() const
+{
+    return depth_ == 0 ? NULL : stack_[depth_ - 1];
+}
+
+template<class Key, class Value>
+std::pair<const Key,Value>&
+PathAVLTree<Key, Value>::iterator::operator*() const
+{
+    return current()->item;
+}
+
+template<class Key, class Value>
+std::pair<const Key,Value>*
+PathAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(current()->item);
+}
+
+template<class Key, class Value>
+bool PathAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return current() == rhs.current();
+}
+
+template<class Key, class Value>
+bool PathAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return current() != rhs.current();
+}
+
+/**
+* Advances in-order: descend into the right subtree if there is one, otherwise
+* the next node is the ancestor below us on the stack.
+*/
+template<class Key, class Value>
+typename PathAVLTree<Key, Value>::iterator&
+PathAVLTree<Key, Value>::iterator::operator++()
+{
+    PathNode<Key, Value>* curr = stack_[--depth_];
+    pushLeftSpine(curr->right);
+    return *this;
+}
+
+// helper - push node and all of its left descendants
+template<class Key, class Value>
+void PathAVLTree<Key, Value>::iterator::pushLeftSpine(PathNode<Key, Value>* node)
+{
+    while(node != NULL) {
+        stack_[depth_++] = node;
+        node = node->left;
+    }
+}
+
+/*
+------------------------------------------------
+End implementations for the PathAVLTree::iterator class.
+------------------------------------------------
+*/
+
+/*
+----------------------------------------------
+Begin implementations for the PathAVLTree class.
+----------------------------------------------
+*/
+
+template<class Key, class Value>
+PathAVLTree<Key, Value>::PathAVLTree()
+    : root_(NULL)
+{
+
+}
+
+template<class Key, class Value>
+PathAVLTree<Key, Value>::~PathAVLTree()
+{
+    clear();
+}
+
+template<class Key, class Value>
+bool PathAVLTree<Key, Value>::empty() const
+{
+    return root_ == NULL;
+}
+
+template<class Key, class Value>
+typename PathAVLTree<Key, Value>::iterator
+PathAVLTree<Key, Value>::begin() const
+{
+    iterator it;
+    it.pushLeftSpine(root_);
+    return it;
+}
+
+template<class Key, class Value>
+typename PathAVLTree<Key, Value>::iterator
+PathAVLTree<Key, Value>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to key, or end(). The stack keeps only the ancestors we went
+* left from, since those are the ones the iterator still has to visit.
+*/
+template<class Key, class Value>
+typename PathAVLTree<Key, Value>::iterator
+PathAVLTree<Key, Value>::find(const Key& key) const
+{
+    iterator it;
+    PathNode<Key, Value>* curr = root_;
+    while(curr != NULL) {
+        if(key == curr->item.first) {
+            it.stack_[it.depth_++] = curr;
+            return it;
+        }
+        else if(key < curr->item.first) {
+            it.stack_[it.depth_++] = curr;
+            curr = curr->left;
+        }
+        else {
+            curr = curr->right;
+        }
+    }
+    return end();
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value>
+Value& PathAVLTree<Key, Value>::operator[](const Key& key)
+{
+    PathNode<Key, Value>* curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->item.second;
+}
+template<class Key, class Value>
+Value const & PathAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    PathNode<Key, Value>* curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->item.second;
+}
+
+/*
+ * If key is already in the tree, the current value is overwritten.
+ */
+template<class Key, class Value>
+void PathAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    PathNode<Key, Value>* path[MAX_DEPTH];
+    int depth = 0;
+
+    // find the insertion point, remembering every node on the way down
+    PathNode<Key, Value>* curr = root_;
+    while(curr != NULL) {
+        if(keyValuePair.first == curr->item.first) {
+            curr->item.second = keyValuePair.second;
+            return;
+        }
+        path[depth++] = curr;
+        curr = (keyValuePair.first < curr->item.first) ? curr->left : curr->right;
+    }
+
+    PathNode<Key, Value>* newNode = new PathNode<Key, Value>(keyValuePair.first, keyValuePair.second);
+    if(depth == 0) {
+        root_ = newNode;
+        return;
+    }
+
+    PathNode<Key, Value>* parent = path[depth - 1];
+    if(keyValuePair.first < parent->item.first) {
+        parent->left = newNode;
+    }
+    else {
+        parent->right = newNode;
+    }
+    retraceInsert(path, depth - 1, newNode);
+}
+
+/*
+ * A node with 2 children is replaced by its predecessor, matching the other trees.
+ */
+template<class Key, class Value>
+void PathAVLTree<Key, Value>::remove(const Key& key)
+{
+    PathNode<Key, Value>* path[MAX_DEPTH];
+    int depth = 0;
+
+    // find the node, recording the path to it
+    PathNode<Key, Value>* z = root_;
+    while(z != NULL && !(key == z->item.first)) {
+        path[depth++] = z;
+        z = (key < z->item.first) ? z->left : z->right;
+    }
+    if(z == NULL) { return; }
+
+    int zIndex = depth;
+    path[depth++] = z;
+
+    // case 1: 0 or 1 child - splice the child into z's place
+    if(z->left == NULL || z->right == NULL) {
+        PathNode<Key, Value>* child = (z->left != NULL) ? z->left : z->right;
+        bool leftShrank = zIndex > 0 && path[zIndex - 1]->left == z;
+        linkTo(path, zIndex) = child;
+        delete z;
+        retraceRemove(path, zIndex - 1, leftShrank);
+        return;
+    }
+
+    // case 2: 2 children - continue the path to the predecessor y
+    PathNode<Key, Value>* y = z->left;
+    path[depth++] = y;
+    while(y->right != NULL) {
+        y = y->right;
+        path[depth++] = y;
+    }
+
+    int retraceFrom;
+    bool leftShrank;
+    if(y == z->left) {
+        // y keeps its left subtree, which is one shorter than z's left side was
+        retraceFrom = zIndex;
+        leftShrank = true;
+    }
+    else {
+        // unlink y; its left child moves up into y's old spot
+        path[depth - 2]->right = y->left;
+        y->left = z->left;
+        retraceFrom = depth - 2;
+        leftShrank = false;
+    }
+
+    // y takes z's place, right subtree and balance
+    y->right = z->right;
+    y->balance = z->balance;
+    linkTo(path, zIndex) = y;
+    path[zIndex] = y;
+    delete z;
+
+    retraceRemove(path, retraceFrom, leftShrank);
+}
+
+/**
+* A method to remove all contents of the tree and
+* reset the values in the tree for use again.
+*/
+template<class Key, class Value>
+void PathAVLTree<Key, Value>::clear()
+{
+    clearSubtree(root_);
+    root_ = NULL;
+}
+
+template<class Key, class Value>
+void PathAVLTree<Key, Value>::clearSubtree(PathNode<Key, Value>* node)
+{
+    if(node == NULL) { return; }
+    clearSubtree(node->left);
+    clearSubtree(node->right);
+    delete node;
+}
+
+/**
+ * Return true iff every node's subtrees differ in height by at most 1.
+ */
+template<class Key, class Value>
+bool PathAVLTree<Key, Value>::isBalanced() const
+{
+    return checkHeight(root_) >= 0;
+}
+
+// helper - height of the subtree, or -1 if any node in it is unbalanced
+template<class Key, class Value>
+int PathAVLTree<Key, Value>::checkHeight(PathNode<Key, Value>* node) const
+{
+    if(node == NULL) { return 0; }
+    int leftH = checkHeight(node->left);
+    int rightH = checkHeight(node->right);
+    if(leftH < 0 || rightH < 0) { return -1; }
+    int diff = leftH - rightH;
+    if(diff > 1 || diff < -1) { return -1; }
+    return (leftH > rightH ? leftH : rightH) + 1;
+}
+
+template<class Key, class Value>
+PathNode<Key, Value>* PathAVLTree<Key, Value>::internalFind(const Key& key) const
+{
+    PathNode<Key, Value>* curr = root_;
+    while(curr != NULL) {
+        if(key == curr->item.first) {
+            return curr;
+        }
+        curr = (key < curr->item.first) ? curr->left : curr->right;
+    }
+    return NULL;
+}
+
+template<class Key, class Value>
+PathNode<Key, Value>*& PathAVLTree<Key, Value>::linkTo(PathNode<Key, Value>** path, int i)
+{
+    if(i == 0) {
+        return root_;
+    }
+    return (path[i - 1]->left == path[i]) ? path[i - 1]->left : path[i - 1]->right;
+}
+
+// helper - single left rotation: slot's right child takes its place
+template<class Key, class Value>
+void PathAVLTree<Key, Value>::rotateL(PathNode<Key, Value>*& slot)
+{
+    PathNode<Key, Value>* x = slot;
+    PathNode<Key, Value>* y = x->right;
+    x->right = y->left;
+    y->left = x;
+    slot = y;
+
+    // exact balance update for balance = height(left) - height(right)
+    int xb = x->balance + 1 - (y->balance < 0 ? y->balance : 0);
+    x->balance = (int8_t)xb;
+    y->balance = (int8_t)(y->balance + 1 + (xb > 0 ? xb : 0));
+}
+
+// helper - single right rotation: slot's left child takes its place
+template<class Key, class Value>
+void PathAVLTree<Key, Value>::rotateR(PathNode<Key, Value>*& slot)
+{
+    PathNode<Key, Value>* z = slot;
+    PathNode<Key, Value>* y = z->left;
+    z->left = y->right;
+    y->right = z;
+    slot = y;
+
+    int zb = z->balance - 1 - (y->balance > 0 ? y->balance : 0);
+    z->balance = (int8_t)zb;
+    y->balance = (int8_t)(y->balance - 1 + (zb < 0 ? zb : 0));
+}
+
+template<class Key, class Value>
+void PathAVLTree<Key, Value>::rotateFix(PathNode<Key, Value>*& slot)
+{
+    // left-heavy
+    if(slot->balance > 0) {
+        // left-right: straighten first
+        if(slot->left->balance < 0) {
+            rotateL(slot->left);
+        }
+        rotateR(slot);
+    }
+    // right-heavy
+    else {
+        // right-left: straighten first
+        if(slot->right->balance > 0) {
+            rotateR(slot->right);
+        }
+        rotateL(slot);
+    }
+}
+
+template<class Key, class Value>
+void PathAVLTree<Key, Value>::retraceInsert(PathNode<Key, Value>** path, int i, PathNode<Key, Value>* child)
+{
+    for(; i >= 0; --i) {
+        PathNode<Key, Value>* parent = path[i];
+        parent->balance += (parent->left == child) ? 1 : -1;
+
+        // subtree height unchanged
+        if(parent->balance == 0) {
+            return;
+        }
+        // +-2: one rotation brings the height back to what it was
+        if(parent->balance == 2 || parent->balance == -2) {
+            rotateFix(linkTo(path, i));
+            return;
+        }
+        // +-1: this subtree grew, keep going up
+        child = parent;
+    }
+}
+
+template<class Key, class Value>
+void PathAVLTree<Key, Value>::retraceRemove(PathNode<Key, Value>** path, int i, bool leftShrank)
+{
+    for(; i >= 0; --i) {
+        PathNode<Key, Value>* parent = path[i];
+        parent->balance += leftShrank ? -1 : 1;
+
+        // +-1: was 0, height unchanged
+        if(parent->balance == 1 || parent->balance == -1) {
+            return;
+        }
+
+        PathNode<Key, Value>* subtree = parent;
+        if(parent->balance != 0) {
+            PathNode<Key, Value>*& slot = linkTo(path, i);
+            rotateFix(slot);
+            subtree = slot;
+            // the new root leaning means the height did not change
+            if(subtree->balance != 0) {
+                return;
+            }
+        }
+
+        // this subtree got shorter, keep going up
+        if(i > 0) {
+            leftShrank = (path[i - 1]->left == subtree);
+        }
+    }
+}
+
+/*
+--------------------------------------------
+End implementations for the PathAVLTree class.
+--------------------------------------------
+*/
+
+#endif
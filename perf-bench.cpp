@@ -0,0 +1,121 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "bst.h"
+#include "avlbst.h"
+#include "rbbst.h"
+#include "compactavl.h"
+#include "pathavl.h"
+#include "perfcounters.h"
+
+using namespace std;
+
+// Usage: ./perf-bench [numKeys] [numLookups]
+//
+// Inserts numKeys random keys into each tree, looks up numLookups keys (half
+// hits, half misses), then removes every key in a different random order. For
+// each phase it prints the wall-clock time and the hardware counters per
+// operation: cycles, instructions, L1 data cache read misses, last level cache
+// misses and branch mispredictions. Counters the kernel will not provide
+// (no PMU in a VM, perf_event_paranoid, seccomp) print as "-"; the timings
+// are always reported.
+
+typedef chrono::steady_clock Clock;
+
+// prints one row: the phase's ns/op and each counter divided by numOps
+void report(const char* tree, const char* phase, size_t numOps, double seconds, const PerfCounters& counters)
+{
+    cout << left << setw(18) << tree << setw(8) << phase << right << fixed << setprecision(1)
+         << setw(10) << seconds * 1e9 / numOps;
+    for(int e = 0; e < PERF_EVENT_COUNT; ++e) {
+        if(counters.available((PerfEvent)e)) {
+            cout << setw(11) << (double)counters.read((PerfEvent)e) / numOps;
+        }
+        else {
+            cout << setw(11) << "-";
+        }
+    }
+    cout << endl;
+}
+
+template<typename Tree>
+void measure(const char* name, const vector<uint64_t>& keys, const vector<uint64_t>& lookups,
+             const vector<uint64_t>& removals, PerfCounters& counters)
+{
+    Tree tree;
+
+    Clock::time_point start = Clock::now();
+    counters.start();
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(make_pair(keys[i], (uint64_t)i));
+    }
+    counters.stop();
+    report(name, "insert", keys.size(), chrono::duration<double>(Clock::now() - start).count(), counters);
+
+    size_t found = 0;
+    start = Clock::now();
+    counters.start();
+    for(size_t i = 0; i < lookups.size(); ++i) {
+        if(tree.find(lookups[i]) != tree.end()) {
+            ++found;
+        }
+    }
+    counters.stop();
+    report(name, "find", lookups.size(), chrono::duration<double>(Clock::now() - start).count(), counters);
+
+    start = Clock::now();
+    counters.start();
+    for(size_t i = 0; i < removals.size(); ++i) {
+        tree.remove(removals[i]);
+    }
+    counters.stop();
+    report(name, "remove", removals.size(), chrono::duration<double>(Clock::now() - start).count(), counters);
+
+    // keeps the lookups from being optimized away
+    if(found > lookups.size()) { cout << found << endl; }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t numKeys = 200000;
+    size_t numLookups = 1000000;
+    if(argc > 1) { numKeys = strtoul(argv[1], NULL, 10); }
+    if(argc > 2) { numLookups = strtoul(argv[2], NULL, 10); }
+    if(numKeys == 0) { numKeys = 1; }
+
+    mt19937_64 gen(430);
+    vector<uint64_t> keys(numKeys);
+    for(size_t i = 0; i < numKeys; ++i) {
+        keys[i] = gen();
+    }
+    vector<uint64_t> lookups(numLookups);
+    for(size_t i = 0; i < numLookups; ++i) {
+        lookups[i] = (i % 2) ? keys[gen() % numKeys] : gen();
+    }
+    vector<uint64_t> removals(keys);
+    shuffle(removals.begin(), removals.end(), gen);
+
+    PerfCounters counters;
+    cout << "keys: " << numKeys << ", lookups: " << numLookups << ", counters:";
+    for(int e = 0; e < PERF_EVENT_COUNT; ++e) {
+        cout << " " << PerfCounters::name((PerfEvent)e)
+             << (counters.available((PerfEvent)e) ? "" : " (unavailable)");
+    }
+    cout << endl;
+    cout << left << setw(18) << "tree" << setw(8) << "op" << right << setw(10) << "ns/op";
+    for(int e = 0; e < PERF_EVENT_COUNT; ++e) {
+        cout << setw(11) << PerfCounters::name((PerfEvent)e);
+    }
+    cout << endl;
+
+    measure<BinarySearchTree<uint64_t, uint64_t> >("BinarySearchTree", keys, lookups, removals, counters);
+    measure<AVLTree<uint64_t, uint64_t> >("AVLTree", keys, lookups, removals, counters);
+    measure<RedBlackTree<uint64_t, uint64_t> >("RedBlackTree", keys, lookups, removals, counters);
+    measure<PathAVLTree<uint64_t, uint64_t> >("PathAVLTree", keys, lookups, removals, counters);
+    measure<CompactAVLTree<uint64_t, uint64_t> >("CompactAVLTree", keys, lookups, removals, counters);
+    return 0;
+}
@@ -0,0 +1,204 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/**
+* The hardware events PerfCounters can count.
+*/
+enum PerfEvent
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_EVENT_COUNT
+};
+
+/**
+* Hardware performance counters for the calling thread, read through
+* perf_event_open(2) on Linux. Each event is opened on its own, so a machine
+* (or VM, or container) that lacks one event still counts the rest; an event
+* that cannot be opened, for any reason, is simply unavailable and reads as 0.
+* Elsewhere than Linux nothing is ever available.
+*
+* Only user-space work is counted, which also lets the counters open under
+* the default perf_event_paranoid setting. When the kernel has to multiplex
+* more events than the PMU has registers, read() scales the raw count by the
+* fraction of time the event was actually counting since start(). Resetting a
+* counter zeroes its count but not its times, so start() notes the times and
+* read() scales by how much they grew.
+*/
+class PerfCounters
+{
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    bool available(PerfEvent event) const;
+    bool anyAvailable() const;
+
+    // zero and start every available counter
+    void start();
+    // stop every available counter; reads afterwards see the final counts
+    void stop();
+    uint64_t read(PerfEvent event) const;
+
+    static const char* name(PerfEvent event);
+
+private:
+    // the counters are owned file descriptors
+    PerfCounters(const PerfCounters&);
+    PerfCounters& operator=(const PerfCounters&);
+
+    // value, time enabled, time running; false if the read fails
+    bool readRaw(PerfEvent event, uint64_t data[3]) const;
+
+    int fds_[PERF_EVENT_COUNT];
+    // time enabled and time running as of the last start()
+    uint64_t enabledAt_[PERF_EVENT_COUNT];
+    uint64_t runningAt_[PERF_EVENT_COUNT];
+};
+
+/*
+----------------------------------------------
+Begin implementations for the PerfCounters class.
+----------------------------------------------
+*/
+
+inline PerfCounters::PerfCounters()
+{
+    for(int i = 0; i < PERF_EVENT_COUNT; ++i) {
+        fds_[i] = -1;
+        enabledAt_[i] = 0;
+        runningAt_[i] = 0;
+    }
+#ifdef __linux__
+    const uint32_t types[PERF_EVENT_COUNT] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+    };
+    const uint64_t configs[PERF_EVENT_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for(int i = 0; i < PERF_EVENT_COUNT; ++i) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = types[i];
+        attr.config = configs[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        // this thread, any CPU, no group
+        fds_[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+}
+
+inline PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+    for(int i = 0; i < PERF_EVENT_COUNT; ++i) {
+        if(fds_[i] >= 0) { close(fds_[i]); }
+    }
+#endif
+}
+
+inline bool PerfCounters::available(PerfEvent event) const
+{
+    return fds_[event] >= 0;
+}
+
+inline bool PerfCounters::anyAvailable() const
+{
+    for(int i = 0; i < PERF_EVENT_COUNT; ++i) {
+        if(fds_[i] >= 0) { return true; }
+    }
+    return false;
+}
+
+inline void PerfCounters::start()
+{
+#ifdef __linux__
+    for(int i = 0; i < PERF_EVENT_COUNT; ++i) {
+        if(fds_[i] >= 0) {
+            ioctl(fds_[i], PERF_EVENT_IOC_RESET, 0);
+            uint64_t data[3];
+            if(readRaw((PerfEvent)i, data)) {
+                enabledAt_[i] = data[1];
+                runningAt_[i] = data[2];
+            }
+            ioctl(fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+inline void PerfCounters::stop()
+{
+#ifdef __linux__
+    for(int i = 0; i < PERF_EVENT_COUNT; ++i) {
+        if(fds_[i] >= 0) {
+            ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+#endif
+}
+
+inline uint64_t PerfCounters::read(PerfEvent event) const
+{
+    uint64_t data[3];
+    if(!readRaw(event, data)) { return 0; }
+    uint64_t enabled = data[1] - enabledAt_[event];
+    uint64_t running = data[2] - runningAt_[event];
+    if(running == 0) {
+        return 0;
+    }
+    if(running == enabled) {
+        return data[0];
+    }
+    return (uint64_t)((double)data[0] * ((double)enabled / (double)running));
+}
+
+// helper - one read(2) of the counter and its times
+inline bool PerfCounters::readRaw(PerfEvent event, uint64_t data[3]) const
+{
+#ifdef __linux__
+    return fds_[event] >= 0 && ::read(fds_[event], data, 3 * sizeof(uint64_t)) == (ssize_t)(3 * sizeof(uint64_t));
+#else
+    (void)event;
+    (void)data;
+    return false;
+#endif
+}
+
+inline const char* PerfCounters::name(PerfEvent event)
+{
+    static const char* const names[PERF_EVENT_COUNT] = {
+        "cycles", "instr", "L1d miss", "LLC miss", "br miss"
+    };
+    return names[event];
+}
+
+/*
+--------------------------------------------
+End implementations for the PerfCounters class.
+--------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,594 @@
+#ifndef RBBST_H
+#define RBBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include "bst.h"
+
+/**
+* A special kind of node for a Red-Black tree, which adds the color as a data member.
+* The color lives in the padding after the Node pointers, so a RBNode is the same
+* size as an AVLNode.
+*/
+template <typename Key, typename Value>
+class RBNode : public Node<Key, Value>
+{
+public:
+    // Constructor/destructor.
+    RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent);
+    virtual ~RBNode();
+
+    // Getters/setters for the node's color. New nodes are red.
+    bool isRed() const;
+    void setRed(bool red);
+
+    // Getters for parent, left, and right. These need to be redefined since they
+    // return pointers to RBNodes - not plain Nodes. See the Node class in bst.h
+    // for more information.
+    virtual RBNode<Key, Value>* getParent() const override;
+    virtual RBNode<Key, Value>* getLeft() const override;
+    virtual RBNode<Key, Value>* getRight() const override;
+
+protected:
+    bool red_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the RBNode class.
+  -------------------------------------------------
+*/
+
+/**
+* An explicit constructor to initialize the elements by calling the base class constructor
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(const Key& key, const Value& value, RBNode<Key, Value> *parent) :
+    Node<Key, Value>(key, value, parent), red_(true)
+{
+
+}
+
+/**
+* A destructor which does nothing.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::~RBNode()
+{
+
+}
+
+/**
+* A getter for the color of a RBNode.
+*/
+template<class Key, class Value>
+bool RBNode<Key, Value>::isRed() const
+{
+    return red_;
+}
+
+/**
+* A setter for the color of a RBNode.
+*/
+template<class Key, class Value>
+void RBNode<Key, Value>::setRed(bool red)
+{
+    red_ = red;
+}
+
+/**
+* An overridden function for getting the parent since a static_cast is necessary to make sure
+* that our node is a RBNode.
+*/
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getParent() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->parent_);
+}
+
+/**
+* Overridden for the same reasons as above.
+*/
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getLeft() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->left_);
+}
+
+/**
+* Overridden for the same reasons as above.
+*/
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getRight() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->right_);
+}
+
+
+/*
+  -----------------------------------------------
+  End implementations for the RBNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A Red-Black tree. Compared to AVLTree it keeps a looser balance (height at most
+* 2*log(n+1)), which bounds the work per update to at most 2 rotations for an insert
+* and 3 rotations for a remove. Prefer it over AVLTree for write-heavy workloads.
+*/
+template <class Key, class Value>
+class RedBlackTree : public BinarySearchTree<Key, Value>
+{
+public:
+    virtual std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+        insert (const std::pair<const Key, Value> &new_item);
+    virtual void remove(const Key& key);
+    // the root is black, no red node has a red child, and every path from the
+    // root to a NULL passes the same number of black nodes
+    bool isRedBlack() const;
+protected:
+    virtual void nodeSwap( RBNode<Key,Value>* n1, RBNode<Key,Value>* n2);
+
+    // single-descent insert: link a new red leaf and fix up, O(log n)
+    virtual Node<Key,Value>* findOrCreate(const Key& key, const Value& value, bool& created);
+
+    // relink the nodes of another RedBlackTree one by one as red leaves
+    virtual void absorbNodes(Node<Key,Value>* root, const BinarySearchTree<Key, Value>& source);
+
+    // bulk building: a balanced build is a valid red-black tree when only its
+    // deepest level is red
+    virtual Node<Key,Value>* createBuildNode(const Key& key, const Value& value);
+    virtual void finishBuildNode(Node<Key,Value>* node, int leftH, int rightH, int depth, int treeHeight);
+    // exporters show each node's color
+    virtual void annotateNode(Node<Key,Value>* node, std::vector<std::pair<const char*, int> >& fields) const;
+
+    // Add helper functions here
+        // NULL leaves count as black
+        static bool isRed(RBNode<Key,Value>* node);
+
+        // recursive helper for isRedBlack: black height of the subtree, or -1
+        // if a red node in it has a red child or two of its paths differ
+        int blackHeight(RBNode<Key,Value>* node) const;
+
+        // rotations
+        void rotateL(RBNode<Key,Value>* node);
+        void rotateR(RBNode<Key,Value>* node);
+
+        // restore the red-black properties after inserting a red node
+        void insertFix(RBNode<Key,Value>* node);
+
+        // restore the red-black properties after unlinking a black node.
+        // node is the (possibly NULL) child that took its place.
+        void removeFix(RBNode<Key,Value>* node, RBNode<Key,Value>* parent);
+};
+
+/*
+ * Recall: If key is already in the tree, you should
+ * overwrite the current value with the updated value.
+ */
+template<class Key, class Value>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+RedBlackTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
+{
+    return this->insertItem(new_item);
+}
+
+template<class Key, class Value>
+Node<Key,Value>* RedBlackTree<Key, Value>::findOrCreate(const Key& key, const Value& value, bool& created)
+{
+    created = false;
+    // base case: empty tree - new (black) root
+    if(this->root_ == NULL) {
+        RBNode<Key,Value>* newRoot = new RBNode<Key,Value>(key, value, NULL);
+        newRoot->setRed(false);
+        this->root_ = newRoot;
+        created = true;
+        return newRoot;
+    }
+
+    // standard BST descent with RBNode
+    Node<Key,Value>* curr = this->root_;
+    Node<Key,Value>* parent = NULL;
+
+    while(curr != NULL) {
+        parent = curr;
+        // key already exists - no structural change
+        if(key == curr->getKey()) {
+            return curr;
+        }
+        // new key is smaller - go left
+        else if(key < curr->getKey()) {
+            curr = curr->getLeft();
+        }
+        // new key is larger - go right
+        else {
+            curr = curr->getRight();
+        }
+    }
+
+    RBNode<Key,Value>* rbP = static_cast<RBNode<Key,Value>*>(parent);
+    RBNode<Key,Value>* newN = new RBNode<Key,Value>(key, value, rbP);
+
+    // insert new node as left or right child
+    if(key < parent->getKey()) {
+        parent->setLeft(newN);
+    }
+    else {
+        parent->setRight(newN);
+    }
+
+    // fix any red-red violation from the new node up
+    insertFix(newN);
+    created = true;
+    return newN;
+}
+
+/*
+ * Recall: The writeup specifies that if a node has 2 children you
+ * should swap with the predecessor and then remove.
+ */
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::remove(const Key& key)
+{
+    RBNode<Key,Value>* rNode = static_cast<RBNode<Key,Value>*>(this->internalFind(key));
+
+    // base case: key not found, no removal
+    if(rNode == NULL) {return;}
+
+    // case 1: node has 2 children - swap with predecessor (colors stay with the positions)
+    if(rNode->getLeft() != NULL && rNode->getRight() != NULL) {
+        RBNode<Key,Value>* pred = static_cast<RBNode<Key,Value>*>(BinarySearchTree<Key,Value>::predecessor(rNode));
+        nodeSwap(rNode, pred);
+    }
+
+    // case 2: 0 or 1 child
+    RBNode<Key,Value>* parent = rNode->getParent();
+    RBNode<Key,Value>* child = rNode->getLeft();
+    if(child == NULL) {
+        child = rNode->getRight();
+    }
+
+    // if child exists - update parent
+    if(child != NULL) {
+        child->setParent(parent);
+    }
+
+    // reconnect parent to child
+    if(parent == NULL) {
+        this->root_ = child;
+    }
+    else if(parent->getLeft() == rNode) {
+        parent->setLeft(child);
+    }
+    else {
+        parent->setRight(child);
+    }
+
+    // removing a red node never changes black heights
+    bool removedBlack = !rNode->isRed();
+    delete rNode;
+
+    if(removedBlack) {
+        removeFix(child, parent);
+    }
+}
+
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::nodeSwap( RBNode<Key,Value>* n1, RBNode<Key,Value>* n2)
+{
+    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+    bool tempRed = n1->isRed();
+    n1->setRed(n2->isRed());
+    n2->setRed(tempRed);
+}
+
+/**
+* Nodes released by a tree of the same type are reused: each is recolored red
+* and linked in as a new leaf, then insertFix runs as for a normal insert. Any
+* other source is copied with insert(), as in BinarySearchTree::absorbNodes.
+*/
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::absorbNodes(Node<Key,Value>* root, const BinarySearchTree<Key, Value>& source)
+{
+    if(typeid(source) != typeid(*this)) {
+        this->absorbByInsert(root);
+        return;
+    }
+    // a valid red-black tree on its own
+    if(this->root_ == NULL) {
+        this->root_ = root;
+        return;
+    }
+
+    // collect first: relinking would break the successor walk
+    std::vector<RBNode<Key,Value>*> nodes;
+    Node<Key,Value>* curr = root;
+    while(curr->getLeft() != NULL) { curr = curr->getLeft(); }
+    for( ; curr != NULL; curr = BinarySearchTree<Key, Value>::successor(curr)) {
+        nodes.push_back(static_cast<RBNode<Key,Value>*>(curr));
+    }
+
+    for(size_t i = 0; i < nodes.size(); ++i) {
+        RBNode<Key,Value>* node = nodes[i];
+        Node<Key,Value>* parent = NULL;
+        curr = this->root_;
+        while(curr != NULL && curr->getKey() != node->getKey()) {
+            parent = curr;
+            curr = (node->getKey() < curr->getKey()) ? curr->getLeft() : curr->getRight();
+        }
+
+        // key already here - take the value only
+        if(curr != NULL) {
+            curr->setValue(node->getValue());
+            delete node;
+            continue;
+        }
+
+        node->setLeft(NULL);
+        node->setRight(NULL);
+        node->setParent(parent);
+        node->setRed(true);
+        if(node->getKey() < parent->getKey()) {
+            parent->setLeft(node);
+        }
+        else {
+            parent->setRight(node);
+        }
+        insertFix(node);
+    }
+}
+
+template<class Key, class Value>
+Node<Key,Value>* RedBlackTree<Key, Value>::createBuildNode(const Key& key, const Value& value)
+{
+    return new RBNode<Key,Value>(key, value, NULL);
+}
+
+/**
+* Every level of a balanced build is full except possibly the deepest, so all
+* paths down to a NULL pass the same number of nodes above that level. Those
+* are black; the deepest level is red (unless it is the root) and has no children.
+*/
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::finishBuildNode(Node<Key,Value>* node, int /*leftH*/, int /*rightH*/, int depth, int treeHeight)
+{
+    static_cast<RBNode<Key,Value>*>(node)->setRed(depth > 0 && depth == treeHeight - 1);
+}
+
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::annotateNode(Node<Key,Value>* node, std::vector<std::pair<const char*, int> >& fields) const
+{
+    fields.push_back(std::make_pair("red", static_cast<RBNode<Key,Value>*>(node)->isRed() ? 1 : 0));
+}
+
+template<class Key, class Value>
+bool RedBlackTree<Key, Value>::isRedBlack() const
+{
+    RBNode<Key,Value>* root = static_cast<RBNode<Key,Value>*>(this->root_);
+    return !isRed(root) && blackHeight(root) >= 0;
+}
+
+// helper functions:
+// helper - NULL-safe color check
+template<class Key, class Value>
+bool RedBlackTree<Key, Value>::isRed(RBNode<Key,Value>* node)
+{
+    return node != NULL && node->isRed();
+}
+
+// helper - heights come back up with the answer, so every node is visited once
+template<class Key, class Value>
+int RedBlackTree<Key, Value>::blackHeight(RBNode<Key,Value>* node) const
+{
+    if(node == NULL) { return 0; }
+    RBNode<Key,Value>* left = node->getLeft();
+    RBNode<Key,Value>* right = node->getRight();
+    if(node->isRed() && (isRed(left) || isRed(right))) { return -1; }
+
+    int leftH = blackHeight(left);
+    if(leftH < 0) { return -1; }
+    int rightH = blackHeight(right);
+    if(rightH != leftH) { return -1; }
+    return leftH + (node->isRed() ? 0 : 1);
+}
+
+// helper - single left rotation, x's right child y takes x's place
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::rotateL(RBNode<Key,Value>* x)
+{
+    RBNode<Key,Value>* y = x->getRight();
+    RBNode<Key,Value>* p = x->getParent();
+
+    // move y up to x's parent
+    y->setParent(p);
+    if(p == NULL) {
+        this->root_ = y;
+    }
+    else if(p->getLeft() == x) {
+        p->setLeft(y);
+    }
+    else {
+        p->setRight(y);
+    }
+
+    // y's previous left subtree becomes x's right subtree
+    x->setRight(y->getLeft());
+    if(x->getRight() != NULL) {
+        x->getRight()->setParent(x);
+    }
+
+    // x becomes y's left child
+    y->setLeft(x);
+    x->setParent(y);
+}
+
+// helper - single right rotation, z's left child y takes z's place
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::rotateR(RBNode<Key,Value>* z)
+{
+    RBNode<Key,Value>* y = z->getLeft();
+    RBNode<Key,Value>* p = z->getParent();
+
+    // move y up to z's parent
+    y->setParent(p);
+    if(p == NULL) {
+        this->root_ = y;
+    }
+    else if(p->getLeft() == z) {
+        p->setLeft(y);
+    }
+    else {
+        p->setRight(y);
+    }
+
+    // y's previous right subtree becomes z's left subtree
+    z->setLeft(y->getRight());
+    if(z->getLeft() != NULL) {
+        z->getLeft()->setParent(z);
+    }
+
+    // z becomes y's right child
+    y->setRight(z);
+    z->setParent(y);
+}
+
+// helper - recolor going up while the uncle is red, then finish with at most 2 rotations
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::insertFix(RBNode<Key,Value>* node)
+{
+    while(isRed(node->getParent())) {
+        RBNode<Key,Value>* parent = node->getParent();
+        // parent is red so it is not the root
+        RBNode<Key,Value>* grand = parent->getParent();
+
+        if(parent == grand->getLeft()) {
+            RBNode<Key,Value>* uncle = grand->getRight();
+
+            // case 1: red uncle - push blackness down from grandparent and continue from there
+            if(isRed(uncle)) {
+                parent->setRed(false);
+                uncle->setRed(false);
+                grand->setRed(true);
+                node = grand;
+                continue;
+            }
+            // case 2: left-right - turn into left-left
+            if(node == parent->getRight()) {
+                rotateL(parent);
+                node = parent;
+                parent = node->getParent();
+            }
+            // case 3: left-left
+            parent->setRed(false);
+            grand->setRed(true);
+            rotateR(grand);
+        }
+        else {
+            RBNode<Key,Value>* uncle = grand->getLeft();
+
+            // case 1: red uncle
+            if(isRed(uncle)) {
+                parent->setRed(false);
+                uncle->setRed(false);
+                grand->setRed(true);
+                node = grand;
+                continue;
+            }
+            // case 2: right-left - turn into right-right
+            if(node == parent->getLeft()) {
+                rotateR(parent);
+                node = parent;
+                parent = node->getParent();
+            }
+            // case 3: right-right
+            parent->setRed(false);
+            grand->setRed(true);
+            rotateL(grand);
+        }
+    }
+
+    static_cast<RBNode<Key,Value>*>(this->root_)->setRed(false);
+}
+
+// helper - the subtree at node is missing one black; fix by recoloring up the tree
+// or by at most 3 rotations
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::removeFix(RBNode<Key,Value>* node, RBNode<Key,Value>* parent)
+{
+    while(parent != NULL && !isRed(node)) {
+        if(node == parent->getLeft()) {
+            // sibling must exist since its subtree has black height >= 1
+            RBNode<Key,Value>* sib = parent->getRight();
+
+            // case 1: red sibling - rotate so the sibling is black
+            if(sib->isRed()) {
+                sib->setRed(false);
+                parent->setRed(true);
+                rotateL(parent);
+                sib = parent->getRight();
+            }
+            // case 2: black sibling with black children - move the problem up
+            if(!isRed(sib->getLeft()) && !isRed(sib->getRight())) {
+                sib->setRed(true);
+                node = parent;
+                parent = node->getParent();
+                continue;
+            }
+            // case 3: sibling's far child is black - rotate the near red child into place
+            if(!isRed(sib->getRight())) {
+                sib->getLeft()->setRed(false);
+                sib->setRed(true);
+                rotateR(sib);
+                sib = parent->getRight();
+            }
+            // case 4: sibling's far child is red - one rotation finishes the fix
+            sib->setRed(parent->isRed());
+            parent->setRed(false);
+            sib->getRight()->setRed(false);
+            rotateL(parent);
+            node = static_cast<RBNode<Key,Value>*>(this->root_);
+            break;
+        }
+        else {
+            RBNode<Key,Value>* sib = parent->getLeft();
+
+            // case 1: red sibling
+            if(sib->isRed()) {
+                sib->setRed(false);
+                parent->setRed(true);
+                rotateR(parent);
+                sib = parent->getLeft();
+            }
+            // case 2: black sibling with black children
+            if(!isRed(sib->getLeft()) && !isRed(sib->getRight())) {
+                sib->setRed(true);
+                node = parent;
+                parent = node->getParent();
+                continue;
+            }
+            // case 3: sibling's far child is black
+            if(!isRed(sib->getLeft())) {
+                sib->getRight()->setRed(false);
+                sib->setRed(true);
+                rotateL(sib);
+                sib = parent->getLeft();
+            }
+            // case 4: sibling's far child is red
+            sib->setRed(parent->isRed());
+            parent->setRed(false);
+            sib->getLeft()->setRed(false);
+            rotateR(parent);
+            node = static_cast<RBNode<Key,Value>*>(this->root_);
+            break;
+        }
+    }
+
+    if(node != NULL) {
+        node->setRed(false);
+    }
+}
+
+#endif
@@ -0,0 +1,121 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include "avlbst.h"
+#include "shardedavl.h"
+
+using namespace std;
+
+// Usage: ./shard-bench [numKeys] [numOps] [numShards]
+//
+// Loads numKeys random keys, then splits numOps operations (80% find,
+// 10% insert, 10% remove) over 1 to 64 threads and reports the throughput
+// of a single AVLTree behind one mutex and of a ShardedAVLMap.
+
+typedef chrono::steady_clock Clock;
+
+// the baseline: every operation takes the one lock
+class LockedAVLTree
+{
+public:
+    void insert(const pair<const uint64_t, uint64_t>& item)
+    {
+        lock_guard<mutex> guard(lock_);
+        tree_.insert(item);
+    }
+
+    void remove(const uint64_t& key)
+    {
+        lock_guard<mutex> guard(lock_);
+        tree_.remove(key);
+    }
+
+    bool find(const uint64_t& key, uint64_t& value) const
+    {
+        lock_guard<mutex> guard(lock_);
+        AVLTree<uint64_t, uint64_t>::iterator it = tree_.find(key);
+        if(it == tree_.end()) { return false; }
+        value = it->second;
+        return true;
+    }
+
+private:
+    mutable mutex lock_;
+    AVLTree<uint64_t, uint64_t> tree_;
+};
+
+// runs numOps operations split over numThreads threads and returns Mops/s
+template<typename Map>
+double runThreads(Map& map, size_t numKeys, size_t numOps, size_t numThreads)
+{
+    vector<thread> threads;
+    Clock::time_point start = Clock::now();
+    for(size_t t = 0; t < numThreads; ++t) {
+        threads.push_back(thread([&map, numKeys, numOps, numThreads, t]() {
+            mt19937_64 gen(410 + t);
+            uniform_int_distribution<uint64_t> keyDist(0, 2 * numKeys);
+            uint64_t value = 0;
+            for(size_t i = 0; i < numOps / numThreads; ++i) {
+                uint64_t key = keyDist(gen);
+                size_t op = i % 10;
+                if(op == 0) {
+                    map.insert(make_pair(key, (uint64_t)i));
+                }
+                else if(op == 1) {
+                    map.remove(key);
+                }
+                else {
+                    map.find(key, value);
+                }
+            }
+        }));
+    }
+    for(size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    return (numOps / numThreads) * numThreads / seconds / 1e6;
+}
+
+template<typename Map>
+void load(Map& map, size_t numKeys)
+{
+    mt19937_64 gen(41);
+    uniform_int_distribution<uint64_t> keyDist(0, 2 * numKeys);
+    for(size_t i = 0; i < numKeys; ++i) {
+        map.insert(make_pair(keyDist(gen), (uint64_t)i));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t numKeys = 4096;
+    size_t numOps = 100000;
+    size_t numShards = 16;
+    if(argc > 1) { numKeys = strtoul(argv[1], NULL, 10); }
+    if(argc > 2) { numOps = strtoul(argv[2], NULL, 10); }
+    if(argc > 3) { numShards = strtoul(argv[3], NULL, 10); }
+
+    cout << "keys: " << numKeys << ", ops: " << numOps << ", shards: " << numShards
+         << ", cores: " << thread::hardware_concurrency() << " (Mops/s)" << endl;
+    cout << left << setw(10) << "threads" << right << setw(16) << "LockedAVLTree" << setw(16) << "ShardedAVLMap" << endl;
+
+    const size_t threadCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+    for(size_t i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); ++i) {
+        LockedAVLTree locked;
+        load(locked, numKeys);
+        ShardedAVLMap<uint64_t, uint64_t> sharded(numShards);
+        load(sharded, numKeys);
+
+        double lockedRate = runThreads(locked, numKeys, numOps, threadCounts[i]);
+        double shardedRate = runThreads(sharded, numKeys, numOps, threadCounts[i]);
+        cout << left << setw(10) << threadCounts[i] << right << fixed << setprecision(2)
+             << setw(16) << lockedRate << setw(16) << shardedRate << endl;
+    }
+    return 0;
+}
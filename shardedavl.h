@@ -0,0 +1,549 @@
+#ifndef SHARDEDAVL_H
+#define SHARDEDAVL_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include "avlbst.h"
+
+/**
+* One shard of a ShardedAVLMap: an AVLTree that can hand its upper keys to
+* another tree in O(log n) using AVLTree's split.
+*/
+template <class Key, class Value>
+class ShardTree : public AVLTree<Key, Value>
+{
+public:
+    // move every item from the rank-th on (counting from 0) into upper, which
+    // must be empty; splitKey is set to upper's smallest key.
+    // @precondition rank < number of items
+    void splitAtRank(size_t rank, ShardTree<Key, Value>& upper, Key& splitKey);
+};
+
+/*
+----------------------------------------------
+Begin implementations for the ShardTree class.
+----------------------------------------------
+*/
+
+template<class Key, class Value>
+void ShardTree<Key, Value>::splitAtRank(size_t rank, ShardTree<Key, Value>& upper, Key& splitKey)
+{
+    Node<Key,Value>* curr = this->getSmallestNode();
+    for(size_t i = 0; i < rank; ++i) {
+        curr = BinarySearchTree<Key, Value>::successor(curr);
+    }
+    splitKey = curr->getKey();
+
+    AVLNode<Key,Value>* root = static_cast<AVLNode<Key,Value>*>(this->root_);
+    AVLNode<Key,Value>* left = NULL;
+    AVLNode<Key,Value>* right = NULL;
+    int leftH = 0;
+    int rightH = 0;
+    this->split(root, AVLTree<Key, Value>::spineHeight(root), splitKey, left, leftH, right, rightH);
+    if(left != NULL) { left->setParent(NULL); }
+    if(right != NULL) { right->setParent(NULL); }
+    this->root_ = left;
+    upper.root_ = right;
+}
+
+/*
+--------------------------------------------
+End implementations for the ShardTree class.
+--------------------------------------------
+*/
+
+/**
+* A concurrent map that splits the key space into ranges, each held by its own
+* AVLTree behind its own mutex, so threads working on different ranges never
+* contend. Shard i holds the keys in [bound i-1, bound i).
+*
+* A point operation binary searches the current bounds (at most shards - 1 of
+* them, so a constant number of steps) and locks one shard. Bounds only change
+* while every shard is locked, and each change publishes a new immutable
+* routing table, so a lookup that locked a shard just checks that the table
+* it routed with is still current, and otherwise routes again.
+*
+* When one shard holds more than twice its share of the items (three quarters
+* with two shards), the next insert into it rebalances: the fullest shard is split at its median, and to keep
+* the shard count the two emptiest neighbouring shards are joined. Splits and
+* joins are O(log n) on the AVL trees; finding the median walks half a shard.
+* Retired routing tables are kept until the map is destroyed, one per rebalance.
+*
+* Each shard counts its own items, so inserts and removes on different shards
+* share no counter; size() adds the counts up. Inserts compare their shard's
+* count with the limit set by the last rebalance check, from the total it saw,
+* and only a shard past it sums the counts and checks for skew. A skew made by
+* removals elsewhere therefore waits for that shard to pass the limit.
+*
+* Range reads are ordered globally since the shards are: they visit the shards
+* in key order, locking one at a time, so each shard is read consistently but
+* the range as a whole is not a snapshot.
+*/
+template <class Key, class Value>
+class ShardedAVLMap
+{
+public:
+    explicit ShardedAVLMap(size_t shards = 16);
+    // start from the given sorted split keys (at most shards - 1) instead of
+    // letting every key go to the first shard until the first rebalance
+    ShardedAVLMap(size_t shards, const std::vector<Key>& bounds);
+
+    void insert(const std::pair<const Key, Value>& new_item);
+    void remove(const Key& key);
+    // copies the value out, since another thread may change it right after
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    size_t size() const;
+    bool empty() const;
+    void clear();
+
+    // every item with a key in [lo, hi), in key order
+    void range(const Key& lo, const Key& hi, std::vector<std::pair<Key, Value> >& results) const;
+    // fn(item) on every item in key order, with the item's shard locked, so
+    // fn must not call back into the map
+    template<typename Function>
+    void for_each(Function fn) const;
+
+    // rebalance now, however skewed the shards are
+    void rebalance();
+    void shardSizes(std::vector<size_t>& sizes) const;
+    size_t rebalances() const;
+
+protected:
+    struct Shard
+    {
+        mutable std::mutex lock;
+        std::unique_ptr<ShardTree<Key, Value> > tree;
+        std::atomic<size_t> count;
+    };
+
+    // the split keys in use; shards past bounds.size() are empty and unused
+    struct Routing
+    {
+        std::vector<Key> bounds;
+    };
+
+    void initShards(size_t shards);
+
+    // lock and return the shard that holds key
+    size_t lockShardFor(const Key& key) const;
+    static size_t route(const Routing* routing, const Key& key);
+
+    // visit [*lo, *hi) in key order; a NULL bound means unbounded on that side
+    template<typename Function>
+    void visitRange(const Key* lo, const Key* hi, Function& fn) const;
+
+    // true if shard holds more than twice its share, i.e. rebalancing pays off;
+    // with two shards, more than three quarters
+    bool isSkewed(size_t count, size_t total) const;
+    // the most items a shard may hold out of total before it is skewed
+    size_t skewLimit(size_t total) const;
+    // move items between shards until none is skewed; every shard is locked
+    void rebalanceLocked(bool force);
+    void publish(const std::vector<Key>& bounds);
+
+    std::vector<std::unique_ptr<Shard> > shards_;
+    std::atomic<const Routing*> routing_;
+    // inserts into a shard holding more than this check for skew
+    std::atomic<size_t> checkAt_;
+    std::atomic<size_t> rebalances_;
+
+    // one rebalance at a time; also guards retired_
+    std::mutex rebalanceLock_;
+    std::vector<std::unique_ptr<Routing> > retired_;
+
+    // shards smaller than this are never split
+    static const size_t MIN_SPLIT = 64;
+};
+
+/*
+----------------------------------------------
+Begin implementations for the ShardedAVLMap class.
+----------------------------------------------
+*/
+
+template<class Key, class Value>
+ShardedAVLMap<Key, Value>::ShardedAVLMap(size_t shards)
+    : routing_(NULL), checkAt_(MIN_SPLIT), rebalances_(0)
+{
+    initShards(shards);
+    publish(std::vector<Key>());
+}
+
+template<class Key, class Value>
+ShardedAVLMap<Key, Value>::ShardedAVLMap(size_t shards, const std::vector<Key>& bounds)
+    : routing_(NULL), checkAt_(MIN_SPLIT), rebalances_(0)
+{
+    initShards(shards);
+    std::vector<Key> used(bounds.begin(), bounds.begin() + std::min(bounds.size(), shards_.size() - 1));
+    publish(used);
+}
+
+template<class Key, class Value>
+void ShardedAVLMap<Key, Value>::initShards(size_t shards)
+{
+    for(size_t i = 0; i < (shards == 0 ? 1 : shards); ++i) {
+        shards_.push_back(std::unique_ptr<Shard>(new Shard()));
+        shards_.back()->tree.reset(new ShardTree<Key, Value>());
+        shards_.back()->count = 0;
+    }
+    if(shards_.size() == 1) {
+        checkAt_ = std::numeric_limits<size_t>::max();
+    }
+}
+
+template<class Key, class Value>
+void ShardedAVLMap<Key, Value>::insert(const std::pair<const Key, Value>& new_item)
+{
+    size_t i = lockShardFor(new_item.first);
+    Shard& shard = *shards_[i];
+    ShardTree<Key, Value>& tree = *shard.tree;
+    typename ShardTree<Key, Value>::iterator it = tree.find(new_item.first);
+    if(it != tree.end()) {
+        it->second = new_item.second;
+    }
+    else {
+        tree.insert(new_item);
+        ++shard.count;
+    }
+    shard.lock.unlock();
+
+    if(shard.count > checkAt_.load(std::memory_order_relaxed)) {
+        std::unique_lock<std::mutex> rebalancing(rebalanceLock_, std::try_to_lock);
+        if(rebalancing.owns_lock()) {
+            for(size_t k = 0; k < shards_.size(); ++k) { shards_[k]->lock.lock(); }
+            rebalanceLocked(false);
+            for(size_t k = 0; k < shards_.size(); ++k) { shards_[k]->lock.unlock(); }
+        }
+    }
+}
+
+template<class Key, class Value>
+void ShardedAVLMap<Key, Value>::remove(const Key& key)
+{
+    size_t i = lockShardFor(key);
+    Shard& shard = *shards_[i];
+    if(shard.tree->find(key) != shard.tree->end()) {
+        shard.tree->remove(key);
+        --shard.count;
+    }
+    shard.lock.unlock();
+}
+
+template<class Key, class Value>
+bool ShardedAVLMap<Key, Value>::find(const Key& key, Value& value) const
+{
+    size_t i = lockShardFor(key);
+    const Shard& shard = *shards_[i];
+    typename ShardTree<Key, Value>::iterator it = shard.tree->find(key);
+    bool found = (it != shard.tree->end());
+    if(found) {
+        value = it->second;
+    }
+    shard.lock.unlock();
+    return found;
+}
+
+template<class Key, class Value>
+bool ShardedAVLMap<Key, Value>::contains(const Key& key) const
+{
+    size_t i = lockShardFor(key);
+    bool found = (shards_[i]->tree->find(key) != shards_[i]->tree->end());
+    shards_[i]->lock.unlock();
+    return found;
+}
+
+template<class Key, class Value>
+size_t ShardedAVLMap<Key, Value>::size() const
+{
+    size_t total = 0;
+    for(size_t i = 0; i < shards_.size(); ++i) {
+        total += shards_[i]->count;
+    }
+    return total;
+}
+
+template<class Key, class Value>
+bool ShardedAVLMap<Key, Value>::empty() const
+{
+    return size() == 0;
+}
+
+template<class Key, class Value>
+void ShardedAVLMap<Key, Value>::clear()
+{
+    for(size_t i = 0; i < shards_.size(); ++i) {
+        std::lock_guard<std::mutex> guard(shards_[i]->lock);
+        shards_[i]->count = 0;
+        shards_[i]->tree->clear();
+    }
+}
+
+template<class Key, class Value>
+void ShardedAVLMap<Key, Value>::range(const Key& lo, const Key& hi,
+                                      std::vector<std::pair<Key, Value> >& results) const
+{
+    results.clear();
+    struct Collect
+    {
+        void operator()(const std::pair<const Key, Value>& item) { out.push_back(item); }
+        std::vector<std::pair<Key, Value> >& out;
+    } collect = { results };
+    visitRange(&lo, &hi, collect);
+}
+
+template<class Key, class Value>
+template<typename Function>
+void ShardedAVLMap<Key, Value>::for_each(Function fn) const
+{
+    visitRange(NULL, NULL, fn);
+}
+
+template<class Key, class Value>
+void ShardedAVLMap<Key, Value>::rebalance()
+{
+    std::lock_guard<std::mutex> rebalancing(rebalanceLock_);
+    for(size_t k = 0; k < shards_.size(); ++k) { shards_[k]->lock.lock(); }
+    rebalanceLocked(true);
+    for(size_t k = 0; k < shards_.size(); ++k) { shards_[k]->lock.unlock(); }
+}
+
+template<class Key, class Value>
+void ShardedAVLMap<Key, Value>::shardSizes(std::vector<size_t>& sizes) const
+{
+    sizes.clear();
+    for(size_t i = 0; i < shards_.size(); ++i) {
+        sizes.push_back(shards_[i]->count);
+    }
+}
+
+template<class Key, class Value>
+size_t ShardedAVLMap<Key, Value>::rebalances() const
+{
+    return rebalances_;
+}
+
+/**
+* Routes with the current table, then checks after locking that no rebalance
+* replaced the table in between. Tables are never freed while the map lives,
+* so an unchanged pointer means unchanged bounds.
+*/
+template<class Key, class Value>
+size_t ShardedAVLMap<Key, Value>::lockShardFor(const Key& key) const
+{
+    while(true) {
+        const Routing* routing = routing_.load(std::memory_order_acquire);
+        size_t i = route(routing, key);
+        shards_[i]->lock.lock();
+        if(routing_.load(std::memory_order_acquire) == routing) {
+            return i;
+        }
+        shards_[i]->lock.unlock();
+    }
+}
+
+template<class Key, class Value>
+size_t ShardedAVLMap<Key, Value>::route(const Routing* routing, const Key& key)
+{
+    return std::upper_bound(routing->bounds.begin(), routing->bounds.end(), key) - routing->bounds.begin();
+}
+
+/**
+* Visits one shard at a time. If a rebalance moved the bounds meanwhile, the
+* walk routes again from just past the last key it visited.
+*/
+template<class Key, class Value>
+template<typename Function>
+void ShardedAVLMap<Key, Value>::visitRange(const Key* lo, const Key* hi, Function& fn) const
+{
+    Key cursor = (lo != NULL) ? *lo : Key();
+    bool started = (lo != NULL);    // false: start from the smallest key
+    bool pastCursor = false;        // true: cursor itself was already visited
+
+    while(true) {
+        const Routing* routing = routing_.load(std::memory_order_acquire);
+        size_t i = started ? route(routing, cursor) : 0;
+        std::lock_guard<std::mutex> guard(shards_[i]->lock);
+        if(routing_.load(std::memory_order_acquire) != routing) {
+            continue;
+        }
+
+        ShardTree<Key, Value>& tree = *shards_[i]->tree;
+        typename ShardTree<Key, Value>::iterator it = started ? tree.lower_bound(cursor) : tree.begin();
+        if(pastCursor && it != tree.end() && !(cursor < it->first)) {
+            ++it;
+        }
+        for( ; it != tree.end(); ++it) {
+            if(hi != NULL && !(it->first < *hi)) {
+                return;
+            }
+            fn(*it);
+            cursor = it->first;
+            started = true;
+            pastCursor = true;
+        }
+
+        // continue with the next shard's first key
+        if(i >= routing->bounds.size()) {
+            return;
+        }
+        if(hi != NULL && !(routing->bounds[i] < *hi)) {
+            return;
+        }
+        cursor = routing->bounds[i];
+        started = true;
+        pastCursor = false;
+    }
+}
+
+template<class Key, class Value>
+bool ShardedAVLMap<Key, Value>::isSkewed(size_t count, size_t total) const
+{
+    return count > skewLimit(total);
+}
+
+template<class Key, class Value>
+size_t ShardedAVLMap<Key, Value>::skewLimit(size_t total) const
+{
+    size_t share = total / shards_.size();
+    size_t limit = share + std::min(share, (total - share) / 2);
+    return limit < MIN_SPLIT ? MIN_SPLIT : limit;
+}
+
+/**
+* Each round splits the fullest shard at its median. While some shards are
+* unused the new half just takes one; otherwise the adjacent pair with the
+* fewest items is joined first to free a shard, and the shards in between
+* shift over by one. With no pair to join apart from the fullest shard (only
+* two or three shards), the half goes to the emptier neighbour instead.
+*/
+template<class Key, class Value>
+void ShardedAVLMap<Key, Value>::rebalanceLocked(bool force)
+{
+    std::vector<Key> bounds = routing_.load()->bounds;
+    std::vector<std::unique_ptr<ShardTree<Key, Value> > > trees;
+    std::vector<size_t> counts;
+    size_t total = 0;
+    for(size_t i = 0; i < shards_.size(); ++i) {
+        trees.push_back(std::move(shards_[i]->tree));
+        counts.push_back(shards_[i]->count);
+        total += counts.back();
+    }
+    size_t n = shards_.size();
+    bool changed = false;
+
+    for(size_t round = 0; n > 1 && round < n; ++round) {
+        size_t used = bounds.size() + 1;
+        size_t big = std::max_element(counts.begin(), counts.begin() + used) - counts.begin();
+        if(counts[big] < 2 || !(isSkewed(counts[big], total) || (force && round == 0))) {
+            break;
+        }
+
+        if(used < n) {
+            // take an unused shard: trees past big shift right by one
+            std::unique_ptr<ShardTree<Key, Value> > upper(std::move(trees[used]));
+            trees.erase(trees.begin() + used);
+            counts.erase(counts.begin() + used);
+            Key splitKey;
+            trees[big]->splitAtRank(counts[big] / 2, *upper, splitKey);
+            trees.insert(trees.begin() + big + 1, std::move(upper));
+            counts.insert(counts.begin() + big + 1, counts[big] - counts[big] / 2);
+            counts[big] /= 2;
+            bounds.insert(bounds.begin() + big, splitKey);
+            changed = true;
+            continue;
+        }
+
+        // the emptiest adjacent pair that leaves big alone
+        size_t pair = n;
+        for(size_t j = 0; j + 1 < n; ++j) {
+            if(j != big && j + 1 != big && (pair == n || counts[j] + counts[j + 1] < counts[pair] + counts[pair + 1])) {
+                pair = j;
+            }
+        }
+
+        if(pair == n) {
+            // give half of big to its emptier neighbour
+            size_t next = (big == 0 || (big + 1 < n && counts[big + 1] < counts[big - 1])) ? big + 1 : big - 1;
+            ShardTree<Key, Value> upper;
+            Key splitKey;
+            trees[big]->splitAtRank(counts[big] / 2, upper, splitKey);
+            size_t upperCount = counts[big] - counts[big] / 2;
+            if(next == big + 1) {
+                trees[next]->merge(std::move(upper));
+                counts[next] += upperCount;
+                counts[big] /= 2;
+                bounds[big] = splitKey;
+            }
+            else {
+                // the lower half moves: keep it in big's tree and swap trees
+                trees[next]->merge(std::move(*trees[big]));
+                trees[big]->merge(std::move(upper));
+                counts[next] += counts[big] / 2;
+                counts[big] = upperCount;
+                bounds[next] = splitKey;
+            }
+            changed = true;
+            continue;
+        }
+        // joining must not make a new skewed shard
+        if(isSkewed(counts[pair] + counts[pair + 1], total) || counts[pair] + counts[pair + 1] >= counts[big]) {
+            break;
+        }
+
+        // join the pair, freeing a tree for the upper half of big
+        trees[pair]->merge(std::move(*trees[pair + 1]));
+        counts[pair] += counts[pair + 1];
+        std::unique_ptr<ShardTree<Key, Value> > upper(std::move(trees[pair + 1]));
+        trees.erase(trees.begin() + pair + 1);
+        counts.erase(counts.begin() + pair + 1);
+        bounds.erase(bounds.begin() + pair);
+        if(big > pair) { --big; }
+
+        Key splitKey;
+        trees[big]->splitAtRank(counts[big] / 2, *upper, splitKey);
+        trees.insert(trees.begin() + big + 1, std::move(upper));
+        counts.insert(counts.begin() + big + 1, counts[big] - counts[big] / 2);
+        counts[big] /= 2;
+        bounds.insert(bounds.begin() + big, splitKey);
+        changed = true;
+    }
+
+    for(size_t i = 0; i < n; ++i) {
+        shards_[i]->tree = std::move(trees[i]);
+        shards_[i]->count = counts[i];
+    }
+    if(n > 1) {
+        checkAt_ = skewLimit(total);
+    }
+    if(changed) {
+        publish(bounds);
+        ++rebalances_;
+    }
+}
+
+// helper - called by the constructors or with rebalanceLock_ and every shard held
+template<class Key, class Value>
+void ShardedAVLMap<Key, Value>::publish(const std::vector<Key>& bounds)
+{
+    Routing* routing = new Routing();
+    routing->bounds = bounds;
+    retired_.push_back(std::unique_ptr<Routing>(routing));
+    routing_.store(routing, std::memory_order_release);
+}
+
+/*
+--------------------------------------------
+End implementations for the ShardedAVLMap class.
+--------------------------------------------
+*/
+
+#endif
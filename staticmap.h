@@ -0,0 +1,179 @@
+#ifndef STATICMAP_H
+#define STATICMAP_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+
+// helper - the pack 0, 1, ..., N-1, to expand a table element by element
+template <size_t... I>
+struct StaticIndices
+{
+};
+
+template <size_t N, size_t... I>
+struct MakeStaticIndices : MakeStaticIndices<N - 1, N - 1, I...>
+{
+};
+
+template <size_t... I>
+struct MakeStaticIndices<0, I...>
+{
+    typedef StaticIndices<I...> type;
+};
+
+/**
+* Compile-time sort of a table of (key, value) pairs for StaticMap: every
+* item's rank, its count of smaller keys, is its position in the sorted
+* table. That is O(N^2) comparisons, fine for the few hundred entries of an
+* opcode or handler table. Recursion splits ranges in half so its depth
+* stays O(log N), well inside the compiler's constexpr limits.
+*/
+template <typename Key, typename Value, size_t N>
+struct StaticMapBuilder
+{
+    typedef std::pair<Key, Value> Item;
+
+    // rank of every item, by input position
+    struct Ranks
+    {
+        size_t of[N];
+    };
+
+    template <size_t... I>
+    static constexpr Ranks ranks(const Item (&items)[N], StaticIndices<I...>)
+    {
+        return Ranks{ { countLess(items, items[I].first, 0, N)... } };
+    }
+
+    // number of keys in items[lo, hi) smaller than key
+    static constexpr size_t countLess(const Item (&items)[N], const Key& key, size_t lo, size_t hi)
+    {
+        return (hi - lo == 0) ? 0
+             : (hi - lo == 1) ? (items[lo].first < key ? 1 : 0)
+             : countLess(items, key, lo, lo + (hi - lo) / 2) + countLess(items, key, lo + (hi - lo) / 2, hi);
+    }
+
+    // the item of rank r. Equal keys share a rank and leave another one
+    // unused, which stops the build.
+    static constexpr Item sortedAt(const Item (&items)[N], const Ranks& ranks, size_t r)
+    {
+        return itemAt(items, indexOfRank(ranks, r, 0, N));
+    }
+
+    // helper - index in [lo, hi) of the item of rank r, or N when there is none
+    static constexpr size_t indexOfRank(const Ranks& ranks, size_t r, size_t lo, size_t hi)
+    {
+        return (hi - lo == 0) ? N
+             : (hi - lo == 1) ? (ranks.of[lo] == r ? lo : N)
+             : orInRange(indexOfRank(ranks, r, lo, lo + (hi - lo) / 2), ranks, r, lo + (hi - lo) / 2, hi);
+    }
+
+    // helper - found, unless it is N, else search [lo, hi)
+    static constexpr size_t orInRange(size_t found, const Ranks& ranks, size_t r, size_t lo, size_t hi)
+    {
+        return (found != N) ? found : indexOfRank(ranks, r, lo, hi);
+    }
+
+    static constexpr Item itemAt(const Item (&items)[N], size_t index)
+    {
+        return (index != N) ? items[index] : throw std::runtime_error("duplicate key in StaticMap");
+    }
+};
+
+/**
+* A read-only map whose contents are fixed at compile time. makeStaticMap()
+* sorts a table of pairs while compiling, so a constexpr StaticMap sits in
+* static storage: no inserts at startup and no heap. The sorted array is an
+* implicit perfectly balanced tree, its middle element the root, and find()
+* descends it in O(log N) like AVLTree::find().
+*
+* Keys and values must be literal types (integers, enums, chars, pointers
+* to string literals...) and keys are ordered by operator<, as in the trees.
+* Lookups are constexpr too, so a fixed table can be checked by static_assert.
+* Iterators are plain pointers to the sorted pairs.
+*/
+template <typename Key, typename Value, size_t N>
+class StaticMap
+{
+    static_assert(N > 0, "StaticMap needs at least one entry");
+
+public:
+    typedef std::pair<Key, Value> value_type;
+    typedef const value_type* iterator;
+
+    // use makeStaticMap()
+    template <size_t... I>
+    constexpr StaticMap(const value_type (&items)[N], StaticIndices<I...> indices)
+        : StaticMap(items, StaticMapBuilder<Key, Value, N>::ranks(items, indices), indices)
+    {
+    }
+
+    constexpr iterator begin() const { return items_; }
+    constexpr iterator end() const { return items_ + N; }
+    constexpr size_t size() const { return N; }
+    constexpr bool empty() const { return false; }
+
+    constexpr iterator find(const Key& key) const
+    {
+        return matching(key, lower_bound(key));
+    }
+
+    // first item whose key is not smaller than key
+    constexpr iterator lower_bound(const Key& key) const
+    {
+        return lowerBound(key, 0, N);
+    }
+
+    constexpr const Value& operator[](const Key& key) const
+    {
+        return valueAt(find(key));
+    }
+
+protected:
+    // helper - it if it holds key, else end()
+    constexpr iterator matching(const Key& key, iterator it) const
+    {
+        return (it != end() && !(key < it->first)) ? it : end();
+    }
+
+    constexpr const Value& valueAt(iterator it) const
+    {
+        return (it != end()) ? it->second : throw std::out_of_range("Invalid key");
+    }
+
+    // helper - binary search of items_[lo, hi)
+    constexpr iterator lowerBound(const Key& key, size_t lo, size_t hi) const
+    {
+        return (lo == hi) ? items_ + lo
+             : (items_[lo + (hi - lo) / 2].first < key)
+                 ? lowerBound(key, lo + (hi - lo) / 2 + 1, hi)
+                 : lowerBound(key, lo, lo + (hi - lo) / 2);
+    }
+
+    template <size_t... I>
+    constexpr StaticMap(const value_type (&items)[N], const typename StaticMapBuilder<Key, Value, N>::Ranks& ranks,
+                        StaticIndices<I...>)
+        : items_{ StaticMapBuilder<Key, Value, N>::sortedAt(items, ranks, I)... }
+    {
+    }
+
+    value_type items_[N];   // sorted by key
+};
+
+/**
+* Builds a StaticMap from a table in any order, at compile time when the
+* result is constexpr:
+*
+*   static constexpr std::pair<int, const char*> opcodes[] = { {0x90, "nop"}, {0xc3, "ret"} };
+*   static constexpr StaticMap<int, const char*, 2> names = makeStaticMap(opcodes);
+*
+* A duplicate key is a compile error (a runtime_error if built at run time).
+*/
+template <typename Key, typename Value, size_t N>
+constexpr StaticMap<Key, Value, N> makeStaticMap(const std::pair<Key, Value> (&items)[N])
+{
+    return StaticMap<Key, Value, N>(items, typename MakeStaticIndices<N>::type());
+}
+
+#endif
@@ -0,0 +1,104 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <map>
+#include "bst.h"
+#include "avlbst.h"
+#include "rbbst.h"
+#include "tracetree.h"
+
+using namespace std;
+
+// Usage: ./trace-replay <trace>
+//        ./trace-replay record <trace> [numOps] [numKeys]
+//
+// Replays a trace of <uint64_t, std::string> operations against each tree
+// and std::map, and reports throughput and per-operation latency. Traces come
+// from a TracedTree<uint64_t, std::string> in the application being studied;
+// "record" writes a synthetic one (skewed keys, mixed value sizes) through
+// the same class, to try the tool out.
+
+typedef TraceRecord<uint64_t> Record;
+
+void recordSample(const string& path, size_t numOps, size_t numKeys)
+{
+    mt19937_64 gen(450);
+    uniform_int_distribution<uint64_t> anyKey(0, numKeys - 1);
+    // a tenth of the keys get nine tenths of the operations
+    uniform_int_distribution<uint64_t> hotKey(0, numKeys / 10);
+    uniform_int_distribution<size_t> valueSize(8, 256);
+    uniform_int_distribution<int> percent(0, 99);
+
+    TracedTree<uint64_t, string> tree(path);
+    for(size_t i = 0; i < numOps; ++i) {
+        uint64_t key = (percent(gen) < 90) ? hotKey(gen) * 10 : anyKey(gen) * 10;
+        int op = percent(gen);
+        if(op < 60) {
+            tree.find(key);
+        }
+        else if(op < 85) {
+            tree.insert(make_pair(key, string(valueSize(gen), 'v')));
+        }
+        else if(op < 99 || i % 100 != 0) {
+            tree.remove(key);
+        }
+        else {
+            tree.erase_range(key, key + 100);
+        }
+    }
+    tree.flush();
+    cout << "recorded " << tree.recordedOps() << " operations to " << path << endl;
+}
+
+template<typename Map>
+void replay(const char* name, const vector<Record>& records)
+{
+    Map map;
+    TraceReplayStats stats = replayTrace<uint64_t, string>(records, map);
+    cout << left << setw(18) << name << right << fixed << setprecision(2)
+         << setw(10) << stats.ops / stats.seconds / 1e6
+         << setw(10) << stats.p50Ns << setw(10) << stats.p99Ns
+         << setw(10) << stats.p999Ns << setw(12) << stats.maxNs
+         << setw(10) << (stats.finds == 0 ? 0.0 : 100.0 * stats.hits / stats.finds) << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc > 2 && strcmp(argv[1], "record") == 0) {
+        size_t numOps = 1000000;
+        size_t numKeys = 100000;
+        if(argc > 3) { numOps = strtoul(argv[3], NULL, 10); }
+        if(argc > 4) { numKeys = strtoul(argv[4], NULL, 10); }
+        if(numKeys < 10) { numKeys = 10; }
+        recordSample(argv[2], numOps, numKeys);
+        return 0;
+    }
+    if(argc != 2) {
+        cerr << "usage: " << argv[0] << " <trace>" << endl
+             << "       " << argv[0] << " record <trace> [numOps] [numKeys]" << endl;
+        return 1;
+    }
+
+    vector<Record> records;
+    try {
+        readTrace(argv[1], records);
+    }
+    catch(const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    cout << "operations: " << records.size() << endl;
+    cout << left << setw(18) << "tree" << right << setw(10) << "Mops/s"
+         << setw(10) << "p50 ns" << setw(10) << "p99 ns" << setw(10) << "p99.9 ns"
+         << setw(12) << "max ns" << setw(10) << "hit %" << endl;
+    replay<BinarySearchTree<uint64_t, string> >("BinarySearchTree", records);
+    replay<AVLTree<uint64_t, string> >("AVLTree", records);
+    replay<RedBlackTree<uint64_t, string> >("RedBlackTree", records);
+    replay<map<uint64_t, string> >("std::map", records);
+    return 0;
+}
@@ -0,0 +1,557 @@
+#ifndef TRACETREE_H
+#define TRACETREE_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include "avlbst.h"
+#include "durableavl.h"
+
+/**
+* Operation trace files: what TracedTree records and replayTrace() re-executes.
+*
+* A trace is the 8 byte magic "AVLTRCE1", a u32 key width (sizeof(Key) for
+* fixed-size keys, 0 for variable-size ones), then one record per operation:
+*   [u8 op][payload]
+*   TRACE_INSERT       key, u32 value size
+*   TRACE_REMOVE       key
+*   TRACE_FIND         key
+*   TRACE_ERASE_RANGE  u8 bounds (1: lo present, 2: hi present), then lo and/or hi
+*   TRACE_CLEAR        nothing
+* Keys use WalCodec. Values are not stored, only their size, so a trace
+* captures the access pattern without the data; replay fills in values of the
+* recorded size.
+*/
+enum TraceOp
+{
+    TRACE_INSERT = 1,
+    TRACE_REMOVE = 2,
+    TRACE_FIND = 3,
+    TRACE_ERASE_RANGE = 4,
+    TRACE_CLEAR = 5
+};
+
+/**
+* How a value is summarized in a trace and recreated on replay. The default
+* records sizeof(T) and replays T(seq); std::string records its length and
+* replays a string of that length. Specialize it for other types.
+*/
+template <typename T>
+struct TraceValue
+{
+    static uint32_t size(const T& value)
+    {
+        (void)value;
+        return sizeof(T);
+    }
+    static T make(uint32_t size, uint64_t seq)
+    {
+        (void)size;
+        return T(seq);
+    }
+};
+
+template <>
+struct TraceValue<std::string>
+{
+    static uint32_t size(const std::string& value)
+    {
+        return (uint32_t)value.size();
+    }
+    static std::string make(uint32_t size, uint64_t seq)
+    {
+        return std::string(size, (char)('a' + seq % 26));
+    }
+};
+
+/**
+* One decoded trace record. hi is used only by TRACE_ERASE_RANGE.
+*/
+template <typename Key>
+struct TraceRecord
+{
+    uint8_t op;
+    uint8_t bounds;
+    uint32_t valueSize;
+    Key key;
+    Key hi;
+};
+
+/**
+* Throughput and per-operation latency of one replay. Latencies are exact,
+* taken from one timestamp pair per operation.
+*/
+struct TraceReplayStats
+{
+    size_t ops;
+    size_t finds;
+    size_t hits;            // finds that found their key
+    double seconds;         // whole replay, timestamps included
+    uint64_t p50Ns;
+    uint64_t p99Ns;
+    uint64_t p999Ns;
+    uint64_t maxNs;
+};
+
+/**
+* Records every operation on any BinarySearchTree-derived Tree to a trace file.
+*
+* Records are buffered and written in large batches with no fsync, so tracing
+* costs an encode and a memcpy per operation. flush() writes what is buffered;
+* the destructor does too.
+*
+* Lookups are recorded when made through this class (find(), operator[] and
+* at() hide the base versions; operator[] and at() are read-only here, since
+* a write through them could not be recorded). Outside insert(), a key
+* created through the findOrCreate() hook and a value changed through the
+* valueChanged() hook are recorded as inserts, so update() and the base
+* operator[] are traced even through a BinarySearchTree&. Range erases and
+* clear() are recorded as such;
+* merging another tree into this one records one insert per item, and merging
+* this tree into another records a clear.
+*/
+template <class Key, class Value, class Tree = AVLTree<Key, Value> >
+class TracedTree : public Tree
+{
+public:
+    // starts a new trace at path, replacing any file there
+    explicit TracedTree(const std::string& path);
+    virtual ~TracedTree();
+
+    virtual std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+        insert (const std::pair<const Key, Value> &new_item);
+    virtual void remove(const Key& key);
+    typename Tree::iterator find(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+    Value const & at(const Key& key) const;
+    void clear();
+
+    // write every buffered record
+    void flush();
+    // operations recorded so far
+    size_t recordedOps() const;
+
+protected:
+    virtual void eraseKeys(const Key* lo, const Key* hi);
+    // erase_if: one recorded remove per match
+    virtual void eraseMatching(const typename BinarySearchTree<Key, Value>::ItemPredicate& pred);
+    virtual Node<Key,Value>* releaseNodes();
+    virtual void absorbNodes(Node<Key,Value>* root, const BinarySearchTree<Key, Value>& source);
+    // record a created key or a changed value as an insert, unless muted
+    virtual Node<Key,Value>* findOrCreate(const Key& key, const Value& value, bool& created);
+    virtual void valueChanged(Node<Key,Value>* node);
+
+    // buffer one record (unless muted) and write once enough is buffered
+    void record(uint8_t op, const Key* key, const Key* hi = NULL, uint32_t valueSize = 0) const;
+    // record the subtree at node as inserts, in key order
+    void recordInserts(Node<Key,Value>* node);
+
+    int fd_;
+    mutable std::string buffer_;
+    mutable size_t ops_;
+    // set while a base operation runs, so that the insert() and remove()
+    // calls it makes are not recorded a second time
+    bool muted_;
+
+    // a write is issued once this much is buffered
+    static const size_t WRITE_BATCH_BYTES = 64 * 1024;
+};
+
+// decode a whole trace file into records; throws if it is unreadable or malformed
+template <class Key>
+void readTrace(const std::string& path, std::vector<TraceRecord<Key> >& records);
+
+// re-execute records against map: any BinarySearchTree-derived tree or a std::map
+template <class Key, class Value, class Map>
+TraceReplayStats replayTrace(const std::vector<TraceRecord<Key> >& records, Map& map);
+
+// helper - sizeof(Key) if keys are fixed-size, else 0
+template <class Key>
+uint32_t traceKeyWidth()
+{
+    return std::is_trivially_copyable<Key>::value ? (uint32_t)sizeof(Key) : 0;
+}
+
+/*
+----------------------------------------------
+Begin implementations for the TracedTree class.
+----------------------------------------------
+*/
+
+template<class Key, class Value, class Tree>
+TracedTree<Key, Value, Tree>::TracedTree(const std::string& path)
+    : fd_(-1), ops_(0), muted_(false)
+{
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd_ < 0) {
+        throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+    }
+    buffer_.append("AVLTRCE1", 8);
+    WalCodec<uint32_t>::encode(traceKeyWidth<Key>(), buffer_);
+}
+
+/**
+* Writes anything still buffered. Errors cannot be reported from here; call
+* flush() first to see them.
+*/
+template<class Key, class Value, class Tree>
+TracedTree<Key, Value, Tree>::~TracedTree()
+{
+    try {
+        flush();
+    }
+    catch(const std::exception&) {
+    }
+    close(fd_);
+}
+
+template<class Key, class Value, class Tree>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+TracedTree<Key, Value, Tree>::insert (const std::pair<const Key, Value> &new_item)
+{
+    record(TRACE_INSERT, &new_item.first, NULL, TraceValue<Value>::size(new_item.second));
+    bool wasMuted = muted_;
+    muted_ = true;
+    std::pair<typename BinarySearchTree<Key, Value>::iterator, bool> result = Tree::insert(new_item);
+    muted_ = wasMuted;
+    return result;
+}
+
+template<class Key, class Value, class Tree>
+void TracedTree<Key, Value, Tree>::remove(const Key& key)
+{
+    record(TRACE_REMOVE, &key);
+    bool wasMuted = muted_;
+    muted_ = true;
+    Tree::remove(key);
+    muted_ = wasMuted;
+}
+
+template<class Key, class Value, class Tree>
+typename Tree::iterator TracedTree<Key, Value, Tree>::find(const Key& key) const
+{
+    record(TRACE_FIND, &key);
+    return Tree::find(key);
+}
+
+template<class Key, class Value, class Tree>
+Value const & TracedTree<Key, Value, Tree>::operator[](const Key& key) const
+{
+    record(TRACE_FIND, &key);
+    return Tree::operator[](key);
+}
+
+template<class Key, class Value, class Tree>
+Value const & TracedTree<Key, Value, Tree>::at(const Key& key) const
+{
+    record(TRACE_FIND, &key);
+    return Tree::at(key);
+}
+
+template<class Key, class Value, class Tree>
+void TracedTree<Key, Value, Tree>::clear()
+{
+    record(TRACE_CLEAR, NULL);
+    Tree::clear();
+}
+
+template<class Key, class Value, class Tree>
+void TracedTree<Key, Value, Tree>::eraseMatching(const typename BinarySearchTree<Key, Value>::ItemPredicate& pred)
+{
+    BinarySearchTree<Key, Value>::eraseMatching(pred);
+}
+
+template<class Key, class Value, class Tree>
+void TracedTree<Key, Value, Tree>::flush()
+{
+    const char* data = buffer_.data();
+    size_t len = buffer_.size();
+    while(len > 0) {
+        ssize_t put = write(fd_, data, len);
+        if(put < 0) {
+            if(errno == EINTR) { continue; }
+            throw std::runtime_error(std::string("trace write failed: ") + std::strerror(errno));
+        }
+        data += put;
+        len -= put;
+    }
+    buffer_.clear();
+}
+
+template<class Key, class Value, class Tree>
+size_t TracedTree<Key, Value, Tree>::recordedOps() const
+{
+    return ops_;
+}
+
+template<class Key, class Value, class Tree>
+void TracedTree<Key, Value, Tree>::eraseKeys(const Key* lo, const Key* hi)
+{
+    if(lo == NULL && hi == NULL) {
+        record(TRACE_CLEAR, NULL);
+    }
+    else {
+        record(TRACE_ERASE_RANGE, lo, hi);
+    }
+    bool wasMuted = muted_;
+    muted_ = true;
+    Tree::eraseKeys(lo, hi);
+    muted_ = wasMuted;
+}
+
+// helper - merging this tree into another empties it
+template<class Key, class Value, class Tree>
+Node<Key,Value>* TracedTree<Key, Value, Tree>::releaseNodes()
+{
+    record(TRACE_CLEAR, NULL);
+    return Tree::releaseNodes();
+}
+
+// helper - the absorbed items are new to this tree's trace, so record them as inserts
+template<class Key, class Value, class Tree>
+void TracedTree<Key, Value, Tree>::absorbNodes(Node<Key,Value>* root, const BinarySearchTree<Key, Value>& source)
+{
+    recordInserts(root);
+    bool wasMuted = muted_;
+    muted_ = true;
+    Tree::absorbNodes(root, source);
+    muted_ = wasMuted;
+}
+
+template<class Key, class Value, class Tree>
+Node<Key,Value>* TracedTree<Key, Value, Tree>::findOrCreate(const Key& key, const Value& value, bool& created)
+{
+    Node<Key,Value>* node = Tree::findOrCreate(key, value, created);
+    if(created) {
+        record(TRACE_INSERT, &key, NULL, TraceValue<Value>::size(value));
+    }
+    return node;
+}
+
+template<class Key, class Value, class Tree>
+void TracedTree<Key, Value, Tree>::valueChanged(Node<Key,Value>* node)
+{
+    Tree::valueChanged(node);
+    record(TRACE_INSERT, &node->getKey(), NULL, TraceValue<Value>::size(node->getValue()));
+}
+
+template<class Key, class Value, class Tree>
+void TracedTree<Key, Value, Tree>::record(uint8_t op, const Key* key, const Key* hi, uint32_t valueSize) const
+{
+    if(muted_) { return; }
+
+    buffer_.push_back((char)op);
+    if(op == TRACE_ERASE_RANGE) {
+        buffer_.push_back((char)((key != NULL ? 1 : 0) | (hi != NULL ? 2 : 0)));
+        if(key != NULL) { WalCodec<Key>::encode(*key, buffer_); }
+        if(hi != NULL) { WalCodec<Key>::encode(*hi, buffer_); }
+    }
+    else if(op != TRACE_CLEAR) {
+        WalCodec<Key>::encode(*key, buffer_);
+        if(op == TRACE_INSERT) {
+            WalCodec<uint32_t>::encode(valueSize, buffer_);
+        }
+    }
+    ++ops_;
+
+    if(buffer_.size() >= WRITE_BATCH_BYTES) {
+        const_cast<TracedTree<Key, Value, Tree>*>(this)->flush();
+    }
+}
+
+// helper - iterative in-order walk; the subtree is detached, so stop at its root
+template<class Key, class Value, class Tree>
+void TracedTree<Key, Value, Tree>::recordInserts(Node<Key,Value>* node)
+{
+    std::vector<Node<Key,Value>*> stack;
+    while(node != NULL || !stack.empty()) {
+        while(node != NULL) {
+            stack.push_back(node);
+            node = node->getLeft();
+        }
+        node = stack.back();
+        stack.pop_back();
+        if(!this->isHiddenNode(node)) {
+            record(TRACE_INSERT, &node->getKey(), NULL, TraceValue<Value>::size(node->getValue()));
+        }
+        node = node->getRight();
+    }
+}
+
+/*
+--------------------------------------------
+End implementations for the TracedTree class.
+--------------------------------------------
+*/
+
+/*
+----------------------------------------------
+Begin implementations for trace replay.
+----------------------------------------------
+*/
+
+template <class Key>
+void readTrace(const std::string& path, std::vector<TraceRecord<Key> >& records)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+    }
+    std::string data;
+    char chunk[64 * 1024];
+    while(true) {
+        ssize_t got = read(fd, chunk, sizeof(chunk));
+        if(got < 0) {
+            if(errno == EINTR) { continue; }
+            int err = errno;
+            close(fd);
+            throw std::runtime_error("cannot read " + path + ": " + std::strerror(err));
+        }
+        if(got == 0) { break; }
+        data.append(chunk, got);
+    }
+    close(fd);
+
+    const char* p = data.data();
+    const char* end = p + data.size();
+    uint32_t keyWidth = 0;
+    if(data.size() < 12 || std::memcmp(p, "AVLTRCE1", 8) != 0) {
+        throw std::runtime_error(path + " is not a trace file");
+    }
+    p += 8;
+    WalCodec<uint32_t>::decode(p, end, keyWidth);
+    if(keyWidth != traceKeyWidth<Key>()) {
+        throw std::runtime_error(path + " was recorded with a different key type");
+    }
+
+    records.clear();
+    while(p < end) {
+        TraceRecord<Key> rec;
+        rec.op = (uint8_t)*p++;
+        rec.bounds = 0;
+        rec.valueSize = 0;
+        rec.key = Key();
+        rec.hi = Key();
+
+        bool ok = true;
+        if(rec.op == TRACE_INSERT) {
+            ok = WalCodec<Key>::decode(p, end, rec.key) && WalCodec<uint32_t>::decode(p, end, rec.valueSize);
+        }
+        else if(rec.op == TRACE_REMOVE || rec.op == TRACE_FIND) {
+            ok = WalCodec<Key>::decode(p, end, rec.key);
+        }
+        else if(rec.op == TRACE_ERASE_RANGE) {
+            ok = (p < end);
+            if(ok) { rec.bounds = (uint8_t)*p++; }
+            if(ok && (rec.bounds & 1)) { ok = WalCodec<Key>::decode(p, end, rec.key); }
+            if(ok && (rec.bounds & 2)) { ok = WalCodec<Key>::decode(p, end, rec.hi); }
+        }
+        else if(rec.op != TRACE_CLEAR) {
+            ok = false;
+        }
+        if(!ok) {
+            throw std::runtime_error(path + " has a malformed record after " +
+                                     std::to_string(records.size()) + " operations");
+        }
+        records.push_back(rec);
+    }
+}
+
+// helper - the trees' insert() overwrites, std::map's does not
+template <class Map, class Key, class Value>
+void traceInsert(Map& map, const Key& key, const Value& value)
+{
+    map.insert(std::make_pair(key, value));
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+void traceInsert(std::map<Key, Value, Compare, Alloc>& map, const Key& key, const Value& value)
+{
+    map[key] = value;
+}
+
+template <class Map, class Key>
+void traceRemove(Map& map, const Key& key)
+{
+    map.remove(key);
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+void traceRemove(std::map<Key, Value, Compare, Alloc>& map, const Key& key)
+{
+    map.erase(key);
+}
+
+/**
+* Runs each record in order, timing each one. Values are made by
+* TraceValue<Value>::make() before the clock starts, so only the map
+* operation itself is measured.
+*/
+template <class Key, class Value, class Map>
+TraceReplayStats replayTrace(const std::vector<TraceRecord<Key> >& records, Map& map)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    TraceReplayStats stats = TraceReplayStats();
+    std::vector<uint64_t> latencies;
+    latencies.reserve(records.size());
+
+    Clock::time_point replayStart = Clock::now();
+    for(size_t i = 0; i < records.size(); ++i) {
+        const TraceRecord<Key>& rec = records[i];
+        Value value = (rec.op == TRACE_INSERT) ? TraceValue<Value>::make(rec.valueSize, i) : Value();
+
+        Clock::time_point start = Clock::now();
+        switch(rec.op) {
+        case TRACE_INSERT:
+            traceInsert(map, rec.key, value);
+            break;
+        case TRACE_REMOVE:
+            traceRemove(map, rec.key);
+            break;
+        case TRACE_FIND:
+            ++stats.finds;
+            if(map.find(rec.key) != map.end()) { ++stats.hits; }
+            break;
+        case TRACE_ERASE_RANGE:
+            map.erase((rec.bounds & 1) ? map.lower_bound(rec.key) : map.begin(),
+                      (rec.bounds & 2) ? map.lower_bound(rec.hi) : map.end());
+            break;
+        default:
+            map.clear();
+            break;
+        }
+        latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+    stats.seconds = std::chrono::duration<double>(Clock::now() - replayStart).count();
+    stats.ops = records.size();
+
+    if(!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        stats.p50Ns = latencies[(latencies.size() - 1) / 2];
+        stats.p99Ns = latencies[(size_t)((latencies.size() - 1) * 0.99)];
+        stats.p999Ns = latencies[(size_t)((latencies.size() - 1) * 0.999)];
+        stats.maxNs = latencies.back();
+    }
+    return stats;
+}
+
+/*
+--------------------------------------------
+End implementations for trace replay.
+--------------------------------------------
+*/
+
+#endif
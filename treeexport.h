@@ -0,0 +1,338 @@
+#ifndef TREEEXPORT_H
+#define TREEEXPORT_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "bst.h"
+
+/**
+* Output formats of exportTree():
+*   EXPORT_TEXT - one line per node, indented with |-- and `-- connectors
+*   EXPORT_DOT  - a Graphviz digraph, edges labelled L and R
+*   EXPORT_JSON - nested {"key", "value", <metadata>, "left", "right"} objects
+*/
+enum TreeExportFormat
+{
+    EXPORT_TEXT,
+    EXPORT_DOT,
+    EXPORT_JSON
+};
+
+/**
+* Streams a tree, or a subtree of it, in one of the formats above. Unlike
+* prettyPrintBST() it has no height limit: the walk is iterative and keeps
+* one stack frame per level, so a multi-million-node tree is written in O(n)
+* time and O(height) memory, straight to the stream.
+*
+* Every node carries the metadata its tree reports through annotateNode()
+* (an AVL balance, a red-black color), plus hidden=1 for nodes the tree's
+* iterators skip. With maxDepth > 0 only that many levels are written and a
+* node whose children were cut off is marked as truncated.
+*/
+template <typename Key, typename Value>
+class TreeExporter
+{
+public:
+    static void write(const BinarySearchTree<Key, Value>& tree, Node<Key, Value>* root,
+                      std::ostream& os, TreeExportFormat format, int maxDepth);
+    static Node<Key, Value>* rootOf(const BinarySearchTree<Key, Value>& tree);
+    static Node<Key, Value>* findNode(const BinarySearchTree<Key, Value>& tree, const Key& key);
+
+protected:
+    typedef std::vector<std::pair<const char*, int> > Fields;
+
+    struct Frame
+    {
+        Frame(Node<Key, Value>* n, int d, size_t i) : node(n), depth(d), id(i), next(0) { }
+        Node<Key, Value>* node;
+        int depth;      // root of the export is 0
+        size_t id;      // preorder number, names DOT nodes
+        int next;       // child to visit next: 0 left, 1 right, 2 done
+    };
+
+    // helper - format-specific output around the shared walk
+    static void beginNode(std::ostream& os, TreeExportFormat format, const Frame& frame,
+                          const Frame* parent, int side, std::string& prefix,
+                          const Fields& fields, bool hidden, std::ostringstream& scratch);
+    static void missingChild(std::ostream& os, TreeExportFormat format, const Frame& parent,
+                             int side, const std::string& prefix);
+    static void truncated(std::ostream& os, TreeExportFormat format, const Frame& frame,
+                          const std::string& prefix);
+    static void endNode(std::ostream& os, TreeExportFormat format);
+
+    // helper - escaped for a DOT label or JSON string
+    template <typename T>
+    static void writeQuoted(std::ostream& os, const T& item, std::ostringstream& scratch);
+    // helper - numbers bare, everything else quoted
+    template <typename T>
+    static void writeJson(std::ostream& os, const T& item, std::ostringstream& scratch);
+    template <typename T>
+    static void writeJson(std::ostream& os, const T& item, std::ostringstream& scratch, std::true_type);
+    template <typename T>
+    static void writeJson(std::ostream& os, const T& item, std::ostringstream& scratch, std::false_type);
+};
+
+/**
+* Writes all of tree, or its top maxDepth levels when maxDepth > 0.
+*/
+template <typename Key, typename Value>
+void exportTree(const BinarySearchTree<Key, Value>& tree, std::ostream& os,
+                TreeExportFormat format = EXPORT_TEXT, int maxDepth = 0)
+{
+    TreeExporter<Key, Value>::write(tree, TreeExporter<Key, Value>::rootOf(tree), os, format, maxDepth);
+}
+
+/**
+* Writes the subtree rooted at key, or its top maxDepth levels when
+* maxDepth > 0. Returns false, writing nothing, when key is not in tree.
+*/
+template <typename Key, typename Value>
+bool exportSubtree(const BinarySearchTree<Key, Value>& tree, const Key& key, std::ostream& os,
+                   TreeExportFormat format = EXPORT_TEXT, int maxDepth = 0)
+{
+    Node<Key, Value>* root = TreeExporter<Key, Value>::findNode(tree, key);
+    if(root == NULL) {
+        return false;
+    }
+    TreeExporter<Key, Value>::write(tree, root, os, format, maxDepth);
+    return true;
+}
+
+/*
+-----------------------------------------------
+Begin implementations for the TreeExporter class.
+-----------------------------------------------
+*/
+
+template <typename Key, typename Value>
+Node<Key, Value>* TreeExporter<Key, Value>::rootOf(const BinarySearchTree<Key, Value>& tree)
+{
+    return tree.root_;
+}
+
+template <typename Key, typename Value>
+Node<Key, Value>* TreeExporter<Key, Value>::findNode(const BinarySearchTree<Key, Value>& tree, const Key& key)
+{
+    return tree.internalFind(key);
+}
+
+template <typename Key, typename Value>
+void TreeExporter<Key, Value>::write(const BinarySearchTree<Key, Value>& tree, Node<Key, Value>* root,
+                                     std::ostream& os, TreeExportFormat format, int maxDepth)
+{
+    if(format == EXPORT_DOT) {
+        os << "digraph BST {\n    node [shape=box];\n";
+    }
+    if(root == NULL) {
+        if(format == EXPORT_JSON) {
+            os << "null\n";
+        }
+        else if(format == EXPORT_DOT) {
+            os << "}\n";
+        }
+        return;
+    }
+
+    std::vector<Frame> stack;
+    std::string prefix;     // text indentation of the current level
+    Fields fields;
+    std::ostringstream scratch;
+    size_t nextId = 0;
+
+    tree.annotateNode(root, fields);
+    stack.push_back(Frame(root, 0, nextId++));
+    beginNode(os, format, stack.back(), NULL, -1, prefix, fields, tree.isHiddenNode(root), scratch);
+
+    while(!stack.empty()) {
+        Frame& top = stack.back();
+        Node<Key, Value>* left = top.node->getLeft();
+        Node<Key, Value>* right = top.node->getRight();
+        if(top.next == 0 && left == NULL && right == NULL) {
+            top.next = 2;
+        }
+        else if(top.next == 0 && maxDepth > 0 && top.depth + 1 >= maxDepth) {
+            truncated(os, format, top, prefix);
+            top.next = 2;
+        }
+
+        if(top.next == 2) {
+            endNode(os, format);
+            stack.pop_back();
+            // drop the indentation this level added
+            if(format == EXPORT_TEXT && !stack.empty()) {
+                prefix.resize(prefix.size() - 4);
+            }
+            continue;
+        }
+
+        int side = top.next++;
+        Node<Key, Value>* child = (side == 0) ? left : right;
+        if(child == NULL) {
+            missingChild(os, format, top, side, prefix);
+            continue;
+        }
+        fields.clear();
+        tree.annotateNode(child, fields);
+        Frame frame(child, top.depth + 1, nextId++);
+        // beginNode before the push: it still reads the parent frame
+        beginNode(os, format, frame, &top, side, prefix, fields, tree.isHiddenNode(child), scratch);
+        stack.push_back(frame);
+    }
+
+    if(format == EXPORT_DOT) {
+        os << "}\n";
+    }
+    else if(format == EXPORT_JSON) {
+        os << "\n";
+    }
+}
+
+template <typename Key, typename Value>
+void TreeExporter<Key, Value>::beginNode(std::ostream& os, TreeExportFormat format, const Frame& frame,
+                                         const Frame* parent, int side, std::string& prefix,
+                                         const Fields& fields, bool hidden, std::ostringstream& scratch)
+{
+    Node<Key, Value>* node = frame.node;
+    if(format == EXPORT_TEXT) {
+        if(parent != NULL) {
+            os << prefix << (side == 0 ? "|-- L " : "`-- R ");
+            prefix += (side == 0) ? "|   " : "    ";
+        }
+        os << node->getKey() << ": " << node->getValue();
+        for(size_t i = 0; i < fields.size(); ++i) {
+            os << "  " << fields[i].first << "=" << fields[i].second;
+        }
+        if(hidden) {
+            os << "  hidden=1";
+        }
+        os << "\n";
+    }
+    else if(format == EXPORT_DOT) {
+        os << "    n" << frame.id << " [label=\"";
+        writeQuoted(os, node->getKey(), scratch);
+        os << ": ";
+        writeQuoted(os, node->getValue(), scratch);
+        for(size_t i = 0; i < fields.size(); ++i) {
+            os << "\\n" << fields[i].first << "=" << fields[i].second;
+        }
+        os << "\"" << (hidden ? ", style=dashed" : "") << "];\n";
+        if(parent != NULL) {
+            os << "    n" << parent->id << " -> n" << frame.id
+               << " [label=\"" << (side == 0 ? "L" : "R") << "\"];\n";
+        }
+    }
+    else {
+        if(parent != NULL) {
+            os << (side == 0 ? ",\"left\":" : ",\"right\":");
+        }
+        os << "{\"key\":";
+        writeJson(os, node->getKey(), scratch);
+        os << ",\"value\":";
+        writeJson(os, node->getValue(), scratch);
+        for(size_t i = 0; i < fields.size(); ++i) {
+            os << ",\"" << fields[i].first << "\":" << fields[i].second;
+        }
+        if(hidden) {
+            os << ",\"hidden\":1";
+        }
+    }
+}
+
+template <typename Key, typename Value>
+void TreeExporter<Key, Value>::missingChild(std::ostream& os, TreeExportFormat format, const Frame& /*parent*/,
+                                            int side, const std::string& prefix)
+{
+    if(format == EXPORT_TEXT) {
+        os << prefix << (side == 0 ? "|-- L -\n" : "`-- R -\n");
+    }
+    else if(format == EXPORT_JSON) {
+        os << (side == 0 ? ",\"left\":null" : ",\"right\":null");
+    }
+}
+
+template <typename Key, typename Value>
+void TreeExporter<Key, Value>::truncated(std::ostream& os, TreeExportFormat format, const Frame& frame,
+                                         const std::string& prefix)
+{
+    if(format == EXPORT_TEXT) {
+        os << prefix << "`-- ...\n";
+    }
+    else if(format == EXPORT_DOT) {
+        os << "    t" << frame.id << " [label=\"...\", shape=plaintext];\n"
+           << "    n" << frame.id << " -> t" << frame.id << " [style=dashed];\n";
+    }
+    else {
+        os << ",\"truncated\":true";
+    }
+}
+
+template <typename Key, typename Value>
+void TreeExporter<Key, Value>::endNode(std::ostream& os, TreeExportFormat format)
+{
+    if(format == EXPORT_JSON) {
+        os << "}";
+    }
+}
+
+template <typename Key, typename Value>
+template <typename T>
+void TreeExporter<Key, Value>::writeQuoted(std::ostream& os, const T& item, std::ostringstream& scratch)
+{
+    scratch.str("");
+    scratch.clear();
+    scratch << item;
+    const std::string& text = scratch.str();
+    for(size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if(c == '"' || c == '\\') {
+            os << '\\' << c;
+        }
+        else if(c == '\n') {
+            os << "\\n";
+        }
+        else if((unsigned char)c < 0x20) {
+            os << ' ';
+        }
+        else {
+            os << c;
+        }
+    }
+}
+
+template <typename Key, typename Value>
+template <typename T>
+void TreeExporter<Key, Value>::writeJson(std::ostream& os, const T& item, std::ostringstream& scratch)
+{
+    // chars are letters in this code base (tree keys like 'a'), so quote them
+    writeJson(os, item, scratch, std::integral_constant<bool,
+              std::is_arithmetic<T>::value && !std::is_same<T, char>::value && !std::is_same<T, bool>::value>());
+}
+
+template <typename Key, typename Value>
+template <typename T>
+void TreeExporter<Key, Value>::writeJson(std::ostream& os, const T& item, std::ostringstream& /*scratch*/, std::true_type)
+{
+    // unary + widens signed/unsigned char to a number
+    os << +item;
+}
+
+template <typename Key, typename Value>
+template <typename T>
+void TreeExporter<Key, Value>::writeJson(std::ostream& os, const T& item, std::ostringstream& scratch, std::false_type)
+{
+    os << '"';
+    writeQuoted(os, item, scratch);
+    os << '"';
+}
+
+/*
+-----------------------------------------------
+End implementations for the TreeExporter class.
+-----------------------------------------------
+*/
+
+#endif
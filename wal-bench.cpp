@@ -0,0 +1,157 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include "durableavl.h"
+#include "rbbst.h"
+#include "checkpointtree.h"
+
+using namespace std;
+
+// Usage: ./wal-bench [numOps] [dir]
+//
+// Times numOps random inserts/removes on a DurableAVLTree under each fsync
+// policy and reports ns/op and fsyncs/op, then times a checkpoint and the
+// recovery of the result. Last it fills a CheckpointedTree with numOps * 20
+// items and reports writer latency while a background checkpoint of it runs,
+// next to a stop-the-world checkpoint of the same map. dir defaults to a fresh
+// directory under /tmp and must be on the disk whose durability cost you want
+// to see.
+
+typedef chrono::steady_clock Clock;
+
+// remove the tree's files so every run starts from an empty map
+void resetDir(const string& dir)
+{
+    unlink((dir + "/wal").c_str());
+    unlink((dir + "/checkpoint").c_str());
+    unlink((dir + "/checkpoint.tmp").c_str());
+}
+
+void runPolicy(const char* name, WalSyncPolicy policy, size_t groupSize, const string& dir, size_t numOps)
+{
+    resetDir(dir);
+    mt19937_64 gen(370);
+    uniform_int_distribution<uint64_t> keyDist(0, numOps);
+
+    DurableAVLTree<uint64_t, uint64_t> tree(dir, policy, groupSize);
+    Clock::time_point start = Clock::now();
+    for(size_t i = 0; i < numOps; ++i) {
+        uint64_t key = keyDist(gen);
+        if(i % 4 == 3) {
+            tree.remove(key);
+        }
+        else {
+            tree.insert(make_pair(key, (uint64_t)i));
+        }
+    }
+    tree.sync();
+    Clock::time_point stop = Clock::now();
+
+    cout << left << setw(28) << name << right << fixed << setprecision(1)
+         << setw(14) << chrono::duration<double, nano>(stop - start).count() / numOps
+         << setw(14) << setprecision(4) << (double)tree.syncCount() / numOps << endl;
+}
+
+// writer latency with a background checkpoint running, then the pause a
+// foreground checkpoint of the same items would cause
+void runBackgroundCheckpoint(const string& dir, size_t numItems)
+{
+    mt19937_64 gen(380);
+    uniform_int_distribution<uint64_t> keyDist(0, 2 * numItems);
+    CheckpointedTree<uint64_t, uint64_t, RedBlackTree<uint64_t, uint64_t> > tree;
+    for(size_t i = 0; i < numItems; ++i) {
+        tree.insert(make_pair(keyDist(gen), (uint64_t)i));
+    }
+
+    string path = dir + "/checkpoint";
+    tree.startCheckpoint(path);
+    size_t ops = 0;
+    for( ; tree.checkpointRunning(); ++ops) {
+        uint64_t key = keyDist(gen);
+        if(ops % 4 == 3) {
+            tree.remove(key);
+        }
+        else {
+            tree.insert(make_pair(key, (uint64_t)ops));
+        }
+    }
+    CheckpointStats stats = tree.waitCheckpoint();
+
+    cout << endl << "background checkpoint of " << stats.items << " items: "
+         << stats.seconds * 1000 << " ms, " << stats.bytes << " bytes" << endl;
+    cout << "  writes meanwhile: " << stats.writerOps << ", p50 <= " << stats.writerP50Ns
+         << " ns, p99 <= " << stats.writerP99Ns << " ns, max " << stats.writerMaxNs << " ns" << endl;
+    cout << "  peak pre-images: " << stats.peakPreimages << endl;
+
+    // a writer arriving during this would wait for all of it
+    Clock::time_point start = Clock::now();
+    string buf;
+    for(RedBlackTree<uint64_t, uint64_t>::iterator it = tree.begin(); it != tree.end(); ++it) {
+        WalCodec<uint64_t>::encode(it->first, buf);
+        WalCodec<uint64_t>::encode(it->second, buf);
+    }
+    FILE* out = fopen(path.c_str(), "wb");
+    if(out != NULL) {
+        fwrite(buf.data(), 1, buf.size(), out);
+        fflush(out);
+        fsync(fileno(out));
+        fclose(out);
+    }
+    cout << "stop-the-world checkpoint: writers paused "
+         << chrono::duration<double, milli>(Clock::now() - start).count() << " ms" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t numOps = 5000;
+    string dir;
+    if(argc > 1) { numOps = strtoul(argv[1], NULL, 10); }
+    if(argc > 2) {
+        dir = argv[2];
+    }
+    else {
+        char tmpl[] = "/tmp/wal-bench-XXXXXX";
+        if(mkdtemp(tmpl) == NULL) {
+            perror("mkdtemp");
+            return 1;
+        }
+        dir = tmpl;
+    }
+
+    cout << "ops: " << numOps << ", dir: " << dir << endl;
+    cout << left << setw(28) << "policy" << right << setw(14) << "ns/op" << setw(14) << "fsyncs/op" << endl;
+    runPolicy("every op", WAL_SYNC_EVERY, 1, dir, numOps);
+    runPolicy("group commit of 16", WAL_SYNC_GROUP, 16, dir, numOps);
+    runPolicy("group commit of 256", WAL_SYNC_GROUP, 256, dir, numOps);
+    runPolicy("no fsync", WAL_SYNC_NONE, 1, dir, numOps);
+
+    // the last run left its log behind: time replaying it, then a checkpoint,
+    // then loading that checkpoint
+    {
+        Clock::time_point start = Clock::now();
+        DurableAVLTree<uint64_t, uint64_t> tree(dir);
+        Clock::time_point mid = Clock::now();
+        cout << endl << "replay " << tree.recoveredRecords() << " log records: "
+             << chrono::duration<double, milli>(mid - start).count() << " ms" << endl;
+        tree.checkpoint();
+        cout << "checkpoint: " << chrono::duration<double, milli>(Clock::now() - mid).count() << " ms" << endl;
+    }
+    {
+        Clock::time_point start = Clock::now();
+        DurableAVLTree<uint64_t, uint64_t> tree(dir);
+        cout << "load checkpoint: " << chrono::duration<double, milli>(Clock::now() - start).count() << " ms" << endl;
+    }
+
+    runBackgroundCheckpoint(dir, numOps * 20);
+
+    resetDir(dir);
+    if(argc <= 2) {
+        rmdir(dir.c_str());
+    }
+    return 0;
+}